@@ -7,15 +7,10 @@
 #include <stdlib.h>
 
 #include "obj_loader.h"
+#include "simd_math.h"
 
 #define BINS 16
 
-typedef struct 
-{
-    float min[3];
-    float max[3];
-} AABB;
-
 typedef struct 
 {
     float min[3];
@@ -23,7 +18,8 @@ typedef struct
     int count;
 } Bin;
 
-typedef struct 
+// Tagged so MeshData can point at stored trees without including this header
+typedef struct BVHNode
 {
     float aabbMin[3];
     uint32_t leftFirst;
@@ -49,8 +45,45 @@ void updateNodeBounds(BVH* bvh, uint32_t nodeIdx, MeshData* mesh, const uint32_t
 
 void subdivideSAH(BVH* bvh, uint32_t nodeIdx, MeshData* mesh);
 
+// Copies mesh->bvhNodes instead of building when the mesh brings its own tree.
+// The root box is the mesh bounds when they are set. Nodes come from allocate,
+// malloc or allocFirstTouch, and are freed with free. No logging, for callers
+// building many trees. 0, with bvh->nodes NULL, when the allocation fails.
+int buildBVHNodes(BVH* bvh, MeshData* mesh, void* (*allocate)(size_t));
+
+// buildBVHNodes with allocFirstTouch, then reports the tree
 void buildBVH(BVH* bvh, MeshData* mesh);
 
+// Binary tree over count boxes, median split on the widest centroid axis.
+// slots[i] receives the node that stands in for box i, the caller fills it in.
+int buildBVHTopLevel(BVH* top, const AABB* bounds, uint32_t count, uint32_t* slots);
+
+// Median split tree over boxes with up to leafSize per leaf, for primitives the
+// shader tests directly such as spheres. Leaves cover ranges of order, which
+// receives the box behind every position.
+int buildBoxBVH(BVH* bvh, const AABB* bounds, uint32_t count, uint32_t leafSize, uint32_t* order);
+
+// A few spheres per leaf keep small sphere counts at one box test
+#define SPHERE_LEAF_SIZE 4
+
+// Moves a node of a finished tree whose nodes 1.. now start at nodeBase and
+// whose leaf triangles start at triangleBase. The old root goes into a slot.
+void relocateBVHNode(BVHNode* node, uint32_t nodeBase, uint32_t triangleBase);
+
+// Joins finished trees under a top level, tree i indexes triangles from triangleBases[i]
+int mergeBVHSubtrees(BVH* merged, const BVH* subtrees, const uint32_t* triangleBases, uint32_t count);
+
+// Recomputes every box after vertices moved, tree shape and triangle order stay
+void refitBVH(BVH* bvh, MeshData* mesh);
+
+// Grows every box by amount on each side, plus two ulps outward for the
+// rounding of the padding itself. For trees traversed over vertices that
+// decode up to amount away from the ones the tree was built on.
+void padBVHBounds(BVH* bvh, float amount);
+
+// Surface area heuristic cost relative to the root box, compares a refitted tree with a fresh build
+float computeBVHCost(const BVH* bvh);
+
 void analyzeBVH(BVH* bvh);
 
 void getStatsRecursive(BVH* bvh, uint32_t nodeIdx, int currentDepth, BVHStats* stats);
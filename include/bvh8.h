@@ -0,0 +1,58 @@
+#ifndef BVH8_H
+#define BVH8_H
+
+#include <stdint.h>
+
+#include "bvh.h"
+#include "cpu_trace.h"
+
+// 8 wide BVH collapsed from the binary buildBVH output for single ray CPU
+// traversal. Uses AVX2 when the file is built with -mavx2 -mfma (make AVX2=1),
+// otherwise the same layout is traversed with scalar loops.
+
+#define BVH8_WIDTH 8
+#define BVH8_EMPTY 0xFFFFFFFFu
+#define BVH8_LEAF_BIT 0x80000000u
+
+// Child boxes in SoA so one ray tests all 8 at once, empty slots have
+// inverted boxes and never hit
+typedef struct
+{
+    float minX[BVH8_WIDTH];
+    float minY[BVH8_WIDTH];
+    float minZ[BVH8_WIDTH];
+    float maxX[BVH8_WIDTH];
+    float maxY[BVH8_WIDTH];
+    float maxZ[BVH8_WIDTH];
+
+    // Internal: node index, leaf: BVH8_LEAF_BIT | first block
+    uint32_t child[BVH8_WIDTH];
+    uint32_t blockCount[BVH8_WIDTH];
+} BVH8Node;
+
+// 8 leaf triangles in SoA, padding lanes have NaN vertices and triIndex NO_HIT
+typedef struct
+{
+    float v0[3][BVH8_WIDTH];
+    float v1[3][BVH8_WIDTH];
+    float v2[3][BVH8_WIDTH];
+    uint32_t triIndex[BVH8_WIDTH];
+} TriangleBlock8;
+
+typedef struct
+{
+    BVH8Node* nodes;
+    uint32_t nodeCount;
+
+    TriangleBlock8* blocks;
+    uint32_t blockCount;
+} BVH8;
+
+// bvh and triangles must come from the same buildBVH pass
+int buildBVH8(BVH8* wide, const BVH* bvh, const PrecomputedTriangle* triangles);
+void freeBVH8(BVH8* wide);
+
+// Closest hit, hit->t must be initialised to the max distance
+void traceBVH8(const BVH8* wide, const float* ro, const float* rd, RayHit* hit);
+
+#endif
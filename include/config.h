@@ -0,0 +1,44 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "thread_pool.h"
+#include "scene_watch.h"
+
+// Runtime knobs, read once from the environment. A malformed or out of range
+// value is reported and the default kept.
+// GLT_THREADS   worker count, 0 or unset = all CPUs
+// GLT_PINNING   none | compact | scatter
+// GLT_WELD      vertex weld tolerance in model units, 0 = exact duplicates, unset = off
+// GLT_PARALLEL_LOAD  0 loads scene meshes one after another, default 1
+// GLT_WATCH     1 reloads the scene when it or its meshes change on disk,
+//               poll checks timestamps instead of inotify (network shares)
+// GLT_CHUNK_SIZE    cell edge in world units, uploads only the cells near the camera, unset = off
+// GLT_CHUNK_BUDGET  GPU megabytes the resident cells may use, default 512
+// GLT_CHUNK_CACHE   existing directory for cell files, cells then leave memory when evicted
+// GLT_OFFSCREEN     image path, renders without a window and writes a PPM there on exit
+// GLT_FRAMES        accumulation frames before the offscreen image is written, default 64
+// GLT_SIZE          offscreen resolution as WxH, default 1920x1080
+// GLT_CAMERA        start camera as x,y,z,yaw,pitch
+// GLT_SKY           day | night | sunset, the starting N key setting, default night
+// GLT_DENOISE       0 starts with the denoiser off like the F key, default 1
+typedef struct
+{
+    ThreadPoolConfig threads;
+    float weldTolerance;    // < 0 disables welding
+    int parallelLoad;       // Scene mesh sources loaded concurrently on the pool
+    WatchMode watch;
+    float chunkSize;        // 0 disables chunked scenes
+    size_t chunkBudget;     // Bytes
+    const char* chunkCache; // NULL keeps every cell in memory
+    const char* offscreenPath;  // NULL opens a window
+    int offscreenFrames;
+    int offscreenWidth, offscreenHeight;
+    int hasCamera;
+    float camera[5];        // x, y, z, yaw, pitch
+    int sky;                // u_isDay: 0 day, 1 night, 2 sunset
+    int denoise;
+} GltConfig;
+
+const GltConfig* getConfig(void);
+
+#endif
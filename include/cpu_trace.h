@@ -0,0 +1,27 @@
+#ifndef CPU_TRACE_H
+#define CPU_TRACE_H
+
+#include <stdint.h>
+
+#include "bvh.h"
+#include "triangle.h"
+#include "vertex_quant.h"
+
+#define NO_HIT 0xFFFFFFFFu
+
+typedef struct 
+{
+    float t;
+    float u, v;
+    uint32_t triIndex;
+} RayHit;
+
+// Closest hit over the binary BVH, scalar reference for the wide kernels
+void traceBVH(const BVH* bvh, const PrecomputedTriangle* triangles, const float* ro, const float* rd, RayHit* hit);
+
+// Same traversal, triangles decoded from quantizeMesh output through the leaf
+// ordered indices, the CPU twin of the QUANTIZED_VERTICES shader path. The
+// boxes must hold the decoded triangles, padBVHBounds by frame->maxError.
+void traceBVHQuantized(const BVH* bvh, const QuantizedVertex* vertices, const uint32_t* indices, const QuantizationFrame* frame, const float* ro, const float* rd, RayHit* hit);
+
+#endif
@@ -1,6 +1,39 @@
 #ifndef FILE_UTIL_H
 #define FILE_UTIL_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Whole file view, either mapped or read into a heap buffer. Mappings are
+// private copy on write, writing through them never reaches the file.
+typedef struct
+{
+    const char* data;
+    size_t size;
+
+    int mapped;
+    void* mapping;  // Windows file mapping handle
+    int references; // Owners of a shareMappedFile copy
+} MappedFile;
+
 char* readFileToString(const char* filename);
 
-#endif
\ No newline at end of file
+// Maps the file, falls back to reading it into memory when mapping fails
+int mapFile(const char* filename, MappedFile* file);
+void unmapFile(MappedFile* file);
+
+// Moves file to the heap for several owners, like a binary scene and its
+// embedded meshes. The caller holds the first reference, retainMappedFile
+// adds one and releaseMappedFile unmaps and frees at the last. NULL, with
+// file unmapped, when the allocation fails.
+MappedFile* shareMappedFile(MappedFile* file);
+void retainMappedFile(MappedFile* file);
+void releaseMappedFile(MappedFile* file);
+
+// ftell and fseek with 64 bit offsets, long is 32 bits on Windows. tellFile
+// returns -1 on failure, seekFile 0 on success like fseek.
+int64_t tellFile(FILE* file);
+int seekFile(FILE* file, int64_t offset, int origin);
+
+#endif
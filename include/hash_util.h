@@ -0,0 +1,10 @@
+#ifndef HASH_UTIL_H
+#define HASH_UTIL_H
+
+#include <stdint.h>
+
+// 32 bit integer finalizer (lowbias32), for hash table slots and stateless
+// per index random numbers. scene_writer.py carries the same hash.
+uint32_t hashUint(uint32_t x);
+
+#endif
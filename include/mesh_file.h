@@ -0,0 +1,75 @@
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "file_util.h"
+#include "obj_loader.h"
+
+// Preprocessed mesh (.gltm) loaded by mapping it and pointing MeshData into the
+// view. Sections start on 16 byte boundaries, native byte order.
+// Version 2 adds the BVH section, version 1 files still load.
+
+#define MESH_FILE_MAGIC "GLTMESH"
+#define MESH_FILE_VERSION 2
+#define MESH_FILE_ALIGN 16
+
+#define MESH_FILE_HAS_MATERIALS 0x1u
+#define MESH_FILE_HAS_NORMALS 0x2u
+#define MESH_FILE_HAS_BVH 0x4u
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t triangleCount;
+    uint32_t normalCount;
+
+    float minBounds[3];
+    float maxBounds[3];
+
+    // Byte offsets from the file start, 0 for absent sections
+    uint64_t vertexOffset;          // GPUPackedVertex[vertexCount]
+    uint64_t indexOffset;           // uint32_t[indexCount]
+    uint64_t materialOffset;        // uint32_t[triangleCount]
+    uint64_t normalOffset;          // GPUPackedVertex[normalCount]
+    uint64_t normalIndexOffset;     // uint32_t[indexCount]
+    uint64_t fileSize;
+
+    // Version 2
+    uint64_t bvhOffset;             // BVHNode[bvhNodeCount] over the stored triangle order
+    uint32_t bvhNodeCount;
+    uint32_t reserved;
+} MeshFileHeader;
+
+#define MESH_FILE_V1_HEADER_SIZE offsetof(MeshFileHeader, bvhOffset)
+
+int isMeshFile(const MappedFile* file);
+
+// Takes ownership of file, it is released by freeMeshData. Quiet apart from
+// errors, loadObj and loadSceneFile report what they mapped.
+int loadMeshFile(const char* filename, MappedFile* file, MeshData* mesh);
+
+// Same for an image of size bytes starting offset bytes into file, used for
+// meshes embedded in binary scenes. file is a shareMappedFile copy, the mesh
+// takes a reference of its own and the caller keeps theirs.
+int loadMeshImage(const char* name, MappedFile* file, uint64_t offset, uint64_t size, MeshData* mesh);
+
+int writeMeshFile(const char* filename, const MeshData* mesh);
+
+// Writes the image at the current position, which must be MESH_FILE_ALIGN aligned
+int writeMeshImage(FILE* file, const MeshData* mesh);
+
+// Layout helpers for writers that stream sections instead of holding a MeshData.
+// placeMeshSection returns the aligned start of the next section (0 when empty),
+// padMeshSection zero fills the file from its current position up to offset.
+uint64_t placeMeshSection(uint64_t* end, size_t bytes);
+int padMeshSection(FILE* file, uint64_t offset);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef MESH_INGEST_H
+#define MESH_INGEST_H
+
+#include <stddef.h>
+
+// Out of core OBJ -> .gltm conversion for meshes too large to load whole.
+// The OBJ is read in fixed windows and spilled to disk, triangles are split
+// into spatial buckets small enough to build under memoryLimit bytes, every
+// bucket gets its own BVH in a spill file, and the subtrees are joined under
+// a top level while the output streams out. The result carries the BVH, so
+// loading it skips the build. Spill files sit next to the output. Only
+// positions are kept, vn normals are counted, reported and dropped.
+int ingestObj(const char* objPath, const char* meshPath, size_t memoryLimit);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include "obj_loader.h"
+
+// Quadric error edge collapse (Garland, Heckbert 1997). Fills lod with a new heap
+// mesh of at most targetTriangles triangles, or as close as the surface allows
+// without flipping faces. Open borders carry extra weight so outlines survive.
+// Normals and triangle materials are not carried over.
+int simplifyMesh(const MeshData* source, MeshData* lod, uint32_t targetTriangles);
+
+#endif
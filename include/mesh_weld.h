@@ -0,0 +1,11 @@
+#ifndef MESH_WELD_H
+#define MESH_WELD_H
+
+#include "obj_loader.h"
+
+// Merges vertices closer than tolerance on every axis (0 = exact duplicates),
+// remaps indices and drops triangles that end up with zero area.
+// Unreferenced vertices are removed, vertex order is kept otherwise.
+int weldMesh(MeshData* mesh, float tolerance);
+
+#endif
@@ -3,6 +3,11 @@
 
 #include <stdint.h>
 
+#include "file_util.h"
+
+// normalIndices entry for a face corner without vn
+#define OBJ_NO_NORMAL 0xFFFFFFFFu
+
 // Match std430 alignment for vec3 (16 Byte)
 typedef struct 
 {
@@ -24,8 +29,23 @@ typedef struct
     float maxBounds[3];
 
     uint32_t* triangleMaterials;
+
+    // vn data, NULL when the file has none. normalIndices runs parallel to
+    // indices and is OBJ_NO_NORMAL where a corner has no normal.
+    GPUPackedVertex* normals;
+    uint32_t* normalIndices;
+    uint32_t normalCount;
+
+    // Tree over the triangles in their stored order, only from ingested .gltm
+    // files and scenes built from them. buildBVH copies it instead of building.
+    struct BVHNode* bvhNodes;
+    uint32_t bvhNodeCount;
+
+    // Set for binary meshes: the arrays point into this view instead of the heap
+    MappedFile* mapping;
 } MeshData;
 
+// Accepts text OBJ and binary .gltm files, told apart by the file header
 int loadObj(const char* filename, MeshData* mesh);
 
 void freeMeshData(MeshData* mesh);
@@ -0,0 +1,21 @@
+#ifndef PARSE_UTIL_H
+#define PARSE_UTIL_H
+
+#include <stdint.h>
+
+// Locale independent number parsing over [p, end) shared by the OBJ and scene
+// loaders. Each returns the position after the number, or p when there is none.
+
+// Correctly rounded (round to nearest even, same result as strtof in the "C" locale)
+const char* parseFloat(const char* p, const char* end, float* out);
+
+// Optional sign, saturates at the int64 range
+const char* parseInt(const char* p, const char* end, int64_t* out);
+
+// Spaces, tabs and line breaks
+const char* skipWhitespace(const char* p, const char* end);
+
+// Spaces and tabs, stops at the line end for line based formats like OBJ
+const char* skipBlanks(const char* p, const char* end);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef SCENE_CHUNKS_H
+#define SCENE_CHUNKS_H
+
+#include <stddef.h>
+
+#include "bvh.h"
+#include "obj_loader.h"
+
+// Chunked scene mode for layouts too large to upload whole. The world mesh is
+// cut into square cells on the ground plane (x, z) by triangle centroid, every
+// cell gets a compact mesh and a BVH of its own. Only the cells nearest the
+// camera that fit the byte budget are uploaded, their trees joined under a top
+// level. Rays pass through cells that are not resident and see the sky.
+
+typedef struct
+{
+    int cellX, cellZ;
+    float minBounds[3];
+    float maxBounds[3];
+    uint32_t triangleCount;
+    size_t gpuBytes;        // Buffer bytes once uploaded, what the budget counts
+
+    // Leaf ordered, released on eviction when the cell has a cache file
+    MeshData mesh;
+    BVH bvh;
+
+    char* cachePath;        // .gltm with the cell's BVH, NULL keeps the cell in memory
+    int resident;
+} SceneChunk;
+
+typedef struct
+{
+    SceneChunk* chunks;
+    int chunkCount;
+    float cellSize;
+    size_t budget;
+
+    size_t residentBytes;
+    int residentCount;
+    float lastCamera[3];    // Residency only changes once the camera moved a quarter cell
+    int placed;
+} SceneChunks;
+
+// Splits world into cells of cellSize. With cacheDir every cell is written
+// there as cell_<x>_<z>.gltm and only loaded while resident.
+int buildSceneChunks(SceneChunks* chunks, const MeshData* world, float cellSize, size_t budget, const char* cacheDir);
+
+// Loads the cells nearest camera until the budget is spent, the nearest one
+// always, and evicts the rest. Returns 1 when the resident set changed.
+int updateChunkResidency(SceneChunks* chunks, const float* camera);
+
+// Resident cells as one mesh, triangles in leaf order under a merged BVH
+int buildResidentMesh(const SceneChunks* chunks, MeshData* mesh, BVH* bvh);
+
+void freeSceneChunks(SceneChunks* chunks);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <stdint.h>
+
+#include "file_util.h"
+#include "shader_structs.h"
+
+// Binary scene container (.glts). A header, a section table, then sections
+// on 16 byte boundaries in native byte order. Materials, instances and
+// spheres are stored as the runtime structs and used in place from the
+// mapping. Embedded meshes are whole .gltm images, BVH included when present.
+
+#define SCENE_FILE_MAGIC "GLTSCN"
+#define SCENE_FILE_VERSION 1
+#define SCENE_FILE_ALIGN 16
+
+#define SCENE_SECTION_MATERIALS 1   // Material[count]
+#define SCENE_SECTION_SOURCES 2     // count NUL terminated paths back to back
+#define SCENE_SECTION_INSTANCES 3   // MeshInstance[count], source indices into the unique paths
+#define SCENE_SECTION_SPHERES 4     // Sphere[count]
+#define SCENE_SECTION_LOD 5         // SceneLod[1]
+#define SCENE_SECTION_MESH 6        // .gltm image of source number count
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;      // SceneFileSection entries right after the header
+    uint64_t fileSize;
+} SceneFileHeader;
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t count;
+    uint32_t elementSize;       // sizeof the stored struct, 1 for byte sections
+    uint32_t reserved;
+    uint64_t offset;            // From the file start
+    uint64_t size;
+} SceneFileSection;
+
+int isSceneFile(const MappedFile* file);
+
+// Takes ownership of file, the scene keeps it until freeScene. Embedded
+// meshes are mapped into meshSources, the other sources only get their path.
+int loadSceneFile(const char* filename, MappedFile* file, SceneDescription* scene);
+
+// Sources with a loaded mesh are embedded when embedMeshes is set
+int writeSceneFile(const char* filename, const SceneDescription* scene, int embedMeshes);
+
+#endif
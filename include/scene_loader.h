@@ -3,7 +3,32 @@
 
 #include "shader_structs.h"
 
+// Text scenes and binary containers (scene_file.h), told apart by magic
 int loadScene(const char* scenePath, SceneDescription* scene);
+
+// Parse only: sources get their paths, meshes embedded in a binary scene are
+// mapped, nothing else is loaded and no LODs are built
+int readScene(const char* scenePath, SceneDescription* scene);
 void freeScene(SceneDescription* scene);
 
+// Loads the scene again for hot reload. Meshes of previous with the same path
+// move over instead of being parsed, except those listed in stalePaths.
+// loadedSources counts the meshes that had to be read. On failure previous
+// is left untouched, on success the caller frees it.
+int reloadScene(const char* scenePath, SceneDescription* previous, const char* const* stalePaths, int staleCount,
+    SceneDescription* scene, int* loadedSources);
+
+// What a reload changed, GEOMETRY means sources or instance meshes differ
+#define SCENE_DIFF_MATERIALS 0x1
+#define SCENE_DIFF_SPHERES 0x2
+#define SCENE_DIFF_TRANSFORMS 0x4
+#define SCENE_DIFF_INSTANCE_MATERIALS 0x8
+#define SCENE_DIFF_GEOMETRY 0x10
+
+int diffScenes(const SceneDescription* before, const SceneDescription* after);
+
+// Flattens every instance into one world space mesh. 0, with mesh empty, when
+// the totals pass 32 bit indices or an allocation fails.
+int buildSceneMesh(SceneDescription* scene, MeshData* mesh);
+
 #endif
\ No newline at end of file
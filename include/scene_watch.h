@@ -0,0 +1,48 @@
+#ifndef SCENE_WATCH_H
+#define SCENE_WATCH_H
+
+typedef enum
+{
+    WATCH_OFF,
+    WATCH_NOTIFY,   // inotify on the directories of the files, polling where it is missing
+    WATCH_POLL      // Timestamp and size checks twice a second
+} WatchMode;
+
+// Modification time to the nanosecond where the file system keeps it, and
+// size, so saves within the same second are still seen
+typedef struct
+{
+    long long seconds;
+    long long nanoseconds;
+    long long size;
+} FileStamp;
+
+// Watches a fixed list of files. Editors save by writing in place or by
+// renaming a new file over the old one, so directories are watched and
+// events matched by name.
+typedef struct
+{
+    char** paths;
+    int count;
+    int* changed;           // Set for the files of the batch pollSceneWatch reported
+
+    WatchMode mode;
+    FileStamp* stamps;      // Polling: modification time and size per file
+    double lastPoll;
+    double lastEvent;
+    int pending;
+    int reported;
+
+    int notifyFd;           // inotify descriptor, -1 when polling
+    int* notifyWatches;     // Watch descriptor of each file's directory
+} SceneWatch;
+
+int initSceneWatch(SceneWatch* watch, WatchMode mode, const char* const* paths, int count);
+
+// Non blocking. 1 once files changed and then stayed quiet for a moment, so a
+// save in several writes reloads once. changed[] holds the batch until the next call.
+int pollSceneWatch(SceneWatch* watch);
+
+void freeSceneWatch(SceneWatch* watch);
+
+#endif
@@ -11,6 +11,21 @@ typedef struct
     float focalLength;
 } Camera;
 
+// std140 block FrameData in raytrace.comp and denoise.comp, vec3s padded by the scalar after them
+typedef struct
+{
+    float cameraPos[3];
+    float cameraYaw;
+    float camForward[3];
+    float cameraPitch;
+    float camRight[3];
+    int32_t frameCount;
+    float camUp[3];
+    int32_t isDay;
+    float resolution[2];
+    float padding[2];
+} FrameUniforms;
+
 typedef struct 
 {
     float cr, cg, cb;
@@ -36,11 +51,24 @@ typedef struct
     Vec4 rotation;
     int materialIndex;
     int meshSourceIndex;
+    int lodLevel;           // -1 = picked from the distance to SceneLod.camera
 } MeshInstance;
 
+// Simplified copies of the sources for far instances, set by the lod directives
+typedef struct
+{
+    int levels;             // 0 = off
+    float ratio;            // Triangles of each level relative to the one before
+    int useCamera;
+    float camera[3];
+    float distance;         // Level 0 inside this, one level more per doubling
+} SceneLod;
+
 typedef struct 
 {
+    // LOD levels are appended after the loaded sources, their paths end in #lodN
     MeshData* meshSources;
+    char** sourcePaths;     // Unique, meshSources[i] was loaded from sourcePaths[i]
     int numberOfSources;
 
     MeshInstance* meshInstances;
@@ -51,6 +79,11 @@ typedef struct
 
     Sphere* spheres;
     int sphereCount;
+
+    SceneLod lod;
+
+    // Binary scenes: materials, instances and spheres point into this view
+    MappedFile* mapping;
 } SceneDescription;
 
 #endif
\ No newline at end of file
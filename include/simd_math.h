@@ -0,0 +1,51 @@
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include <stddef.h>
+
+#include "matrix.h"
+
+// Affine transforms and batched transforms over arrays, SSE where the target
+// has it. Every batched routine has a scalar version with the same arithmetic
+// in the same order, the SIMD ones give the same bits and fall back to them
+// for tails and targets without SSE2.
+
+// Top three rows of a 4x4 transform, m[r][3] is the translation
+typedef struct
+{
+    float m[3][4];
+} Affine3x4;
+
+typedef struct
+{
+    float min[3];
+    float max[3];
+} AABB;
+
+Affine3x4 affineFromMat4(const Mat4* m);
+Affine3x4 affineMultiply(const Affine3x4* a, const Affine3x4* b);
+
+// Return 0 and leave the output alone when the 3x3 part is singular
+int affineInverse(const Affine3x4* m, Affine3x4* inverse);
+
+// Inverse transpose of the 3x3 part with no translation, for transformVectors
+// on normals. Lengths are not kept, normalize after.
+int affineNormalMatrix(const Affine3x4* m, Affine3x4* normal);
+
+// Points and vectors are 4 floats apart (x, y, z, unused) like Vec4 and
+// GPUPackedVertex, the unused float is written as 0. in and out may be the
+// same array. minBounds and maxBounds grow by the results, NULL skips them.
+void transformPoints(const Affine3x4* m, const float* in, float* out, size_t count, float* minBounds, float* maxBounds);
+void transformPointsScalar(const Affine3x4* m, const float* in, float* out, size_t count, float* minBounds, float* maxBounds);
+
+// Like transformPoints without the translation
+void transformVectors(const Affine3x4* m, const float* in, float* out, size_t count);
+void transformVectorsScalar(const Affine3x4* m, const float* in, float* out, size_t count);
+
+// Box around the transformed box. Each term takes the lower or upper of its
+// two corner products, so the result holds every point transformPoints maps
+// from inside the source box, rounding included.
+void transformBoxes(const Affine3x4* m, const AABB* in, AABB* out, size_t count);
+void transformBoxesScalar(const Affine3x4* m, const AABB* in, AABB* out, size_t count);
+
+#endif
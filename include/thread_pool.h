@@ -0,0 +1,41 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+// Project wide worker pool, the loader, BVH builder and CPU tracer all run on it
+// instead of spawning their own threads
+
+typedef enum
+{
+    PIN_NONE,       // Leave placement to the OS
+    PIN_COMPACT,    // Fill one NUMA node before the next
+    PIN_SCATTER     // Round robin workers over NUMA nodes
+} PinPolicy;
+
+typedef struct
+{
+    int threadCount;    // 0 = every CPU the process may run on
+    PinPolicy pinning;
+} ThreadPoolConfig;
+
+// Called with [begin, end) of the parallelFor range on a worker
+typedef void (*ParallelTask)(void* context, size_t begin, size_t end, int worker);
+
+int threadPoolInit(const ThreadPoolConfig* config);
+void threadPoolShutdown(void);
+
+// 1 when the pool is not running, everything then runs on the caller
+int threadPoolSize(void);
+int threadPoolNodeCount(void);
+
+// grain 0 splits the range into one contiguous block per worker, the same
+// split allocFirstTouch uses, so a worker keeps working on its own node's pages.
+// Calls from inside a task run inline on that worker.
+void parallelFor(size_t count, size_t grain, ParallelTask task, void* context);
+
+// Zeroed allocation whose pages are first touched by the workers that will
+// process them, freed with free()
+void* allocFirstTouch(size_t bytes);
+
+#endif
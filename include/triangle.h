@@ -0,0 +1,49 @@
+#ifndef TRIANGLE_H
+#define TRIANGLE_H
+
+#include <stdint.h>
+
+#include "obj_loader.h"
+
+// Triangle test used by the CPU and GPU kernels
+// 1: watertight shear test over precomputed leaf ordered triangles
+// 0: original Moller-Trumbore over indices + vertices
+#ifndef WATERTIGHT_TRIANGLES
+#define WATERTIGHT_TRIANGLES 1
+#endif
+
+// Triangle vertices gathered in BVH leaf order, matches std430 (3x vec4)
+typedef struct 
+{
+    float v0[3];
+    float pad0;
+    float v1[3];
+    float pad1;
+    float v2[3];
+    float pad2;
+} PrecomputedTriangle;
+
+// Per ray constants for the watertight test (Woop, Benthin, Wald 2013)
+typedef struct 
+{
+    int kx, ky, kz;
+    float sx, sy, sz;
+} WatertightRay;
+
+// Call after buildBVH, triangle i follows the reordered mesh->indices
+PrecomputedTriangle* buildPrecomputedTriangles(const MeshData* mesh);
+
+// Geometric normals in the same leaf order, octahedral snorm 2x16 (4 bytes)
+uint32_t* buildTriangleNormals(const MeshData* mesh);
+
+uint32_t packOctNormal(const float* n);
+
+void setupWatertightRay(const float* rd, WatertightRay* ray);
+
+// Both return hit distance or -1.0f, same contract as raytrace.comp
+float hitTriangleIndexed(const MeshData* mesh, uint32_t triIdx, const float* ro, const float* rd);
+
+// bary (optional) receives the v1 and v2 weights
+float hitTriangleWatertight(const PrecomputedTriangle* tri, const float* ro, const WatertightRay* ray, float* bary);
+
+#endif
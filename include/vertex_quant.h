@@ -0,0 +1,46 @@
+#ifndef VERTEX_QUANT_H
+#define VERTEX_QUANT_H
+
+#include <stdint.h>
+
+#include "obj_loader.h"
+
+// 1: upload positions as 3x21 bit fixed point over the scene bounds (8 bytes
+// per vertex instead of 16) and gather triangles through the index buffer,
+// 0: float vertices and precomputed triangles
+#ifndef QUANTIZED_VERTICES
+#define QUANTIZED_VERTICES 0
+#endif
+
+#define QUANT_BITS 21
+#define QUANT_MAX ((1u << QUANT_BITS) - 1u)
+
+// Largest decode error allowed, as a fraction of the shortest triangle edge
+#define QUANT_MAX_EDGE_ERROR (1.0f / 32.0f)
+
+// x in lo[0:21], y in lo[21:32] + hi[0:10], z in hi[10:31], matches std430 uvec2
+typedef struct
+{
+    uint32_t lo;
+    uint32_t hi;
+} QuantizedVertex;
+
+// position = origin + q * step, per axis
+typedef struct
+{
+    float origin[3];
+    float step[3];
+    float maxError;
+} QuantizationFrame;
+
+void initQuantizationFrame(QuantizationFrame* frame, const float* minBounds, const float* maxBounds);
+
+QuantizedVertex quantizeVertex(const QuantizationFrame* frame, const float* p);
+void dequantizeVertex(const QuantizationFrame* frame, QuantizedVertex q, float* p);
+
+// Quantizes to the mesh bounds and measures the worst decode error against the
+// shortest edge. NULL when the mesh needs more precision than 21 bits give,
+// the caller keeps float vertices then. Free with free().
+QuantizedVertex* quantizeMesh(const MeshData* mesh, QuantizationFrame* frame);
+
+#endif
@@ -104,6 +104,8 @@ for x in range(10):
     )
 
 
-
+# Far copies of the city at a quarter of the triangles per doubling of distance
+set_lod(4, 0.25)
+set_lod_camera((0, 0, 0), 7000)
 
 write_scene("city_ns.scene")
@@ -1,4 +1,5 @@
 import os
+import struct
 
 SCENEBUILDER_DIR = os.path.dirname(os.path.abspath(__file__))
 
@@ -11,6 +12,11 @@ materials = []
 sources = []
 instances = []
 spheres = []
+generators = []
+
+lod = None
+lod_camera = None
+instance_lods = {}
 
 def add_material(r, g, b, visibility, roughness, metallic, emission, opacity):
     if visibility > 0.5:
@@ -39,13 +45,176 @@ def add_source(model_filename):
 def add_instance(pos, scale, rotation, material_index, source_index):
     instances.append((pos, scale, rotation, material_index, source_index))
 
+    return len(instances) - 1
+
+# Generators become grid / line / scatter directives, the loader expands them
+# into instances after the listed ones, in the order they were added
+def add_grid(pos, counts, step, scale, rotation, material_index, source_index):
+    generators.append(("grid", source_index, material_index, tuple(pos), tuple(counts), tuple(step), scale, rotation))
+
+    return len(generators) - 1
+
+# count instances evenly spaced from start to end, both included
+def add_line(start, end, count, scale, rotation, material_index, source_index):
+    generators.append(("line", source_index, material_index, count, tuple(start), tuple(end), scale, rotation))
+
+    return len(generators) - 1
+
+# Uniform in the box [lo, hi], rotation y turned by a random angle up to yaw
+def add_scatter(lo, hi, count, seed, scale, rotation, yaw, material_index, source_index):
+    generators.append(("scatter", source_index, material_index, count, seed, tuple(lo), tuple(hi), scale, rotation, yaw))
+
+    return len(generators) - 1
+
 def add_sphere(pos, radius, material_index):
     spheres.append((pos, radius, material_index))
 
+# Simplified copies of every source, each level keeps ratio of the triangles before it
+def set_lod(levels, ratio):
+    global lod
+    lod = (levels, ratio)
+
+# Instances pick level 0 inside distance of pos, one level more per doubling
+def set_lod_camera(pos, distance):
+    global lod_camera
+    lod_camera = (pos, distance)
+
+def set_instance_lod(instance_index, level):
+    instance_lods[instance_index] = level
+
+# Binary container layout, see include/scene_file.h. Records match the C structs
+SCENE_FILE_MAGIC = b"GLTSCN\0\0"
+SCENE_FILE_VERSION = 1
+SCENE_FILE_ALIGN = 16
+
+SCENE_SECTION_MATERIALS = 1
+SCENE_SECTION_SOURCES = 2
+SCENE_SECTION_INSTANCES = 3
+SCENE_SECTION_SPHERES = 4
+SCENE_SECTION_LOD = 5
+
+MATERIAL_RECORD = struct.Struct("=8f")
+INSTANCE_RECORD = struct.Struct("=12f3i")
+SPHERE_RECORD = struct.Struct("=4fi3f")
+LOD_RECORD = struct.Struct("=ifi4f")
+HEADER_RECORD = struct.Struct("=8sIIQ")
+SECTION_RECORD = struct.Struct("=IIIIQQ")
+
+def _f32(x):
+    return struct.unpack("=f", struct.pack("=f", x))[0]
+
+# Same hash as src/scene_loader.c, so both expansions agree
+def _hash_uint(x):
+    x &= 0xFFFFFFFF
+    x ^= x >> 16
+    x = (x * 0x7FEB352D) & 0xFFFFFFFF
+    x ^= x >> 15
+    x = (x * 0x846CA68B) & 0xFFFFFFFF
+    x ^= x >> 16
+    return x
+
+def _random_unit(seed, index, stream):
+    h = _hash_uint(seed ^ _hash_uint(index * 4 + stream))
+    return (h >> 8) / 16777216.0
+
+# Float32 steps in the loader's order, the binary scene matches the text one
+def _expand_generator(generator):
+    kind, src_idx, mat_idx = generator[:3]
+    out = []
+
+    if kind == "grid":
+        _, _, _, pos, counts, step, scale, rot = generator
+        for k in range(counts[2]):
+            for j in range(counts[1]):
+                for i in range(counts[0]):
+                    cell = (i, j, k)
+                    p = tuple(_f32(_f32(pos[a]) + _f32(_f32(step[a]) * cell[a])) for a in range(3))
+                    out.append((p, scale, rot, mat_idx, src_idx))
+    elif kind == "line":
+        _, _, _, count, start, end, scale, rot = generator
+        for i in range(count):
+            t = _f32(i / (count - 1)) if count > 1 else 0.0
+            p = tuple(_f32(_f32(start[a]) + _f32(_f32(_f32(end[a]) - _f32(start[a])) * t)) for a in range(3))
+            out.append((p, scale, rot, mat_idx, src_idx))
+    else:
+        _, _, _, count, seed, lo, hi, scale, rot, yaw = generator
+        for i in range(count):
+            p = tuple(_f32(_f32(lo[a]) + _f32(_f32(_f32(hi[a]) - _f32(lo[a])) * _random_unit(seed, i, a))) for a in range(3))
+            turned = (rot[0], _f32(_f32(rot[1]) + _f32(_f32(yaw) * _random_unit(seed, i, 3))), rot[2])
+            out.append((p, scale, turned, mat_idx, src_idx))
+
+    return out
+
+def _binary_sections():
+    sections = []
+
+    if materials:
+        data = b"".join(MATERIAL_RECORD.pack(*m) for m in materials)
+        sections.append((SCENE_SECTION_MATERIALS, len(materials), MATERIAL_RECORD.size, data))
+
+    if sources:
+        data = b"".join(s.encode("utf-8") + b"\0" for s in sources)
+        sections.append((SCENE_SECTION_SOURCES, len(sources), 1, data))
+
+    # The binary container stores generated instances expanded
+    expanded = list(instances)
+    for generator in generators:
+        expanded.extend(_expand_generator(generator))
+
+    if expanded:
+        records = []
+        for index, (pos, scale, rot, mat_idx, src_idx) in enumerate(expanded):
+            records.append(INSTANCE_RECORD.pack(
+                pos[0], pos[1], pos[2], 1.0,
+                scale[0], scale[1], scale[2], 1.0,
+                rot[0], rot[1], rot[2], 1.0,
+                mat_idx, src_idx, instance_lods.get(index, -1)))
+        sections.append((SCENE_SECTION_INSTANCES, len(expanded), INSTANCE_RECORD.size, b"".join(records)))
+
+    if spheres:
+        data = b"".join(SPHERE_RECORD.pack(pos[0], pos[1], pos[2], rad, mat_idx, 1.0, 1.0, 1.0) for pos, rad, mat_idx in spheres)
+        sections.append((SCENE_SECTION_SPHERES, len(spheres), SPHERE_RECORD.size, data))
+
+    if lod is not None or lod_camera is not None:
+        levels, ratio = lod if lod is not None else (0, 0.0)
+        (cx, cy, cz), distance = lod_camera if lod_camera is not None else ((0.0, 0.0, 0.0), 0.0)
+        data = LOD_RECORD.pack(levels, ratio, 1 if lod_camera is not None else 0, cx, cy, cz, distance)
+        sections.append((SCENE_SECTION_LOD, 1, LOD_RECORD.size, data))
+
+    return sections
+
+def _align(offset):
+    return (offset + SCENE_FILE_ALIGN - 1) & ~(SCENE_FILE_ALIGN - 1)
+
+# Meshes are not embedded here, glt-scene-convert --embed does that
+def write_scene_binary(output_path):
+    sections = _binary_sections()
+
+    table = []
+    offset = HEADER_RECORD.size + SECTION_RECORD.size * len(sections)
+    for section_type, count, element_size, data in sections:
+        offset = _align(offset)
+        table.append(SECTION_RECORD.pack(section_type, count, element_size, 0, offset, len(data)))
+        offset += len(data)
+
+    with open(output_path, "wb") as f:
+        f.write(HEADER_RECORD.pack(SCENE_FILE_MAGIC, SCENE_FILE_VERSION, len(sections), offset))
+        f.write(b"".join(table))
+        for _, _, _, data in sections:
+            f.write(b"\0" * (_align(f.tell()) - f.tell()))
+            f.write(data)
+
+    print(f"Scene written to: {output_path}")
+
+# .glts names get the binary container, anything else the text format
 def write_scene(scene_name):
     os.makedirs(SCENES_DIR, exist_ok=True)
     output_path = os.path.join(SCENES_DIR, scene_name)
 
+    if scene_name.endswith(".glts"):
+        write_scene_binary(output_path)
+        return
+
     with open(output_path, "w") as f:
         f.write(f"{len(materials)}\n")
         for m in materials:
@@ -78,4 +247,27 @@ def write_scene(scene_name):
                 f"{rad} {mat_idx}\n"
             )
 
+        if generators:
+            f.write("\n")
+        for generator in generators:
+            kind, src_idx, mat_idx = generator[:3]
+            if kind == "grid":
+                _, _, _, pos, counts, step, scale, rot = generator
+                fields = [*pos, *counts, *step, *scale, *rot]
+            elif kind == "line":
+                _, _, _, count, start, end, scale, rot = generator
+                fields = [count, *start, *end, *scale, *rot]
+            else:
+                _, _, _, count, seed, lo, hi, scale, rot, yaw = generator
+                fields = [count, seed, *lo, *hi, *scale, *rot, yaw]
+            f.write(f"{kind} {src_idx} {mat_idx} " + " ".join(str(v) for v in fields) + "\n")
+
+        if lod is not None:
+            f.write(f"\nlod {lod[0]} {lod[1]}\n")
+        if lod_camera is not None:
+            pos, distance = lod_camera
+            f.write(f"lod_camera {pos[0]} {pos[1]} {pos[2]} {distance}\n")
+        for index, level in instance_lods.items():
+            f.write(f"lod_instance {index} {level}\n")
+
     print(f"Scene written to: {output_path}")
\ No newline at end of file
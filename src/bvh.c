@@ -1,4 +1,9 @@
 #include "bvh.h"
+#include "thread_pool.h"
+
+#include <string.h>
+#include <math.h>
+
 float getSurfaceArea(float* min, float* max)
 {
     float x = max[0] - min[0];
@@ -224,25 +229,308 @@ void subdivideSAH(BVH* bvh, uint32_t nodeIdx, MeshData* mesh)
     subdivideSAH(bvh, rightChildIdx, mesh);
 }
 
-void buildBVH(BVH* bvh, MeshData* mesh)
+int buildBVHNodes(BVH* bvh, MeshData* mesh, void* (*allocate)(size_t))
 {
-    // Max potential nodes 2 * N - 1
-    bvh->nodes = malloc(sizeof(BVHNode) * mesh->triangleCount * 2);
+    if (mesh->bvhNodes)
+    {
+        bvh->nodes = allocate(sizeof(BVHNode) * mesh->bvhNodeCount);
+        if (!bvh->nodes)
+        {
+            fprintf(stderr, "Memory allocation for BVH nodes failed\n");
+            bvh->nodeCount = 0;
+            return 0;
+        }
+        memcpy(bvh->nodes, mesh->bvhNodes, sizeof(BVHNode) * mesh->bvhNodeCount);
+        bvh->nodeCount = mesh->bvhNodeCount;
+        return 1;
+    }
+
+    // Max potential nodes 2 * N - 1, an empty mesh still gets its root
+    size_t maxNodes = mesh->triangleCount > 0 ? 2 * (size_t)mesh->triangleCount : 1;
+    bvh->nodes = allocate(sizeof(BVHNode) * maxNodes);
     if (!bvh->nodes)
     {
-        fprintf(stderr, "Memory allocation for BVH nodes failed");
-        return;
+        fprintf(stderr, "Memory allocation for BVH nodes failed\n");
+        bvh->nodeCount = 0;
+        return 0;
     }
     bvh->nodeCount = 1;
     // Root node
     bvh->nodes[0].leftFirst = 0;
     bvh->nodes[0].triCount = mesh->triangleCount;
-    updateNodeBounds(bvh, 0, mesh, mesh->indices);
+
+    // Loaders and buildSceneMesh measure the mesh already, one more pass only without bounds
+    if (mesh->minBounds[0] <= mesh->maxBounds[0] && mesh->minBounds[1] <= mesh->maxBounds[1] && mesh->minBounds[2] <= mesh->maxBounds[2])
+    {
+        memcpy(bvh->nodes[0].aabbMin, mesh->minBounds, sizeof(mesh->minBounds));
+        memcpy(bvh->nodes[0].aabbMax, mesh->maxBounds, sizeof(mesh->maxBounds));
+    }
+    else {updateNodeBounds(bvh, 0, mesh, mesh->indices);}
     subdivideSAH(bvh, 0, mesh);
-    printf("BVH built\n");
+    return 1;
+}
+
+void buildBVH(BVH* bvh, MeshData* mesh)
+{
+    int reused = mesh->bvhNodes != NULL;
+    if (!buildBVHNodes(bvh, mesh, allocFirstTouch)) {return;}
+
+    printf(reused ? "BVH reused from mesh\n" : "BVH built\n");
     analyzeBVH(bvh);
 }
 
+typedef struct
+{
+    float key;
+    uint32_t box;
+} TopLevelItem;
+
+static int compareTopLevelItems(const void* a, const void* b)
+{
+    float ka = ((const TopLevelItem*)a)->key;
+    float kb = ((const TopLevelItem*)b)->key;
+
+    return (ka > kb) - (ka < kb);
+}
+
+// Median split until leafSize boxes remain, a leaf covers items [first, first + count)
+static void subdivideTopLevel(BVH* top, uint32_t nodeIdx, const AABB* bounds, TopLevelItem* items, uint32_t first, uint32_t count,
+    uint32_t leafSize, uint32_t* slots)
+{
+    BVHNode* node = &top->nodes[nodeIdx];
+    float centroidMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float centroidMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    node->aabbMin[0] = node->aabbMin[1] = node->aabbMin[2] = FLT_MAX;
+    node->aabbMax[0] = node->aabbMax[1] = node->aabbMax[2] = -FLT_MAX;
+
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const AABB* box = &bounds[items[i].box];
+        float centroid[3];
+
+        for (int a = 0; a < 3; a++) {centroid[a] = 0.5f * (box->min[a] + box->max[a]);}
+
+        growBounds(node->aabbMin, node->aabbMax, (float*)box->min);
+        growBounds(node->aabbMin, node->aabbMax, (float*)box->max);
+        growBounds(centroidMin, centroidMax, centroid);
+    }
+
+    if (count <= leafSize)
+    {
+        node->leftFirst = first;
+        node->triCount = count;
+        if (slots) {slots[items[first].box] = nodeIdx;}
+        return;
+    }
+
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+    {
+        if (centroidMax[a] - centroidMin[a] > centroidMax[axis] - centroidMin[axis]) {axis = a;}
+    }
+
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const AABB* box = &bounds[items[i].box];
+        items[i].key = box->min[axis] + box->max[axis];
+    }
+    qsort(items + first, count, sizeof(TopLevelItem), compareTopLevelItems);
+
+    uint32_t leftChildIdx = top->nodeCount++;
+    uint32_t rightChildIdx = top->nodeCount++;
+    uint32_t leftCount = count / 2;
+
+    node->leftFirst = leftChildIdx;
+    node->triCount = 0;
+
+    subdivideTopLevel(top, leftChildIdx, bounds, items, first, leftCount, leafSize, slots);
+    subdivideTopLevel(top, rightChildIdx, bounds, items, first + leftCount, count - leftCount, leafSize, slots);
+}
+
+int buildBVHTopLevel(BVH* top, const AABB* bounds, uint32_t count, uint32_t* slots)
+{
+    top->nodes = NULL;
+    top->nodeCount = 0;
+    if (count == 0) {return 0;}
+
+    top->nodes = calloc(2 * (size_t)count - 1, sizeof(BVHNode));
+    TopLevelItem* items = malloc(sizeof(TopLevelItem) * count);
+    if (!top->nodes || !items)
+    {
+        fprintf(stderr, "Memory allocation for BVH top level failed\n");
+        free(top->nodes);
+        free(items);
+        top->nodes = NULL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {items[i].box = i;}
+
+    top->nodeCount = 1;
+    subdivideTopLevel(top, 0, bounds, items, 0, count, 1, slots);
+
+    free(items);
+    return 1;
+}
+
+int buildBoxBVH(BVH* bvh, const AABB* bounds, uint32_t count, uint32_t leafSize, uint32_t* order)
+{
+    bvh->nodes = NULL;
+    bvh->nodeCount = 0;
+    if (count == 0 || leafSize == 0) {return 0;}
+
+    bvh->nodes = calloc(2 * (size_t)count - 1, sizeof(BVHNode));
+    TopLevelItem* items = malloc(sizeof(TopLevelItem) * count);
+    if (!bvh->nodes || !items)
+    {
+        fprintf(stderr, "Memory allocation for box BVH failed\n");
+        free(bvh->nodes);
+        free(items);
+        bvh->nodes = NULL;
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {items[i].box = i;}
+
+    bvh->nodeCount = 1;
+    subdivideTopLevel(bvh, 0, bounds, items, 0, count, leafSize, NULL);
+
+    for (uint32_t i = 0; i < count; i++) {order[i] = items[i].box;}
+
+    free(items);
+    return 1;
+}
+
+void relocateBVHNode(BVHNode* node, uint32_t nodeBase, uint32_t triangleBase)
+{
+    // Children come in pairs from index 1, the root itself is not stored
+    if (node->triCount > 0) {node->leftFirst += triangleBase;}
+    else {node->leftFirst = nodeBase + node->leftFirst - 1;}
+}
+
+int mergeBVHSubtrees(BVH* merged, const BVH* subtrees, const uint32_t* triangleBases, uint32_t count)
+{
+    merged->nodes = NULL;
+    merged->nodeCount = 0;
+    if (count == 0) {return 0;}
+
+    AABB* bounds = calloc(count, sizeof(AABB));
+    uint32_t* slots = calloc(count, sizeof(uint32_t));
+    BVH top = {0};
+
+    int ok = bounds && slots;
+    for (uint32_t i = 0; ok && i < count; i++)
+    {
+        memcpy(bounds[i].min, subtrees[i].nodes[0].aabbMin, sizeof(float) * 3);
+        memcpy(bounds[i].max, subtrees[i].nodes[0].aabbMax, sizeof(float) * 3);
+    }
+
+    ok = ok && buildBVHTopLevel(&top, bounds, count, slots);
+
+    size_t total = top.nodeCount;
+    for (uint32_t i = 0; ok && i < count; i++) {total += subtrees[i].nodeCount - 1;}
+
+    merged->nodes = ok ? allocFirstTouch(sizeof(BVHNode) * total) : NULL;
+    ok = ok && merged->nodes;
+
+    if (ok)
+    {
+        memcpy(merged->nodes, top.nodes, sizeof(BVHNode) * top.nodeCount);
+        uint32_t nodeBase = top.nodeCount;
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const BVH* subtree = &subtrees[i];
+
+            merged->nodes[slots[i]] = subtree->nodes[0];
+            relocateBVHNode(&merged->nodes[slots[i]], nodeBase, triangleBases[i]);
+
+            for (uint32_t n = 1; n < subtree->nodeCount; n++)
+            {
+                BVHNode* node = &merged->nodes[nodeBase + n - 1];
+                *node = subtree->nodes[n];
+                relocateBVHNode(node, nodeBase, triangleBases[i]);
+            }
+
+            nodeBase += subtree->nodeCount - 1;
+        }
+
+        merged->nodeCount = nodeBase;
+    }
+    else
+    {
+        fprintf(stderr, "Failed to merge BVH subtrees\n");
+    }
+
+    free(top.nodes);
+    free(slots);
+    free(bounds);
+    return ok;
+}
+
+void refitBVH(BVH* bvh, MeshData* mesh)
+{
+    // Children always come after their parent, one backward pass sees them first
+    for (uint32_t i = bvh->nodeCount; i-- > 0;)
+    {
+        BVHNode* node = &bvh->nodes[i];
+
+        if (node->triCount > 0)
+        {
+            updateNodeBounds(bvh, i, mesh, mesh->indices);
+            continue;
+        }
+
+        const BVHNode* left = &bvh->nodes[node->leftFirst];
+        const BVHNode* right = &bvh->nodes[node->leftFirst + 1];
+
+        for (int a = 0; a < 3; a++)
+        {
+            node->aabbMin[a] = left->aabbMin[a] < right->aabbMin[a] ? left->aabbMin[a] : right->aabbMin[a];
+            node->aabbMax[a] = left->aabbMax[a] > right->aabbMax[a] ? left->aabbMax[a] : right->aabbMax[a];
+        }
+    }
+}
+
+void padBVHBounds(BVH* bvh, float amount)
+{
+    for (uint32_t i = 0; i < bvh->nodeCount; i++)
+    {
+        BVHNode* node = &bvh->nodes[i];
+
+        for (int a = 0; a < 3; a++)
+        {
+            node->aabbMin[a] = nextafterf(nextafterf(node->aabbMin[a] - amount, -INFINITY), -INFINITY);
+            node->aabbMax[a] = nextafterf(nextafterf(node->aabbMax[a] + amount, INFINITY), INFINITY);
+        }
+    }
+}
+
+static float nodeArea(const BVHNode* node)
+{
+    float ex = node->aabbMax[0] - node->aabbMin[0];
+    float ey = node->aabbMax[1] - node->aabbMin[1];
+    float ez = node->aabbMax[2] - node->aabbMin[2];
+
+    return ex * ey + ey * ez + ez * ex;
+}
+
+float computeBVHCost(const BVH* bvh)
+{
+    if (bvh->nodeCount == 0) {return 0.0f;}
+
+    double cost = 0.0;
+    for (uint32_t i = 0; i < bvh->nodeCount; i++)
+    {
+        const BVHNode* node = &bvh->nodes[i];
+        cost += nodeArea(node) * (node->triCount > 0 ? (double)node->triCount : 1.0);
+    }
+
+    float rootArea = nodeArea(&bvh->nodes[0]);
+    return rootArea > 0.0f ? (float)(cost / rootArea) : 0.0f;
+}
+
 void getStatsRecursive(BVH* bvh, uint32_t nodeIdx, int currentDepth, BVHStats* stats)
 {
     BVHNode* node = &bvh->nodes[nodeIdx];
@@ -0,0 +1,644 @@
+#include "bvh8.h"
+
+#include <string.h>
+#include <math.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Every wide level leaves at most 7 siblings on the stack, buildBVH8 refuses
+// trees deeper than this holds so traversal never has to check
+#define BVH8_STACK_SIZE 512
+#define BVH8_MAX_DEPTH ((BVH8_STACK_SIZE - 1) / (BVH8_WIDTH - 1))
+
+typedef struct
+{
+    BVH8* wide;
+    const BVH* bvh;
+    const PrecomputedTriangle* triangles;
+    uint32_t* subtreeTris;      // Triangles under each binary node
+    uint32_t nodeCapacity;
+    uint32_t blockCapacity;
+    int maxDepth;
+} BVH8Builder;
+
+typedef struct
+{
+    uint32_t child;
+    uint32_t blockCount;
+    float dist;
+} BVH8StackEntry;
+
+static float nodeArea(const BVHNode* node)
+{
+    float x = node->aabbMax[0] - node->aabbMin[0];
+    float y = node->aabbMax[1] - node->aabbMin[1];
+    float z = node->aabbMax[2] - node->aabbMin[2];
+
+    return 2.0f * (x * y + y * z + z * x);
+}
+
+static uint32_t allocNode(BVH8Builder* builder)
+{
+    BVH8* wide = builder->wide;
+
+    if (wide->nodeCount == builder->nodeCapacity)
+    {
+        uint32_t capacity = builder->nodeCapacity ? builder->nodeCapacity * 2 : 64;
+        BVH8Node* nodes = realloc(wide->nodes, sizeof(BVH8Node) * capacity);
+        if (!nodes) {return BVH8_EMPTY;}
+
+        wide->nodes = nodes;
+        builder->nodeCapacity = capacity;
+    }
+
+    BVH8Node* node = &wide->nodes[wide->nodeCount];
+
+    for (int i = 0; i < BVH8_WIDTH; i++)
+    {
+        node->minX[i] = node->minY[i] = node->minZ[i] = 1e30f;
+        node->maxX[i] = node->maxY[i] = node->maxZ[i] = -1e30f;
+        node->child[i] = BVH8_EMPTY;
+        node->blockCount[i] = 0;
+    }
+
+    return wide->nodeCount++;
+}
+
+static uint32_t countSubtree(BVH8Builder* builder, uint32_t binaryIdx)
+{
+    const BVHNode* node = &builder->bvh->nodes[binaryIdx];
+    uint32_t count = node->triCount;
+
+    if (count == 0) {count = countSubtree(builder, node->leftFirst) + countSubtree(builder, node->leftFirst + 1);}
+
+    builder->subtreeTris[binaryIdx] = count;
+    return count;
+}
+
+// Subtrees that fit one block are never opened, their triangles go to a leaf
+static int isLeafSlot(const BVH8Builder* builder, uint32_t binaryIdx)
+{
+    return builder->bvh->nodes[binaryIdx].triCount > 0 || builder->subtreeTris[binaryIdx] <= BVH8_WIDTH;
+}
+
+static void gatherTriangles(const BVH8Builder* builder, uint32_t binaryIdx, uint32_t* indices, uint32_t* count)
+{
+    const BVHNode* node = &builder->bvh->nodes[binaryIdx];
+
+    if (node->triCount > 0)
+    {
+        for (uint32_t i = 0; i < node->triCount; i++) {indices[(*count)++] = node->leftFirst + i;}
+        return;
+    }
+
+    gatherTriangles(builder, node->leftFirst, indices, count);
+    gatherTriangles(builder, node->leftFirst + 1, indices, count);
+}
+
+// Packs triangles into 8 wide blocks, returns the first block. indices lists
+// the triangles, NULL takes count of them from first on.
+static uint32_t emitLeafBlocks(BVH8Builder* builder, const uint32_t* indices, uint32_t first, uint32_t count)
+{
+    BVH8* wide = builder->wide;
+    uint32_t blocks = (count + BVH8_WIDTH - 1) / BVH8_WIDTH;
+
+    while (wide->blockCount + blocks > builder->blockCapacity)
+    {
+        uint32_t capacity = builder->blockCapacity ? builder->blockCapacity * 2 : 256;
+        TriangleBlock8* grown = realloc(wide->blocks, sizeof(TriangleBlock8) * capacity);
+        if (!grown) {return BVH8_EMPTY;}
+
+        wide->blocks = grown;
+        builder->blockCapacity = capacity;
+    }
+
+    uint32_t firstBlock = wide->blockCount;
+
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        TriangleBlock8* block = &wide->blocks[firstBlock + b];
+        memset(block, 0, sizeof(TriangleBlock8));
+
+        for (int lane = 0; lane < BVH8_WIDTH; lane++)
+        {
+            uint32_t local = b * BVH8_WIDTH + lane;
+
+            // NaN vertices fail every compare, zero ones can hit after FMA rounding
+            if (local >= count)
+            {
+                for (int a = 0; a < 3; a++)
+                {
+                    block->v0[a][lane] = NAN;
+                    block->v1[a][lane] = NAN;
+                    block->v2[a][lane] = NAN;
+                }
+                block->triIndex[lane] = NO_HIT;
+                continue;
+            }
+
+            uint32_t triIndex = indices ? indices[local] : first + local;
+            const PrecomputedTriangle* tri = &builder->triangles[triIndex];
+            for (int a = 0; a < 3; a++)
+            {
+                block->v0[a][lane] = tri->v0[a];
+                block->v1[a][lane] = tri->v1[a];
+                block->v2[a][lane] = tri->v2[a];
+            }
+            block->triIndex[lane] = triIndex;
+        }
+    }
+
+    wide->blockCount += blocks;
+
+    return firstBlock;
+}
+
+static void setChild(BVH8Node* wideNode, int slot, const float* minB, const float* maxB, uint32_t child, uint32_t blockCount)
+{
+    wideNode->minX[slot] = minB[0];
+    wideNode->minY[slot] = minB[1];
+    wideNode->minZ[slot] = minB[2];
+    wideNode->maxX[slot] = maxB[0];
+    wideNode->maxY[slot] = maxB[1];
+    wideNode->maxZ[slot] = maxB[2];
+    wideNode->child[slot] = child;
+    wideNode->blockCount[slot] = blockCount;
+}
+
+// Opens the largest internal binary nodes until 8 children are gathered, then
+// packs the small leaves among them into shared blocks so lanes are not
+// padded out one binary leaf at a time
+static uint32_t collapseNode(BVH8Builder* builder, uint32_t binaryIdx, int depth)
+{
+    const BVHNode* binary = builder->bvh->nodes;
+
+    if (depth > builder->maxDepth) {builder->maxDepth = depth;}
+
+    uint32_t slots[BVH8_WIDTH];
+    int slotCount = 0;
+
+    if (isLeafSlot(builder, binaryIdx))
+    {
+        slots[slotCount++] = binaryIdx;
+    }
+    else
+    {
+        slots[slotCount++] = binary[binaryIdx].leftFirst;
+        slots[slotCount++] = binary[binaryIdx].leftFirst + 1;
+    }
+
+    while (slotCount < BVH8_WIDTH)
+    {
+        int best = -1;
+        float bestArea = -1.0f;
+
+        for (int i = 0; i < slotCount; i++)
+        {
+            const BVHNode* node = &binary[slots[i]];
+            if (!isLeafSlot(builder, slots[i]) && nodeArea(node) > bestArea)
+            {
+                bestArea = nodeArea(node);
+                best = i;
+            }
+        }
+
+        if (best < 0) {break;}
+
+        uint32_t opened = slots[best];
+        slots[best] = binary[opened].leftFirst;
+        slots[slotCount++] = binary[opened].leftFirst + 1;
+    }
+
+    // Small leaves first fit into bins of one block each, largest first
+    int binOf[BVH8_WIDTH];
+    uint32_t binTris[BVH8_WIDTH];
+    int binCount = 0;
+    int order[BVH8_WIDTH];
+
+    for (int i = 0; i < slotCount; i++) {order[i] = i;}
+    for (int i = 1; i < slotCount; i++)
+    {
+        int o = order[i];
+        int j = i - 1;
+        while (j >= 0 && builder->subtreeTris[slots[order[j]]] < builder->subtreeTris[slots[o]])
+        {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = o;
+    }
+
+    for (int k = 0; k < slotCount; k++)
+    {
+        int i = order[k];
+        uint32_t tris = builder->subtreeTris[slots[i]];
+        binOf[i] = -1;
+
+        if (!isLeafSlot(builder, slots[i]) || tris > BVH8_WIDTH) {continue;}
+
+        int bin = 0;
+        while (bin < binCount && binTris[bin] + tris > BVH8_WIDTH) {bin++;}
+        if (bin == binCount) {binTris[binCount++] = 0;}
+
+        binTris[bin] += tris;
+        binOf[i] = bin;
+    }
+
+    uint32_t wideIdx = allocNode(builder);
+    if (wideIdx == BVH8_EMPTY) {return BVH8_EMPTY;}
+
+    int childCount = 0;
+
+    for (int i = 0; i < slotCount; i++)
+    {
+        if (binOf[i] >= 0) {continue;}
+
+        const BVHNode* node = &binary[slots[i]];
+        uint32_t child;
+        uint32_t blockCount = 0;
+
+        if (isLeafSlot(builder, slots[i]))
+        {
+            child = emitLeafBlocks(builder, NULL, node->leftFirst, node->triCount);
+            if (child == BVH8_EMPTY) {return BVH8_EMPTY;}
+
+            child |= BVH8_LEAF_BIT;
+            blockCount = (node->triCount + BVH8_WIDTH - 1) / BVH8_WIDTH;
+        }
+        else
+        {
+            child = collapseNode(builder, slots[i], depth + 1);
+            if (child == BVH8_EMPTY) {return BVH8_EMPTY;}
+        }
+
+        // Node array may have moved during recursion
+        setChild(&builder->wide->nodes[wideIdx], childCount++, node->aabbMin, node->aabbMax, child, blockCount);
+    }
+
+    for (int bin = 0; bin < binCount; bin++)
+    {
+        uint32_t indices[BVH8_WIDTH];
+        uint32_t count = 0;
+        float minB[3] = {1e30f, 1e30f, 1e30f};
+        float maxB[3] = {-1e30f, -1e30f, -1e30f};
+
+        for (int i = 0; i < slotCount; i++)
+        {
+            if (binOf[i] != bin) {continue;}
+
+            const BVHNode* node = &binary[slots[i]];
+            gatherTriangles(builder, slots[i], indices, &count);
+
+            for (int a = 0; a < 3; a++)
+            {
+                minB[a] = fminf(minB[a], node->aabbMin[a]);
+                maxB[a] = fmaxf(maxB[a], node->aabbMax[a]);
+            }
+        }
+
+        uint32_t child = emitLeafBlocks(builder, indices, 0, count);
+        if (child == BVH8_EMPTY) {return BVH8_EMPTY;}
+
+        setChild(&builder->wide->nodes[wideIdx], childCount++, minB, maxB, child | BVH8_LEAF_BIT, 1);
+    }
+
+    return wideIdx;
+}
+
+#ifdef __AVX2__
+// Lane permutations that move the set lanes of a mask to the front
+static uint32_t g_compressLUT[256][BVH8_WIDTH];
+
+static void initCompressLUT(void)
+{
+    for (int mask = 0; mask < 256; mask++)
+    {
+        int n = 0;
+        for (int lane = 0; lane < BVH8_WIDTH; lane++)
+        {
+            if (mask & (1 << lane)) {g_compressLUT[mask][n++] = lane;}
+        }
+        while (n < BVH8_WIDTH) {g_compressLUT[mask][n++] = 0;}
+    }
+}
+#endif
+
+int buildBVH8(BVH8* wide, const BVH* bvh, const PrecomputedTriangle* triangles)
+{
+    memset(wide, 0, sizeof(BVH8));
+
+    if (!bvh->nodes || bvh->nodeCount == 0) {return 0;}
+
+#ifdef __AVX2__
+    initCompressLUT();
+#endif
+
+    BVH8Builder builder = {wide, bvh, triangles, malloc(sizeof(uint32_t) * bvh->nodeCount), 0, 0, 0};
+    if (!builder.subtreeTris)
+    {
+        fprintf(stderr, "Memory allocation for BVH8 failed\n");
+        return 0;
+    }
+
+    uint32_t triangleCount = countSubtree(&builder, 0);
+    uint32_t root = collapseNode(&builder, 0, 1);
+    free(builder.subtreeTris);
+
+    if (root == BVH8_EMPTY)
+    {
+        fprintf(stderr, "Memory allocation for BVH8 failed\n");
+        freeBVH8(wide);
+        return 0;
+    }
+
+    if (builder.maxDepth > BVH8_MAX_DEPTH)
+    {
+        fprintf(stderr, "BVH8 is %d levels deep, the traversal stack holds %d\n", builder.maxDepth, BVH8_MAX_DEPTH);
+        freeBVH8(wide);
+        return 0;
+    }
+
+    printf("BVH8: %u nodes, %u triangle blocks (%.2f KB), %.1f%% lanes used, depth %d\n", wide->nodeCount, wide->blockCount,
+        (sizeof(BVH8Node) * wide->nodeCount + sizeof(TriangleBlock8) * wide->blockCount) / 1024.0f,
+        wide->blockCount > 0 ? 100.0f * triangleCount / (wide->blockCount * BVH8_WIDTH) : 0.0f, builder.maxDepth);
+
+    return 1;
+}
+
+void freeBVH8(BVH8* wide)
+{
+    free(wide->nodes);
+    free(wide->blocks);
+    memset(wide, 0, sizeof(BVH8));
+}
+
+#ifdef __AVX2__
+static inline float horizontalMin(__m256 v)
+{
+    __m256 m = _mm256_min_ps(v, _mm256_permute2f128_ps(v, v, 1));
+    m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm256_cvtss_f32(m);
+}
+
+// Watertight test on 8 triangles at once, same math as hitTriangleWatertight
+static void intersectBlock(const TriangleBlock8* block, const float* ro, const WatertightRay* ray, RayHit* hit)
+{
+    int kx = ray->kx;
+    int ky = ray->ky;
+    int kz = ray->kz;
+
+    __m256 ox = _mm256_set1_ps(ro[kx]);
+    __m256 oy = _mm256_set1_ps(ro[ky]);
+    __m256 oz = _mm256_set1_ps(ro[kz]);
+    __m256 sx = _mm256_set1_ps(ray->sx);
+    __m256 sy = _mm256_set1_ps(ray->sy);
+    __m256 sz = _mm256_set1_ps(ray->sz);
+
+    __m256 az = _mm256_sub_ps(_mm256_loadu_ps(block->v0[kz]), oz);
+    __m256 bz = _mm256_sub_ps(_mm256_loadu_ps(block->v1[kz]), oz);
+    __m256 cz = _mm256_sub_ps(_mm256_loadu_ps(block->v2[kz]), oz);
+
+    __m256 ax = _mm256_fnmadd_ps(sx, az, _mm256_sub_ps(_mm256_loadu_ps(block->v0[kx]), ox));
+    __m256 ay = _mm256_fnmadd_ps(sy, az, _mm256_sub_ps(_mm256_loadu_ps(block->v0[ky]), oy));
+    __m256 bx = _mm256_fnmadd_ps(sx, bz, _mm256_sub_ps(_mm256_loadu_ps(block->v1[kx]), ox));
+    __m256 by = _mm256_fnmadd_ps(sy, bz, _mm256_sub_ps(_mm256_loadu_ps(block->v1[ky]), oy));
+    __m256 cx = _mm256_fnmadd_ps(sx, cz, _mm256_sub_ps(_mm256_loadu_ps(block->v2[kx]), ox));
+    __m256 cy = _mm256_fnmadd_ps(sy, cz, _mm256_sub_ps(_mm256_loadu_ps(block->v2[ky]), oy));
+
+    __m256 u = _mm256_fmsub_ps(cx, by, _mm256_mul_ps(cy, bx));
+    __m256 v = _mm256_fmsub_ps(ax, cy, _mm256_mul_ps(ay, cx));
+    __m256 w = _mm256_fmsub_ps(bx, ay, _mm256_mul_ps(by, ax));
+
+    __m256 zero = _mm256_setzero_ps();
+    __m256 anyNeg = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_LT_OQ), _mm256_cmp_ps(v, zero, _CMP_LT_OQ)), _mm256_cmp_ps(w, zero, _CMP_LT_OQ));
+    __m256 anyPos = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_GT_OQ), _mm256_cmp_ps(v, zero, _CMP_GT_OQ)), _mm256_cmp_ps(w, zero, _CMP_GT_OQ));
+
+    __m256 det = _mm256_add_ps(_mm256_add_ps(u, v), w);
+    __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+    __m256 sAz = _mm256_mul_ps(sz, az);
+    __m256 sBz = _mm256_mul_ps(sz, bz);
+    __m256 sCz = _mm256_mul_ps(sz, cz);
+    __m256 t = _mm256_mul_ps(_mm256_fmadd_ps(u, sAz, _mm256_fmadd_ps(v, sBz, _mm256_mul_ps(w, sCz))), invDet);
+
+    __m256 valid = _mm256_andnot_ps(_mm256_and_ps(anyNeg, anyPos), _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(0.001f), _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(hit->t), _CMP_LT_OQ));
+
+    int validMask = _mm256_movemask_ps(valid);
+    if (!validMask) {return;}
+
+    __m256 masked = _mm256_blendv_ps(_mm256_set1_ps(1e30f), t, valid);
+    float best = horizontalMin(masked);
+    int lane = __builtin_ctz(_mm256_movemask_ps(_mm256_cmp_ps(masked, _mm256_set1_ps(best), _CMP_EQ_OQ)) & validMask);
+
+    float laneDet[BVH8_WIDTH];
+    float laneV[BVH8_WIDTH];
+    float laneW[BVH8_WIDTH];
+    _mm256_storeu_ps(laneDet, invDet);
+    _mm256_storeu_ps(laneV, v);
+    _mm256_storeu_ps(laneW, w);
+
+    hit->t = best;
+    hit->u = laneV[lane] * laneDet[lane];
+    hit->v = laneW[lane] * laneDet[lane];
+    hit->triIndex = block->triIndex[lane];
+}
+
+void traceBVH8(const BVH8* wide, const float* ro, const float* rd, RayHit* hit)
+{
+    WatertightRay ray;
+    setupWatertightRay(rd, &ray);
+
+    float invDir[3] = {1.0f / rd[0], 1.0f / rd[1], 1.0f / rd[2]};
+
+    __m256 idx = _mm256_set1_ps(invDir[0]);
+    __m256 idy = _mm256_set1_ps(invDir[1]);
+    __m256 idz = _mm256_set1_ps(invDir[2]);
+    __m256 oix = _mm256_set1_ps(ro[0] * invDir[0]);
+    __m256 oiy = _mm256_set1_ps(ro[1] * invDir[1]);
+    __m256 oiz = _mm256_set1_ps(ro[2] * invDir[2]);
+
+    // Near and far planes picked once per ray from the direction signs
+    int nearIsMinX = rd[0] >= 0.0f;
+    int nearIsMinY = rd[1] >= 0.0f;
+    int nearIsMinZ = rd[2] >= 0.0f;
+
+    BVH8StackEntry stack[BVH8_STACK_SIZE];
+    int stackPtr = 0;
+
+    stack[stackPtr++] = (BVH8StackEntry){0, 0, 0.0f};
+
+    while (stackPtr > 0)
+    {
+        BVH8StackEntry entry = stack[--stackPtr];
+        if (entry.dist >= hit->t) {continue;}
+
+        if (entry.child & BVH8_LEAF_BIT)
+        {
+            const TriangleBlock8* blocks = &wide->blocks[entry.child & ~BVH8_LEAF_BIT];
+            for (uint32_t b = 0; b < entry.blockCount; b++) {intersectBlock(&blocks[b], ro, &ray, hit);}
+            continue;
+        }
+
+        const BVH8Node* node = &wide->nodes[entry.child];
+
+        __m256 nearX = _mm256_loadu_ps(nearIsMinX ? node->minX : node->maxX);
+        __m256 nearY = _mm256_loadu_ps(nearIsMinY ? node->minY : node->maxY);
+        __m256 nearZ = _mm256_loadu_ps(nearIsMinZ ? node->minZ : node->maxZ);
+        __m256 farX = _mm256_loadu_ps(nearIsMinX ? node->maxX : node->minX);
+        __m256 farY = _mm256_loadu_ps(nearIsMinY ? node->maxY : node->minY);
+        __m256 farZ = _mm256_loadu_ps(nearIsMinZ ? node->maxZ : node->minZ);
+
+        __m256 tNear = _mm256_max_ps(
+            _mm256_max_ps(_mm256_fmsub_ps(nearX, idx, oix), _mm256_fmsub_ps(nearY, idy, oiy)),
+            _mm256_max_ps(_mm256_fmsub_ps(nearZ, idz, oiz), _mm256_setzero_ps()));
+        __m256 tFar = _mm256_min_ps(
+            _mm256_min_ps(_mm256_fmsub_ps(farX, idx, oix), _mm256_fmsub_ps(farY, idy, oiy)),
+            _mm256_min_ps(_mm256_fmsub_ps(farZ, idz, oiz), _mm256_set1_ps(hit->t)));
+
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+        if (!mask) {continue;}
+
+        // Compress hit lanes to the front
+        __m256i permutation = _mm256_loadu_si256((const __m256i*)g_compressLUT[mask]);
+        int hitCount = __builtin_popcount(mask);
+
+        float dist[BVH8_WIDTH];
+        uint32_t child[BVH8_WIDTH];
+        uint32_t blockCount[BVH8_WIDTH];
+        _mm256_storeu_ps(dist, _mm256_permutevar8x32_ps(tNear, permutation));
+        _mm256_storeu_si256((__m256i*)child, _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)node->child), permutation));
+        _mm256_storeu_si256((__m256i*)blockCount, _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)node->blockCount), permutation));
+
+        // Sort far to near so the nearest child is popped first
+        for (int i = 1; i < hitCount; i++)
+        {
+            float d = dist[i];
+            uint32_t c = child[i];
+            uint32_t n = blockCount[i];
+            int j = i - 1;
+
+            while (j >= 0 && dist[j] < d)
+            {
+                dist[j + 1] = dist[j];
+                child[j + 1] = child[j];
+                blockCount[j + 1] = blockCount[j];
+                j--;
+            }
+            dist[j + 1] = d;
+            child[j + 1] = c;
+            blockCount[j + 1] = n;
+        }
+
+        for (int i = 0; i < hitCount; i++)
+        {
+            stack[stackPtr++] = (BVH8StackEntry){child[i], blockCount[i], dist[i]};
+        }
+    }
+}
+#else
+static void intersectBlock(const TriangleBlock8* block, const float* ro, const WatertightRay* ray, RayHit* hit)
+{
+    for (int lane = 0; lane < BVH8_WIDTH; lane++)
+    {
+        if (block->triIndex[lane] == NO_HIT) {continue;}
+
+        PrecomputedTriangle tri;
+        for (int a = 0; a < 3; a++)
+        {
+            tri.v0[a] = block->v0[a][lane];
+            tri.v1[a] = block->v1[a][lane];
+            tri.v2[a] = block->v2[a][lane];
+        }
+
+        float bary[2];
+        float t = hitTriangleWatertight(&tri, ro, ray, bary);
+
+        if (t > 0.0f && t < hit->t)
+        {
+            hit->t = t;
+            hit->u = bary[0];
+            hit->v = bary[1];
+            hit->triIndex = block->triIndex[lane];
+        }
+    }
+}
+
+void traceBVH8(const BVH8* wide, const float* ro, const float* rd, RayHit* hit)
+{
+    WatertightRay ray;
+    setupWatertightRay(rd, &ray);
+
+    float invDir[3] = {1.0f / rd[0], 1.0f / rd[1], 1.0f / rd[2]};
+
+    BVH8StackEntry stack[BVH8_STACK_SIZE];
+    int stackPtr = 0;
+
+    stack[stackPtr++] = (BVH8StackEntry){0, 0, 0.0f};
+
+    while (stackPtr > 0)
+    {
+        BVH8StackEntry entry = stack[--stackPtr];
+        if (entry.dist >= hit->t) {continue;}
+
+        if (entry.child & BVH8_LEAF_BIT)
+        {
+            const TriangleBlock8* blocks = &wide->blocks[entry.child & ~BVH8_LEAF_BIT];
+            for (uint32_t b = 0; b < entry.blockCount; b++) {intersectBlock(&blocks[b], ro, &ray, hit);}
+            continue;
+        }
+
+        const BVH8Node* node = &wide->nodes[entry.child];
+
+        float dist[BVH8_WIDTH];
+        uint32_t child[BVH8_WIDTH];
+        uint32_t blockCount[BVH8_WIDTH];
+        int hitCount = 0;
+
+        for (int i = 0; i < BVH8_WIDTH; i++)
+        {
+            if (node->child[i] == BVH8_EMPTY) {continue;}
+
+            float minB[3] = {node->minX[i], node->minY[i], node->minZ[i]};
+            float maxB[3] = {node->maxX[i], node->maxY[i], node->maxZ[i]};
+            float tNear = 0.0f;
+            float tFar = hit->t;
+
+            for (int a = 0; a < 3; a++)
+            {
+                float t0 = (minB[a] - ro[a]) * invDir[a];
+                float t1 = (maxB[a] - ro[a]) * invDir[a];
+
+                if (t0 > t1) {float temp = t0; t0 = t1; t1 = temp;}
+                if (t0 > tNear) {tNear = t0;}
+                if (t1 < tFar) {tFar = t1;}
+            }
+
+            if (tNear > tFar) {continue;}
+
+            // Insert keeping far to near order
+            int j = hitCount++ - 1;
+            while (j >= 0 && dist[j] < tNear)
+            {
+                dist[j + 1] = dist[j];
+                child[j + 1] = child[j];
+                blockCount[j + 1] = blockCount[j];
+                j--;
+            }
+            dist[j + 1] = tNear;
+            child[j + 1] = node->child[i];
+            blockCount[j + 1] = node->blockCount[i];
+        }
+
+        for (int i = 0; i < hitCount; i++)
+        {
+            stack[stackPtr++] = (BVH8StackEntry){child[i], blockCount[i], dist[i]};
+        }
+    }
+}
+#endif
@@ -0,0 +1,190 @@
+#include "config.h"
+#include "parse_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+static GltConfig g_config;
+static int g_configLoaded = 0;
+
+// The whole value must be one number, surrounding whitespace allowed
+static int parseWholeInt(const char* text, int64_t* out)
+{
+    const char* end = text + strlen(text);
+    const char* p = skipWhitespace(text, end);
+    const char* q = parseInt(p, end, out);
+    return q != p && skipWhitespace(q, end) == end;
+}
+
+static int parseWholeFloat(const char* text, float* out)
+{
+    const char* end = text + strlen(text);
+    const char* p = skipWhitespace(text, end);
+    const char* q = parseFloat(p, end, out);
+    return q != p && skipWhitespace(q, end) == end && isfinite(*out);
+}
+
+// Leaves value at its default and says so when the variable is malformed or out of range
+static void readIntVar(const char* name, int64_t min, int64_t max, int* value)
+{
+    const char* text = getenv(name);
+    if (!text) {return;}
+
+    int64_t parsed;
+    if (parseWholeInt(text, &parsed) && parsed >= min && parsed <= max) {*value = (int)parsed;}
+    else {fprintf(stderr, "Invalid %s '%s', expected a whole number from %lld to %lld, keeping the default\n", name, text,
+        (long long)min, (long long)max);}
+}
+
+static void readFloatVar(const char* name, float min, float max, float* value)
+{
+    const char* text = getenv(name);
+    if (!text) {return;}
+
+    float parsed;
+    if (parseWholeFloat(text, &parsed) && parsed >= min && parsed <= max) {*value = parsed;}
+    else if (isinf(max)) {fprintf(stderr, "Invalid %s '%s', expected a number of at least %g, keeping the default\n", name, text, min);}
+    else {fprintf(stderr, "Invalid %s '%s', expected a number from %g to %g, keeping the default\n", name, text, min, max);}
+}
+
+// "WxH", both positive
+static int parseSize(const char* text, int* width, int* height)
+{
+    const char* end = text + strlen(text);
+    int64_t w, h;
+
+    const char* p = skipWhitespace(text, end);
+    const char* q = parseInt(p, end, &w);
+    if (q == p || q == end || *q != 'x') {return 0;}
+
+    p = q + 1;
+    q = parseInt(p, end, &h);
+    if (q == p || skipWhitespace(q, end) != end) {return 0;}
+    if (w < 1 || w > INT32_MAX || h < 1 || h > INT32_MAX) {return 0;}
+
+    *width = (int)w;
+    *height = (int)h;
+    return 1;
+}
+
+// Exactly count comma separated finite floats
+static int parseFloatList(const char* text, float* out, int count)
+{
+    const char* end = text + strlen(text);
+    const char* p = text;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+        {
+            if (p == end || *p != ',') {return 0;}
+            p++;
+        }
+
+        p = skipWhitespace(p, end);
+        const char* q = parseFloat(p, end, &out[i]);
+        if (q == p || !isfinite(out[i])) {return 0;}
+        p = skipWhitespace(q, end);
+    }
+
+    return p == end;
+}
+
+static void loadConfig(GltConfig* config)
+{
+    memset(config, 0, sizeof(GltConfig));
+
+    config->threads.threadCount = 0;
+    config->threads.pinning = PIN_COMPACT;
+    config->weldTolerance = -1.0f;
+    config->parallelLoad = 1;
+    config->watch = WATCH_OFF;
+    config->chunkSize = 0.0f;
+    config->chunkBudget = (size_t)512 << 20;
+    config->chunkCache = NULL;
+    config->offscreenPath = NULL;
+    config->offscreenFrames = 64;
+    config->offscreenWidth = 1920;
+    config->offscreenHeight = 1080;
+    config->hasCamera = 0;
+    config->sky = 1;
+    config->denoise = 1;
+
+    readIntVar("GLT_THREADS", 0, INT32_MAX, &config->threads.threadCount);
+
+    const char* pinning = getenv("GLT_PINNING");
+    if (pinning)
+    {
+        if (strcmp(pinning, "none") == 0) {config->threads.pinning = PIN_NONE;}
+        else if (strcmp(pinning, "compact") == 0) {config->threads.pinning = PIN_COMPACT;}
+        else if (strcmp(pinning, "scatter") == 0) {config->threads.pinning = PIN_SCATTER;}
+        else {fprintf(stderr, "Unknown GLT_PINNING '%s', using compact\n", pinning);}
+    }
+
+    readFloatVar("GLT_WELD", 0.0f, INFINITY, &config->weldTolerance);
+    readIntVar("GLT_PARALLEL_LOAD", 0, 1, &config->parallelLoad);
+
+    const char* watch = getenv("GLT_WATCH");
+    if (watch)
+    {
+        int64_t on;
+        if (strcmp(watch, "poll") == 0) {config->watch = WATCH_POLL;}
+        else if (parseWholeInt(watch, &on) && (on == 0 || on == 1)) {config->watch = on ? WATCH_NOTIFY : WATCH_OFF;}
+        else {fprintf(stderr, "Invalid GLT_WATCH '%s', expected 0, 1 or poll, watching off\n", watch);}
+    }
+
+    readFloatVar("GLT_CHUNK_SIZE", 0.0f, INFINITY, &config->chunkSize);
+
+    // Megabytes, at most half of what size_t holds
+    float budgetMB = (float)(config->chunkBudget >> 20);
+    readFloatVar("GLT_CHUNK_BUDGET", 0.0f, (float)(SIZE_MAX >> 21), &budgetMB);
+    config->chunkBudget = (size_t)((double)budgetMB * 1024.0 * 1024.0);
+
+    const char* chunkCache = getenv("GLT_CHUNK_CACHE");
+    if (chunkCache && chunkCache[0]) {config->chunkCache = chunkCache;}
+
+    const char* offscreen = getenv("GLT_OFFSCREEN");
+    if (offscreen && offscreen[0]) {config->offscreenPath = offscreen;}
+
+    readIntVar("GLT_FRAMES", 1, INT32_MAX, &config->offscreenFrames);
+
+    const char* size = getenv("GLT_SIZE");
+    if (size && !parseSize(size, &config->offscreenWidth, &config->offscreenHeight))
+    {
+        fprintf(stderr, "Invalid GLT_SIZE '%s', expected WxH\n", size);
+    }
+
+    const char* camera = getenv("GLT_CAMERA");
+    if (camera)
+    {
+        float c[5];
+        config->hasCamera = parseFloatList(camera, c, 5);
+        if (config->hasCamera) {memcpy(config->camera, c, sizeof(c));}
+        else {fprintf(stderr, "Invalid GLT_CAMERA '%s', expected x,y,z,yaw,pitch\n", camera);}
+    }
+
+    const char* sky = getenv("GLT_SKY");
+    if (sky)
+    {
+        if (strcmp(sky, "day") == 0) {config->sky = 0;}
+        else if (strcmp(sky, "night") == 0) {config->sky = 1;}
+        else if (strcmp(sky, "sunset") == 0) {config->sky = 2;}
+        else {fprintf(stderr, "Unknown GLT_SKY '%s', using night\n", sky);}
+    }
+
+    readIntVar("GLT_DENOISE", 0, 1, &config->denoise);
+}
+
+const GltConfig* getConfig(void)
+{
+    if (!g_configLoaded)
+    {
+        loadConfig(&g_config);
+        g_configLoaded = 1;
+    }
+
+    return &g_config;
+}
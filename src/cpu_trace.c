@@ -0,0 +1,113 @@
+#include "cpu_trace.h"
+
+#include <math.h>
+
+static float hitAABB(const BVHNode* node, const float* ro, const float* invDir)
+{
+    float tNear = 0.0f;
+    float tFar = 1e30f;
+
+    for (int a = 0; a < 3; a++)
+    {
+        float t0 = (node->aabbMin[a] - ro[a]) * invDir[a];
+        float t1 = (node->aabbMax[a] - ro[a]) * invDir[a];
+
+        if (t0 > t1) {float temp = t0; t0 = t1; t1 = temp;}
+        if (t0 > tNear) {tNear = t0;}
+        if (t1 < tFar) {tFar = t1;}
+    }
+
+    return (tFar >= tNear) ? tNear : 1e30f;
+}
+
+// Leaf triangles come either precomputed or decoded from quantized vertices
+typedef struct
+{
+    const PrecomputedTriangle* triangles;
+    const QuantizedVertex* vertices;
+    const uint32_t* indices;
+    const QuantizationFrame* frame;
+} TriangleSource;
+
+static void fetchTriangle(const TriangleSource* source, uint32_t triIdx, PrecomputedTriangle* tri)
+{
+    const uint32_t* corners = &source->indices[triIdx * 3];
+
+    dequantizeVertex(source->frame, source->vertices[corners[0]], tri->v0);
+    dequantizeVertex(source->frame, source->vertices[corners[1]], tri->v1);
+    dequantizeVertex(source->frame, source->vertices[corners[2]], tri->v2);
+}
+
+static void traceSource(const BVH* bvh, const TriangleSource* source, const float* ro, const float* rd, RayHit* hit)
+{
+    float invDir[3] = {1.0f / rd[0], 1.0f / rd[1], 1.0f / rd[2]};
+
+    WatertightRay ray;
+    setupWatertightRay(rd, &ray);
+
+    uint32_t stack[64];
+    int stackPtr = 0;
+    stack[stackPtr++] = 0;
+
+    while (stackPtr > 0)
+    {
+        const BVHNode* node = &bvh->nodes[stack[--stackPtr]];
+
+        if (hitAABB(node, ro, invDir) >= hit->t) {continue;}
+
+        if (node->triCount > 0)
+        {
+            for (uint32_t i = 0; i < node->triCount; i++)
+            {
+                uint32_t triIdx = node->leftFirst + i;
+                float bary[2];
+                PrecomputedTriangle decoded;
+                const PrecomputedTriangle* tri = &decoded;
+
+                if (source->triangles) {tri = &source->triangles[triIdx];}
+                else {fetchTriangle(source, triIdx, &decoded);}
+
+                float t = hitTriangleWatertight(tri, ro, &ray, bary);
+
+                if (t > 0.0f && t < hit->t)
+                {
+                    hit->t = t;
+                    hit->u = bary[0];
+                    hit->v = bary[1];
+                    hit->triIndex = triIdx;
+                }
+            }
+            continue;
+        }
+
+        uint32_t left = node->leftFirst;
+        uint32_t right = node->leftFirst + 1;
+
+        float distL = hitAABB(&bvh->nodes[left], ro, invDir);
+        float distR = hitAABB(&bvh->nodes[right], ro, invDir);
+
+        // Nearest child popped first
+        if (distL < distR)
+        {
+            if (distR < hit->t) {stack[stackPtr++] = right;}
+            if (distL < hit->t) {stack[stackPtr++] = left;}
+        }
+        else
+        {
+            if (distL < hit->t) {stack[stackPtr++] = left;}
+            if (distR < hit->t) {stack[stackPtr++] = right;}
+        }
+    }
+}
+
+void traceBVH(const BVH* bvh, const PrecomputedTriangle* triangles, const float* ro, const float* rd, RayHit* hit)
+{
+    TriangleSource source = {triangles, NULL, NULL, NULL};
+    traceSource(bvh, &source, ro, rd, hit);
+}
+
+void traceBVHQuantized(const BVH* bvh, const QuantizedVertex* vertices, const uint32_t* indices, const QuantizationFrame* frame, const float* ro, const float* rd, RayHit* hit)
+{
+    TriangleSource source = {NULL, vertices, indices, frame};
+    traceSource(bvh, &source, ro, rd, hit);
+}
@@ -1,10 +1,22 @@
+// 64 bit off_t for fseeko and ftello on 32 bit POSIX
+#define _FILE_OFFSET_BITS 64
+
 #include "file_util.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-char* readFileToString(const char* filename)
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static char* readFileWithSize(const char* filename, size_t* size)
 {
     FILE* fp = fopen(filename, "rb");
     if (fp == NULL)
@@ -13,11 +25,15 @@ char* readFileToString(const char* filename)
         return NULL;
     }
 
-    fseek(fp, 0, SEEK_END);
-    long length = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+    int64_t length = seekFile(fp, 0, SEEK_END) == 0 ? tellFile(fp) : -1;
+    if (length < 0 || (uint64_t)length >= SIZE_MAX || seekFile(fp, 0, SEEK_SET) != 0)
+    {
+        fprintf(stderr, "Could not read size of file %s\n", filename);
+        fclose(fp);
+        return NULL;
+    }
 
-    char* buffer = (char*)malloc(length + 1);  // file content + null terminator
+    char* buffer = (char*)malloc((size_t)length + 1);  // file content + null terminator
 
     if (buffer == NULL)
     {
@@ -26,8 +42,8 @@ char* readFileToString(const char* filename)
         return NULL;
     }
 
-    size_t readBytes = fread(buffer, 1, length, fp);
-    if (readBytes != length)
+    size_t readBytes = fread(buffer, 1, (size_t)length, fp);
+    if (readBytes != (size_t)length)
     {
         fprintf(stderr, "Failed to read full file %s\n", filename);
         free(buffer);
@@ -38,5 +54,157 @@ char* readFileToString(const char* filename)
     buffer[length] = '\0';
     fclose(fp);
 
+    *size = (size_t)length;
     return buffer;
-}
\ No newline at end of file
+}
+
+char* readFileToString(const char* filename)
+{
+    size_t size;
+    return readFileWithSize(filename, &size);
+}
+
+#ifdef _WIN32
+static int mapFileView(const char* filename, MappedFile* file)
+{
+    HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {return 0;}
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(handle);
+        return 0;
+    }
+
+    // The view keeps its own reference, the file handle can go right away
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(handle);
+    if (!mapping) {return 0;}
+
+    const void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mapping);
+        return 0;
+    }
+
+    file->data = view;
+    file->size = (size_t)size.QuadPart;
+    file->mapping = mapping;
+
+    return 1;
+}
+#else
+static int mapFileView(const char* filename, MappedFile* file)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {return 0;}
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    void* view = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {return 0;}
+
+    // Parsers read front to back
+    madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+    file->data = view;
+    file->size = (size_t)info.st_size;
+
+    return 1;
+}
+#endif
+
+int mapFile(const char* filename, MappedFile* file)
+{
+    memset(file, 0, sizeof(MappedFile));
+
+    if (mapFileView(filename, file))
+    {
+        file->mapped = 1;
+        return 1;
+    }
+
+    // Pipes, empty files and anything else mmap refuses
+    size_t size;
+    char* buffer = readFileWithSize(filename, &size);
+    if (!buffer) {return 0;}
+
+    file->data = buffer;
+    file->size = size;
+
+    return 1;
+}
+
+void unmapFile(MappedFile* file)
+{
+    if (file->mapped)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(file->data);
+        CloseHandle(file->mapping);
+#else
+        munmap((void*)file->data, file->size);
+#endif
+    }
+    else
+    {
+        free((void*)file->data);
+    }
+
+    memset(file, 0, sizeof(MappedFile));
+}
+
+MappedFile* shareMappedFile(MappedFile* file)
+{
+    MappedFile* shared = malloc(sizeof(MappedFile));
+    if (!shared)
+    {
+        unmapFile(file);
+        return NULL;
+    }
+
+    *shared = *file;
+    shared->references = 1;
+    memset(file, 0, sizeof(MappedFile));
+
+    return shared;
+}
+
+void retainMappedFile(MappedFile* file)
+{
+    file->references++;
+}
+
+void releaseMappedFile(MappedFile* file)
+{
+    if (--file->references > 0) {return;}
+
+    unmapFile(file);
+    free(file);
+}
+
+int64_t tellFile(FILE* file)
+{
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return (int64_t)ftello(file);
+#endif
+}
+
+int seekFile(FILE* file, int64_t offset, int origin)
+{
+#ifdef _WIN32
+    return _fseeki64(file, offset, origin);
+#else
+    return fseeko(file, (off_t)offset, origin);
+#endif
+}
@@ -0,0 +1,11 @@
+#include "hash_util.h"
+
+uint32_t hashUint(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
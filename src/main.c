@@ -6,6 +6,11 @@
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#ifndef _WIN32
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -18,6 +23,13 @@
 #include "bvh.h"
 #include "matrix.h"
 #include "scene_loader.h"
+#include "triangle.h"
+#include "vertex_quant.h"
+#include "thread_pool.h"
+#include "config.h"
+#include "scene_watch.h"
+#include "scene_chunks.h"
+#include "timer.h"
 
 #ifndef M_PI
 #define M_PI 3.1415
@@ -183,13 +195,27 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     }
 }
 
-GLuint compileShader(const char* filename, GLenum type)
+// Build time switches forwarded to raytrace.comp
+const char* g_raytraceDefines =
+#if WATERTIGHT_TRIANGLES
+    "#define WATERTIGHT_TRIANGLES\n"
+#endif
+    "";
+
+GLuint compileShader(const char* filename, GLenum type, const char* defines)
 {
     char* source = readFileToString(filename);
     if (source == NULL) {return 0;}
 
+    // Defines have to go after the #version line
+    char* body = strchr(source, '\n');
+    body = body ? body + 1 : source + strlen(source);
+
+    const char* parts[3] = {source, defines ? defines : "", body};
+    GLint lengths[3] = {(GLint)(body - source), -1, -1};
+
     GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, (const char* const*)&source, NULL);
+    glShaderSource(shader, 3, parts, lengths);
     glCompileShader(shader);
 
     GLint success;
@@ -208,9 +234,9 @@ GLuint compileShader(const char* filename, GLenum type)
     return shader;
 }
 
-GLuint createComputeProgram(const char* filename)
+GLuint createComputeProgram(const char* filename, const char* defines)
 {
-    GLuint computeShader = compileShader(filename, GL_COMPUTE_SHADER);
+    GLuint computeShader = compileShader(filename, GL_COMPUTE_SHADER, defines);
     if (!computeShader) {return 0;}
 
     GLuint program = glCreateProgram();
@@ -235,8 +261,8 @@ GLuint createComputeProgram(const char* filename)
 
 GLuint createShaderProgram()
 {
-    GLuint vertexShader = compileShader("shaders/fullscreen.vert", GL_VERTEX_SHADER);
-    GLuint fragmentShader = compileShader("shaders/display.frag", GL_FRAGMENT_SHADER);
+    GLuint vertexShader = compileShader("shaders/fullscreen.vert", GL_VERTEX_SHADER, NULL);
+    GLuint fragmentShader = compileShader("shaders/display.frag", GL_FRAGMENT_SHADER, NULL);
 
     if (vertexShader == 0 || fragmentShader == 0) {return 0;}
 
@@ -262,6 +288,208 @@ GLuint createShaderProgram()
     return program;
 }
 
+// Bytes read from the scene buffers to shade one triangle hit: packed normal,
+// material id and one material. Counted from the shader source, not measured.
+#define SHADE_BYTES_PER_HIT (sizeof(uint32_t) + sizeof(uint32_t) + sizeof(Material))
+
+enum {TIMER_RAYTRACE, TIMER_DENOISE, TIMER_PASS_COUNT};
+
+// GPU pass timing, queries are read a frame late so they do not stall
+typedef struct 
+{
+    GLuint queries[2][TIMER_PASS_COUNT];
+    int frame;
+    double totalMs[TIMER_PASS_COUNT];
+    int samples;
+    float lastReport;
+} GpuTimer;
+
+void initGpuTimer(GpuTimer* timer)
+{
+    memset(timer, 0, sizeof(GpuTimer));
+    glGenQueries(2 * TIMER_PASS_COUNT, &timer->queries[0][0]);
+}
+
+void beginGpuTimer(GpuTimer* timer, int pass)
+{
+    glBeginQuery(GL_TIME_ELAPSED, timer->queries[timer->frame & 1][pass]);
+}
+
+void endGpuTimer()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+}
+
+void resolveGpuTimer(GpuTimer* timer, float now, int width, int height)
+{
+    if (timer->frame > 0)
+    {
+        for (int pass = 0; pass < TIMER_PASS_COUNT; pass++)
+        {
+            GLuint64 elapsedNs = 0;
+            glGetQueryObjectui64v(timer->queries[(timer->frame - 1) & 1][pass], GL_QUERY_RESULT, &elapsedNs);
+            timer->totalMs[pass] += elapsedNs * 1e-6;
+        }
+        timer->samples++;
+    }
+    timer->frame++;
+
+    if (now - timer->lastReport < 1.0f || timer->samples == 0) {return;}
+
+    double raytraceMs = timer->totalMs[TIMER_RAYTRACE] / timer->samples;
+    double denoiseMs = timer->totalMs[TIMER_DENOISE] / timer->samples;
+
+    // Estimated upper bound, every pixel hits a triangle on every bounce and no read hits a cache.
+    // The timer does not see traffic, so no rate is derived from it.
+    double shadeMB = (double)width * height * SHADE_BYTES_PER_HIT / (1024.0 * 1024.0);
+
+    printf("GPU raytrace %.2f ms, denoise %.2f ms | shading reads at most %d B per hit, est. upper bound %.1f MB per bounce\n",
+        raytraceMs, denoiseMs, (int)SHADE_BYTES_PER_HIT, shadeMB);
+
+    timer->totalMs[TIMER_RAYTRACE] = 0.0;
+    timer->totalMs[TIMER_DENOISE] = 0.0;
+    timer->samples = 0;
+    timer->lastReport = now;
+}
+
+#define STREAM_SLOTS 3
+
+// Staging slot for scene updates, larger single updates go through glBufferSubData
+#define STREAM_SLOT_BYTES (4 << 20)
+
+// Persistently mapped buffer split into STREAM_SLOTS slots. The CPU writes the
+// current slot while the GPU may still read the ones before it. Every slot has
+// a fence behind the last commands that read it, a slot is only written again
+// once that fence has passed.
+typedef struct
+{
+    GLuint buffer;
+    char* mapped;
+    GLsizeiptr stride;      // Slot size, a multiple of the alignment asked for
+    GLsizeiptr cursor;      // Bytes of the current slot already handed out
+    GLsync fences[STREAM_SLOTS];
+    int slot;
+} StreamRing;
+
+int initStreamRing(StreamRing* ring, GLenum target, GLsizeiptr slotSize, GLint alignment)
+{
+    memset(ring, 0, sizeof(StreamRing));
+    ring->stride = (slotSize + alignment - 1) / alignment * alignment;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &ring->buffer);
+    glBindBuffer(target, ring->buffer);
+    glBufferStorage(target, ring->stride * STREAM_SLOTS, NULL, flags);
+    ring->mapped = glMapBufferRange(target, 0, ring->stride * STREAM_SLOTS, flags);
+
+    if (!ring->mapped)
+    {
+        fprintf(stderr, "Failed to map a %.1f MB stream buffer\n", ring->stride * STREAM_SLOTS / (1024.0 * 1024.0));
+        glDeleteBuffers(1, &ring->buffer);
+        ring->buffer = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+// Fence after the last command reading the current slot, once per frame and
+// before the ring moves on
+void fenceStreamRing(StreamRing* ring)
+{
+    if (ring->fences[ring->slot]) {glDeleteSync(ring->fences[ring->slot]);}
+    ring->fences[ring->slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Moves to the next slot, waiting only if the GPU still reads it
+void nextStreamSlot(StreamRing* ring)
+{
+    ring->slot = (ring->slot + 1) % STREAM_SLOTS;
+    ring->cursor = 0;
+
+    GLsync fence = ring->fences[ring->slot];
+    if (!fence) {return;}
+
+    GLenum status;
+    do {status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);}
+    while (status == GL_TIMEOUT_EXPIRED);
+
+    glDeleteSync(fence);
+    ring->fences[ring->slot] = 0;
+}
+
+void freeStreamRing(StreamRing* ring)
+{
+    if (!ring->buffer) {return;}
+
+    for (int i = 0; i < STREAM_SLOTS; i++)
+    {
+        if (ring->fences[i]) {glDeleteSync(ring->fences[i]);}
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glDeleteBuffers(1, &ring->buffer);
+    memset(ring, 0, sizeof(StreamRing));
+}
+
+// Copies into dst on the GPU timeline through the staging ring, so neither side
+// waits for the other while dst is in use. Returns the bytes sent.
+GLsizeiptr streamBufferRange(StreamRing* staging, GLuint dst, GLintptr offset, const void* data, GLsizeiptr size)
+{
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+
+    if (size > staging->stride)
+    {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+        return size;
+    }
+
+    if (staging->cursor + size > staging->stride)
+    {
+        fenceStreamRing(staging);
+        nextStreamSlot(staging);
+    }
+
+    GLintptr source = staging->slot * staging->stride + staging->cursor;
+    memcpy(staging->mapped + source, data, size);
+    staging->cursor += (size + 15) & ~(GLsizeiptr)15;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, staging->buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, source, offset, size);
+    return size;
+}
+
+// Whole SSBO through the staging ring, storage is only reallocated when the size changes
+void streamBuffer(StreamRing* staging, GLuint buffer, GLuint binding, const void* data, GLsizeiptr size)
+{
+    GLint64 current = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glGetBufferParameteri64v(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &current);
+    if (current != size) {glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);}
+
+    streamBufferRange(staging, buffer, 0, data, size);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
+
+int initFrameUniforms(StreamRing* ring)
+{
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    return initStreamRing(ring, GL_UNIFORM_BUFFER, sizeof(FrameUniforms), alignment);
+}
+
+// Every frame takes the next slot and binds it for its dispatches
+void pushFrameUniforms(StreamRing* ring, const FrameUniforms* uniforms)
+{
+    nextStreamSlot(ring);
+
+    GLintptr offset = ring->slot * ring->stride;
+    memcpy(ring->mapped + offset, uniforms, sizeof(FrameUniforms));
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, ring->buffer, offset, sizeof(FrameUniforms));
+}
+
 GLuint g_accumTexture;
 GLuint g_outputTexture;
 
@@ -344,149 +572,540 @@ void setupTextures(int width, int height)
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-MeshData buildSceneMesh(SceneDescription* scene)
+typedef struct
+{
+    GLuint spheres;
+    GLuint materials;
+    GLuint vertices;
+    GLuint indices;
+    GLuint bvh;
+    GLuint triangleMaterials;
+    GLuint triangles;
+    GLuint triangleNormals;
+    GLuint sphereBvh;
+
+    // Materials, spheres and refits reach the buffers above through here
+    StreamRing staging;
+} SceneBuffers;
+
+// CPU copy of the uploaded geometry, kept in watch mode so instance edits can refit
+typedef struct
 {
-    MeshData combinedMesh = {0};
+    MeshData mesh;          // World space, indices and triangle materials in leaf order
+    uint32_t* leafOrder;    // buildSceneMesh triangle behind every leaf slot
+    BVH bvh;
+    float builtCost;        // SAH cost right after the last full build
+    int quantized;
+} SceneGeometry;
 
-    int totalVertices = 0;
-    int totalIndices = 0;
+// Refitted trees are rebuilt once their SAH cost grows past this factor
+#define REFIT_MAX_COST_GROWTH 1.5f
 
-    for (int i = 0; i < scene->numberOfInstances; i++)
+void freeSceneGeometry(SceneGeometry* geometry)
+{
+    freeMeshData(&geometry->mesh);
+    free(geometry->leafOrder);
+    free(geometry->bvh.nodes);
+    memset(geometry, 0, sizeof(SceneGeometry));
+}
+
+void uploadMaterials(SceneBuffers* buffers, const SceneDescription* sceneDesc)
+{
+    streamBuffer(&buffers->staging, buffers->materials, 1, sceneDesc->materials, sizeof(Material) * sceneDesc->materialCount);
+}
+
+// Spheres get a tree of their own, the shader walks it before the triangles
+void uploadSpheres(SceneBuffers* buffers, const SceneDescription* sceneDesc)
+{
+    int count = sceneDesc->sphereCount;
+    BVH sphereBvh = {0};
+    AABB* bounds = count > 0 ? malloc(sizeof(AABB) * count) : NULL;
+    uint32_t* order = count > 0 ? malloc(sizeof(uint32_t) * count) : NULL;
+    Sphere* ordered = count > 0 ? malloc(sizeof(Sphere) * count) : NULL;
+
+    for (int i = 0; bounds && i < count; i++)
     {
-        int srcIndex = scene->meshInstances[i].meshSourceIndex;
+        const Sphere* s = &sceneDesc->spheres[i];
+        float center[3] = {s->px, s->py, s->pz};
+        for (int a = 0; a < 3; a++)
+        {
+            bounds[i].min[a] = center[a] - s->radius;
+            bounds[i].max[a] = center[a] + s->radius;
+        }
+    }
 
-        if (srcIndex >= scene->numberOfSources) {continue;}
+    // Leaves index the uploaded copy, which is stored in leaf order
+    if (bounds && order && ordered && buildBoxBVH(&sphereBvh, bounds, (uint32_t)count, SPHERE_LEAF_SIZE, order))
+    {
+        for (int i = 0; i < count; i++) {ordered[i] = sceneDesc->spheres[order[i]];}
+    }
+    else if (count > 0)
+    {
+        fprintf(stderr, "Failed to build the sphere BVH, spheres are not drawn\n");
+    }
+    free(bounds);
+    free(order);
 
-        totalVertices += scene->meshSources[srcIndex].vertexCount;
-        totalIndices += scene->meshSources[srcIndex].indexCount;
+    if (sphereBvh.nodes)
+    {
+        streamBuffer(&buffers->staging, buffers->spheres, 0, ordered, sizeof(Sphere) * count);
+        streamBuffer(&buffers->staging, buffers->sphereBvh, 8, sphereBvh.nodes, sizeof(BVHNode) * sphereBvh.nodeCount);
+        free(sphereBvh.nodes);
+    }
+    else
+    {
+        // Allocate some memory to prevent GL errors if empty. The placeholder
+        // leaf points at the zero radius placeholder sphere, which no ray hits.
+        Sphere placeholderSphere = {0};
+        BVHNode placeholderNode = {{0}, 0, {0}, 1};
+        streamBuffer(&buffers->staging, buffers->spheres, 0, &placeholderSphere, sizeof(Sphere));
+        streamBuffer(&buffers->staging, buffers->sphereBvh, 8, &placeholderNode, sizeof(BVHNode));
     }
+    free(ordered);
+}
 
-    combinedMesh.vertices = (GPUPackedVertex*)malloc(sizeof(GPUPackedVertex) * totalVertices);
-    combinedMesh.indices = (uint32_t*)malloc(sizeof(uint32_t) * totalIndices);
-    combinedMesh.triangleMaterials = (uint32_t*)malloc(sizeof(uint32_t) * (totalIndices / 3));
+void uploadTriangleMaterials(SceneBuffers* buffers, const MeshData* sceneMesh)
+{
+    streamBuffer(&buffers->staging, buffers->triangleMaterials, 5, sceneMesh->triangleMaterials, sizeof(uint32_t) * sceneMesh->triangleCount);
+}
+
+void uploadIndices(GLuint indexSSBO, const MeshData* sceneMesh)
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t) * sceneMesh->indexCount, sceneMesh->indices, GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, indexSSBO);
+}
 
-    combinedMesh.vertexCount = totalVertices;
-    combinedMesh.indexCount = totalIndices;
+// Everything that moves with the vertices: positions, leaf ordered triangles,
+// normals and nodes. Returns 1 when the vertex buffer holds quantized positions,
+// bvh is then padded to the decoded triangles.
+int uploadGeometry(const SceneBuffers* buffers, MeshData* sceneMesh, BVH* bvh, QuantizationFrame* frame)
+{
+    // Falls back to float vertices when the scene needs more than 21 bits
+    QuantizedVertex* quantized = NULL;
+#if QUANTIZED_VERTICES
+    quantized = quantizeMesh(sceneMesh, frame);
+#endif
 
-    int vOffset = 0;
-    int iOffset = 0;
-    int tOffset = 0;
-    
-    for (int i = 0; i < scene->numberOfInstances; i++)
+    // Upload vertices
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers->vertices);
+    if (quantized)
     {
-        MeshInstance* instance = &scene->meshInstances[i];
-        int srcIndex = instance->meshSourceIndex;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(QuantizedVertex) * sceneMesh->vertexCount, quantized, GL_STATIC_DRAW);
+        free(quantized);
+    }
+    else
+    {
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPUPackedVertex) * sceneMesh->vertexCount, sceneMesh->vertices, GL_STATIC_DRAW);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buffers->vertices);
 
-        if (srcIndex >= scene->numberOfSources) {continue;}
+    // The boxes were built on the float positions, decoded edges can stick out by the error
+    if (quantized) {padBVHBounds(bvh, frame->maxError);}
 
-        MeshData* sourceMesh = &scene->meshSources[srcIndex];
+    // Upload BVH nodes
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers->bvh);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(BVHNode) * bvh->nodeCount, bvh->nodes, GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, buffers->bvh);
+
+    // Leaf ordered triangles, only read by the watertight kernel on float vertices,
+    // the quantized kernel gathers through the index buffer instead
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers->triangles);
+    PrecomputedTriangle* triangles = NULL;
+#if WATERTIGHT_TRIANGLES
+    if (!quantized) {triangles = buildPrecomputedTriangles(sceneMesh);}
+#endif
+    if (triangles)
+    {
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PrecomputedTriangle) * sceneMesh->triangleCount, triangles, GL_STATIC_DRAW);
+        free(triangles);
+    }
+    else
+    {
+        PrecomputedTriangle placeholderTriangle = {0};
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PrecomputedTriangle), &placeholderTriangle, GL_STATIC_DRAW);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, buffers->triangles);
 
-        Mat4 modelMatrix = transformMatrix(instance->pos, instance->scale, instance->rotation);
+    // Packed geometric normals, leaf ordered like the triangles
+    uint32_t* triangleNormals = buildTriangleNormals(sceneMesh);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers->triangleNormals);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t) * sceneMesh->triangleCount, triangleNormals, GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, buffers->triangleNormals);
+    free(triangleNormals);
 
-        for (int v = 0; v < sourceMesh->vertexCount; v++)
-        {
-            Vec4 localPos;
-            localPos.x = sourceMesh->vertices[v].x;
-            localPos.y = sourceMesh->vertices[v].y;
-            localPos.z = sourceMesh->vertices[v].z;
-            localPos.a = 1.0f;
+    return quantized != NULL;
+}
 
-            Vec4 worldPos = matrixMultiplyVec4(modelMatrix, localPos);
+// Returns 1 when the vertex buffer holds quantized positions described by frame,
+// -1 with nothing uploaded when the world mesh or its tree could not be built.
+// With keep the world mesh and tree stay in memory for refitBVH.
+int setupSceneData(SceneBuffers* buffers, SceneDescription* sceneDesc, QuantizationFrame* frame, SceneGeometry* keep)
+{
+    MeshData sceneMesh;
+    if (!buildSceneMesh(sceneDesc, &sceneMesh)) {return -1;}
 
-            combinedMesh.vertices[vOffset + v].x = worldPos.x;
-            combinedMesh.vertices[vOffset + v].y = worldPos.y;
-            combinedMesh.vertices[vOffset + v].z = worldPos.z;
+    // The BVH sort swaps triangle materials along with the triangles, an
+    // identity array in their place comes out as the leaf order
+    uint32_t* triangleMaterials = sceneMesh.triangleMaterials;
+    uint32_t* leafOrder = NULL;
+    if (keep)
+    {
+        leafOrder = malloc(sizeof(uint32_t) * sceneMesh.triangleCount);
+        if (leafOrder)
+        {
+            for (uint32_t i = 0; i < sceneMesh.triangleCount; i++) {leafOrder[i] = i;}
+            sceneMesh.triangleMaterials = leafOrder;
         }
-        for (int idx = 0; idx < sourceMesh->indexCount; idx++)
+    }
+
+    BVH bvh;
+    buildBVH(&bvh, &sceneMesh);
+    if (!bvh.nodes)
+    {
+        if (leafOrder) {sceneMesh.triangleMaterials = triangleMaterials;}
+        free(leafOrder);
+        freeMeshData(&sceneMesh);
+        return -1;
+    }
+
+    if (leafOrder)
+    {
+        uint32_t* ordered = malloc(sizeof(uint32_t) * sceneMesh.triangleCount);
+        if (ordered)
         {
-            combinedMesh.indices[iOffset + idx] = sourceMesh->indices[idx] + vOffset;
+            for (uint32_t i = 0; i < sceneMesh.triangleCount; i++) {ordered[i] = triangleMaterials[leafOrder[i]];}
+            free(triangleMaterials);
+            triangleMaterials = ordered;
         }
+        sceneMesh.triangleMaterials = triangleMaterials;
 
-        int triangleCount = sourceMesh->indexCount / 3;
-        for (int t = 0; t < triangleCount; t++)
+        // Without the ordered copy the materials would not match the leaves
+        if (!ordered)
         {
-            combinedMesh.triangleMaterials[tOffset + t] = instance->materialIndex;
+            fprintf(stderr, "Memory allocation for the leaf order failed, refits disabled\n");
+            free(leafOrder);
+            leafOrder = NULL;
         }
+    }
+
+    int quantized = uploadGeometry(buffers, &sceneMesh, &bvh, frame);
+    uploadIndices(buffers->indices, &sceneMesh);
+
+    // Material data for triangles
+    uploadTriangleMaterials(buffers, &sceneMesh);
 
-        vOffset += sourceMesh->vertexCount;
-        iOffset += sourceMesh->indexCount;
-        tOffset += triangleCount;
+    uploadMaterials(buffers, sceneDesc);
+    uploadSpheres(buffers, sceneDesc);
+
+    if (keep && leafOrder)
+    {
+        keep->mesh = sceneMesh;
+        keep->leafOrder = leafOrder;
+        keep->bvh = bvh;
+        keep->builtCost = computeBVHCost(&bvh);
+        keep->quantized = quantized;
+    }
+    else
+    {
+        free(bvh.nodes);
+        freeMeshData(&sceneMesh);
+    }
+
+    return quantized;
+}
+
+// Replaces the scene geometry with the stitched resident cells. Returns 1 when
+// the vertices are quantized, -1 when the old upload stays.
+int uploadResidentChunks(SceneBuffers* buffers, const SceneChunks* chunks, QuantizationFrame* frame)
+{
+    MeshData residentMesh;
+    BVH bvh;
+    if (!buildResidentMesh(chunks, &residentMesh, &bvh)) {return -1;}
+
+    int quantized = uploadGeometry(buffers, &residentMesh, &bvh, frame);
+    uploadIndices(buffers->indices, &residentMesh);
+    uploadTriangleMaterials(buffers, &residentMesh);
+
+    free(bvh.nodes);
+    freeMeshData(&residentMesh);
+    return quantized;
+}
+
+// Chunked counterpart of setupSceneData, the world mesh only lives until it is split
+int setupChunkedSceneData(SceneBuffers* buffers, SceneDescription* sceneDesc, SceneChunks* chunks, QuantizationFrame* frame)
+{
+    const GltConfig* config = getConfig();
+
+    MeshData world;
+    if (!buildSceneMesh(sceneDesc, &world)) {return -1;}
+
+    int split = buildSceneChunks(chunks, &world, config->chunkSize, config->chunkBudget, config->chunkCache);
+    freeMeshData(&world);
+    if (!split) {return -1;}
+
+    float eye[3] = {g_camera.x, g_camera.y, g_camera.z};
+    updateChunkResidency(chunks, eye);
+
+    int quantized = uploadResidentChunks(buffers, chunks, frame);
+    if (quantized < 0)
+    {
+        freeSceneChunks(chunks);
+        return -1;
+    }
+
+    uploadMaterials(buffers, sceneDesc);
+    uploadSpheres(buffers, sceneDesc);
+    return quantized;
+}
+
+// Runs of changed elements closer than this go out as one copy
+#define RANGE_MERGE_BYTES 4096
+
+// Streams every run of dirty elements into buffer, which keeps its size and
+// stays bound. Returns the bytes sent.
+size_t uploadDirtyRanges(StreamRing* staging, GLuint buffer, const void* data, size_t elementSize, const uint8_t* dirty, size_t count)
+{
+    size_t gap = RANGE_MERGE_BYTES / elementSize;
+    size_t sent = 0;
+
+    for (size_t i = 0; i < count;)
+    {
+        if (!dirty[i]) {i++; continue;}
+
+        size_t end = i + 1;
+        for (size_t j = end; j < count && j - end < gap; j++)
+        {
+            if (dirty[j]) {end = j + 1;}
         }
 
-    combinedMesh.triangleCount = totalIndices / 3;
+        sent += streamBufferRange(staging, buffer, (GLintptr)(i * elementSize), (const char*)data + i * elementSize, (GLsizeiptr)((end - i) * elementSize));
+        i = end;
+    }
 
-    return combinedMesh;
+    return sent;
 }
 
-void setupSceneData(GLuint sphereSSBO, GLuint materialSSBO, GLuint vertexSSBO, GLuint indexSSBO, GLuint bvhSSBO, GLuint triangleMaterialSSBO, SceneDescription* sceneDesc)
+// Refit counterpart of uploadGeometry: only vertices that moved, nodes whose
+// box changed and triangles touching a moved vertex are sent
+size_t uploadRefittedGeometry(SceneBuffers* buffers, const MeshData* mesh, const BVH* bvh, const uint8_t* movedVertices, const uint8_t* changedNodes)
 {
-    MeshData sceneMesh;
-    sceneMesh = buildSceneMesh(sceneDesc);
+    size_t sent = uploadDirtyRanges(&buffers->staging, buffers->vertices, mesh->vertices, sizeof(GPUPackedVertex), movedVertices, mesh->vertexCount);
+    sent += uploadDirtyRanges(&buffers->staging, buffers->bvh, bvh->nodes, sizeof(BVHNode), changedNodes, bvh->nodeCount);
 
-    BVH bvh;
-    buildBVH(&bvh, &sceneMesh);
-    // Upload vertices
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, vertexSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPUPackedVertex) * sceneMesh.vertexCount, sceneMesh.vertices, GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, vertexSSBO);
-    // Upload indices
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t) * sceneMesh.indexCount, sceneMesh.indices, GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, indexSSBO);
-    // Upload BVH nodes
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(BVHNode) * bvh.nodeCount, bvh.nodes, GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, bvhSSBO);
+    uint8_t* movedTriangles = malloc(mesh->triangleCount);
+    if (!movedTriangles) {return sent;}
 
-    // Material data for triangles
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, triangleMaterialSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t) * sceneMesh.triangleCount, sceneMesh.triangleMaterials, GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, triangleMaterialSSBO);
+    for (uint32_t t = 0; t < mesh->triangleCount; t++)
+    {
+        const uint32_t* tri = &mesh->indices[3 * (size_t)t];
+        movedTriangles[t] = movedVertices[tri[0]] | movedVertices[tri[1]] | movedVertices[tri[2]];
+    }
 
-    // Materials
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Material) * sceneDesc->materialCount, sceneDesc->materials, GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, materialSSBO);
+#if WATERTIGHT_TRIANGLES
+    PrecomputedTriangle* triangles = buildPrecomputedTriangles(mesh);
+    if (triangles)
+    {
+        sent += uploadDirtyRanges(&buffers->staging, buffers->triangles, triangles, sizeof(PrecomputedTriangle), movedTriangles, mesh->triangleCount);
+        free(triangles);
+    }
+#endif
 
-    free(bvh.nodes);
-    freeMeshData(&sceneMesh);
+    uint32_t* triangleNormals = buildTriangleNormals(mesh);
+    if (triangleNormals)
+    {
+        sent += uploadDirtyRanges(&buffers->staging, buffers->triangleNormals, triangleNormals, sizeof(uint32_t), movedTriangles, mesh->triangleCount);
+        free(triangleNormals);
+    }
 
-    // Sphere data
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sphereSSBO);
+    free(movedTriangles);
+    return sent;
+}
+
+// Instances only moved or swapped materials, so vertex numbering, triangle
+// order and tree shape still hold. Returns 0 when a full rebuild is needed.
+int refitSceneData(SceneBuffers* buffers, SceneGeometry* geometry, SceneDescription* sceneDesc, int diff, QuantizationFrame* frame)
+{
+    // The quantization frame follows the bounds, the shader would need new uniforms
+    if (!geometry->leafOrder || geometry->quantized) {return 0;}
+
+    MeshData world;
+    if (!buildSceneMesh(sceneDesc, &world)) {return 0;}
 
-    if (sceneDesc->sphereCount > 0)
+    int refitted = world.vertexCount == geometry->mesh.vertexCount && world.triangleCount == geometry->mesh.triangleCount;
+
+    if (refitted && (diff & SCENE_DIFF_TRANSFORMS))
     {
-        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Sphere) * sceneDesc->sphereCount, sceneDesc->spheres, GL_STATIC_DRAW);
+        // What changed is marked on the way, only that is uploaded after the refit
+        uint8_t* movedVertices = malloc(world.vertexCount);
+        uint8_t* changedNodes = malloc(geometry->bvh.nodeCount);
+        BVHNode* previousNodes = malloc(sizeof(BVHNode) * geometry->bvh.nodeCount);
+        int ranges = movedVertices && changedNodes && previousNodes;
+
+        for (uint32_t v = 0; ranges && v < world.vertexCount; v++)
+        {
+            movedVertices[v] = memcmp(&geometry->mesh.vertices[v], &world.vertices[v], sizeof(GPUPackedVertex)) != 0;
+        }
+        if (ranges) {memcpy(previousNodes, geometry->bvh.nodes, sizeof(BVHNode) * geometry->bvh.nodeCount);}
+
+        memcpy(geometry->mesh.vertices, world.vertices, sizeof(GPUPackedVertex) * world.vertexCount);
+        refitBVH(&geometry->bvh, &geometry->mesh);
+
+        float cost = computeBVHCost(&geometry->bvh);
+        refitted = cost <= geometry->builtCost * REFIT_MAX_COST_GROWTH;
+
+        if (refitted && ranges)
+        {
+            for (uint32_t n = 0; n < geometry->bvh.nodeCount; n++)
+            {
+                changedNodes[n] = memcmp(&previousNodes[n], &geometry->bvh.nodes[n], sizeof(BVHNode)) != 0;
+            }
+
+            size_t total = (sizeof(GPUPackedVertex) * world.vertexCount + sizeof(BVHNode) * geometry->bvh.nodeCount) +
+                (sizeof(PrecomputedTriangle) * WATERTIGHT_TRIANGLES + sizeof(uint32_t)) * world.triangleCount;
+            size_t sent = uploadRefittedGeometry(buffers, &geometry->mesh, &geometry->bvh, movedVertices, changedNodes);
+            printf("BVH refit: SAH cost %.1f, %.1f after the last build, %.1f of %.1f KB uploaded\n", cost, geometry->builtCost,
+                sent / 1024.0, total / 1024.0);
+        }
+        else
+        {
+            printf("BVH refit: SAH cost %.1f, %.1f after the last build\n", cost, geometry->builtCost);
+            if (refitted) {uploadGeometry(buffers, &geometry->mesh, &geometry->bvh, frame);}
+        }
+
+        free(movedVertices);
+        free(changedNodes);
+        free(previousNodes);
     }
-    else
+
+    if (refitted && (diff & SCENE_DIFF_INSTANCE_MATERIALS))
     {
-        // Allocate some memory to prevent GL errors if empty
-        Sphere placeholderSphere = {0};
-        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Sphere), &placeholderSphere, GL_STATIC_DRAW);
+        for (uint32_t i = 0; i < world.triangleCount; i++)
+        {
+            geometry->mesh.triangleMaterials[i] = world.triangleMaterials[geometry->leafOrder[i]];
+        }
+        uploadTriangleMaterials(buffers, &geometry->mesh);
     }
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sphereSSBO);
+    freeMeshData(&world);
+    return refitted;
 }
 
-int main(int argc, char* argv[])
+// The quantized decode path is only compiled in when the scene passed the error check
+GLuint createRaytraceProgram(int quantized, const QuantizationFrame* frame)
 {
-    char scenePath[512];
+    char raytraceDefines[256];
+    snprintf(raytraceDefines, sizeof(raytraceDefines), "%s%s", g_raytraceDefines, quantized ? "#define QUANTIZED_VERTICES\n" : "");
 
-    if (argc > 1)
+    GLuint program = createComputeProgram("shaders/raytrace.comp", raytraceDefines);
+
+    if (!program) {return 0;}
+
+    // Per frame values come from the FrameData block, what is left is set here once
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "u_historyTexture"), 0);
+
+    // Decode frame only changes with a full rebuild, which creates the program again
+    if (quantized)
     {
-        snprintf(scenePath, sizeof(scenePath), "scenes/%s", argv[1]);
+        glUniform3fv(glGetUniformLocation(program, "u_quantOrigin"), 1, frame->origin);
+        glUniform3fv(glGetUniformLocation(program, "u_quantStep"), 1, frame->step);
+    }
+
+    return program;
+}
+
+void watchScene(SceneWatch* watch, const char* scenePath, const SceneDescription* scene)
+{
+    const char** paths = malloc(sizeof(char*) * (scene->numberOfSources + 1));
+    if (!paths) {return;}
+
+    // LOD sources have no file behind them, they never see an event
+    paths[0] = scenePath;
+    for (int i = 0; i < scene->numberOfSources; i++) {paths[i + 1] = scene->sourcePaths[i];}
+
+    initSceneWatch(watch, getConfig()->watch, paths, scene->numberOfSources + 1);
+    free(paths);
+}
+
+// Loads the scene again after a watched file changed and updates only what
+// differs. Returns the SCENE_DIFF flags, 0 leaves the accumulated image alone.
+int hotReloadScene(const char* scenePath, SceneDescription* scene, SceneWatch* watch, SceneBuffers* buffers,
+    SceneGeometry* geometry, QuantizationFrame* frame, GLuint* computeProgram)
+{
+    double start = getTimeSeconds();
+
+    // Changed meshes are parsed again, all others move over from the loaded scene
+    const char** stalePaths = malloc(sizeof(char*) * watch->count);
+    int staleCount = 0;
+    for (int i = 1; stalePaths && i < watch->count; i++)
+    {
+        if (watch->changed[i]) {stalePaths[staleCount++] = watch->paths[i];}
+    }
+
+    SceneDescription next;
+    int loadedSources = 0;
+    int loaded = stalePaths && reloadScene(scenePath, scene, stalePaths, staleCount, &next, &loadedSources);
+    free(stalePaths);
+
+    if (!loaded)
+    {
+        fprintf(stderr, "Reload of %s failed, keeping the loaded scene\n", scenePath);
+        return 0;
+    }
+
+    int diff = diffScenes(scene, &next);
+    if (loadedSources > 0) {diff |= SCENE_DIFF_GEOMETRY;}
+
+    freeScene(scene);
+    *scene = next;
+
+    const char* applied = "nothing changed";
+    int rebuild = (diff & SCENE_DIFF_GEOMETRY) != 0;
+
+    if (!rebuild && (diff & (SCENE_DIFF_TRANSFORMS | SCENE_DIFF_INSTANCE_MATERIALS)))
+    {
+        rebuild = !refitSceneData(buffers, geometry, scene, diff, frame);
+        applied = (diff & SCENE_DIFF_TRANSFORMS) ? "instances refitted" : "instance materials updated";
+    }
+
+    if (rebuild)
+    {
+        int wasQuantized = geometry->quantized;
+        freeSceneGeometry(geometry);
+        int quantized = setupSceneData(buffers, scene, frame, geometry);
+        applied = "full rebuild";
+
+        // The previous upload stays on the GPU, the next edit tries again
+        if (quantized < 0) {applied = "full rebuild failed, previous geometry kept";}
+        else if (quantized || wasQuantized)
+        {
+            glDeleteProgram(*computeProgram);
+            *computeProgram = createRaytraceProgram(quantized, frame);
+        }
     }
     else
     {
-        strncpy(scenePath, "scenes/1.scene", sizeof(scenePath));
+        if (diff & SCENE_DIFF_MATERIALS) {uploadMaterials(buffers, scene);}
+        if (diff & SCENE_DIFF_SPHERES) {uploadSpheres(buffers, scene);}
+        if (!(diff & (SCENE_DIFF_TRANSFORMS | SCENE_DIFF_INSTANCE_MATERIALS)) && diff) {applied = "materials or spheres updated";}
     }
 
-    printf("\nGLTrace, loading: %s\n", scenePath);
+    printf("Reloaded %s in %.2f s: %s, %d mesh(es) parsed\n", scenePath, getTimeSeconds() - start, applied, loadedSources);
+
+    // Sources may have been added or dropped
+    freeSceneWatch(watch);
+    watchScene(watch, scenePath, scene);
 
+    return diff;
+}
+
+static int createWindow(GLFWwindow** window)
+{
     if (!glfwInit())
     {
         fprintf(stderr, "GLFW init failed\n");
-        return 1;
+        return 0;
     }
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -494,73 +1113,416 @@ int main(int argc, char* argv[])
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "GLTrace", NULL, NULL);
-    if (!window)
+    *window = glfwCreateWindow(WIDTH, HEIGHT, "GLTrace", NULL, NULL);
+    if (!*window)
     {
         fprintf(stderr, "GLFW window creation failed\n");
-        glfwTerminate();
-        return 1;
+        return 0;
     }
 
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+    glfwMakeContextCurrent(*window);
+    glfwSetFramebufferSizeCallback(*window, framebufferSizeCallback);
 
     // Capture and hide mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwSetCursorPosCallback(window, mouseCallback);
+    glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetCursorPosCallback(*window, mouseCallback);
 
-    glfwSetKeyCallback(window, keyCallback);
+    glfwSetKeyCallback(*window, keyCallback);
 
     // Load GL functions
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
         fprintf(stderr, "Failed to load GLAD\n");
-        glfwTerminate();
-        return 1;
+        return 0;
     }
 
     // Vsync
     glfwSwapInterval(0);
+    return 1;
+}
+
+// Headless rendering for CI and render nodes. EGL gives a context with no
+// window, surfaceless where the driver allows it and a 1x1 pbuffer otherwise,
+// Windows falls back to a hidden GLFW window. Frames are drawn into an RGBA8
+// framebuffer, so the image is what the window would have shown.
+typedef struct
+{
+#ifdef _WIN32
+    GLFWwindow* window;
+#else
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface;
+#endif
+    GLuint framebuffer;
+    GLuint colorTexture;
+} OffscreenContext;
+
+#ifndef _WIN32
+static int initEglDisplay(EGLDisplay display, EGLConfig* config)
+{
+    EGLint major, minor, configCount = 0;
+    const EGLint attributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+
+    if (!eglInitialize(display, &major, &minor)) {return 0;}
+    return eglBindAPI(EGL_OPENGL_API) && eglChooseConfig(display, attributes, config, 1, &configCount) && configCount > 0;
+}
+
+static EGLContext createEglContext(EGLDisplay display, EGLConfig config)
+{
+    const EGLint attributes[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 6,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    return eglCreateContext(display, config, EGL_NO_CONTEXT, attributes);
+}
+#endif
+
+static int createOffscreenContext(OffscreenContext* offscreen)
+{
+#ifdef _WIN32
+    if (!glfwInit())
+    {
+        fprintf(stderr, "GLFW init failed\n");
+        return 0;
+    }
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    offscreen->window = glfwCreateWindow(1, 1, "GLTrace", NULL, NULL);
+    if (!offscreen->window)
+    {
+        fprintf(stderr, "GLFW hidden window creation failed\n");
+        return 0;
+    }
+
+    glfwMakeContextCurrent(offscreen->window);
+    GLADloadproc loader = (GLADloadproc)glfwGetProcAddress;
+#else
+    // Surfaceless needs no GPU node or display server, llvmpipe included
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    offscreen->display = EGL_NO_DISPLAY;
+    if (getPlatformDisplay && clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+    {
+        offscreen->display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (offscreen->display == EGL_NO_DISPLAY) {offscreen->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);}
+
+    EGLConfig config;
+    if (offscreen->display == EGL_NO_DISPLAY || !initEglDisplay(offscreen->display, &config))
+    {
+        fprintf(stderr, "EGL init failed (0x%x)\n", eglGetError());
+        return 0;
+    }
+
+    offscreen->context = createEglContext(offscreen->display, config);
+
+    // llvmpipe stops at 4.5 and reads the override only when the display is initialized
+    if (offscreen->context == EGL_NO_CONTEXT && !getenv("MESA_GL_VERSION_OVERRIDE"))
+    {
+        fprintf(stderr, "No GL 4.6 core context, retrying with MESA_GL_VERSION_OVERRIDE=4.6\n");
+        setenv("MESA_GL_VERSION_OVERRIDE", "4.6", 0);
+        setenv("MESA_GLSL_VERSION_OVERRIDE", "460", 0);
+
+        eglTerminate(offscreen->display);
+        if (initEglDisplay(offscreen->display, &config)) {offscreen->context = createEglContext(offscreen->display, config);}
+    }
+
+    if (offscreen->context == EGL_NO_CONTEXT)
+    {
+        fprintf(stderr, "EGL GL 4.6 core context creation failed (0x%x)\n", eglGetError());
+        return 0;
+    }
+
+    // Everything is drawn into framebuffer, a surface is only made for drivers that need one
+    const char* extensions = eglQueryString(offscreen->display, EGL_EXTENSIONS);
+    offscreen->surface = EGL_NO_SURFACE;
+    if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+    {
+        const EGLint attributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        offscreen->surface = eglCreatePbufferSurface(offscreen->display, config, attributes);
+    }
+
+    if (!eglMakeCurrent(offscreen->display, offscreen->surface, offscreen->surface, offscreen->context))
+    {
+        fprintf(stderr, "EGL make current failed (0x%x)\n", eglGetError());
+        return 0;
+    }
+
+    GLADloadproc loader = (GLADloadproc)eglGetProcAddress;
+#endif
+
+    if (!gladLoadGLLoader(loader))
+    {
+        fprintf(stderr, "Failed to load GLAD\n");
+        return 0;
+    }
+
+    printf("Offscreen context: %s, %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+    return 1;
+}
+
+static int createOffscreenTarget(OffscreenContext* offscreen, int width, int height)
+{
+    glGenTextures(1, &offscreen->colorTexture);
+    glBindTexture(GL_TEXTURE_2D, offscreen->colorTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+
+    glGenFramebuffers(1, &offscreen->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreen->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, offscreen->colorTexture, 0);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "Offscreen framebuffer incomplete (0x%x)\n", status);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Binary PPM, rows flipped from GL's bottom up order
+static int writeOffscreenImage(const OffscreenContext* offscreen, int width, int height, const char* path)
+{
+    size_t rowBytes = (size_t)width * 3;
+    unsigned char* pixels = malloc(rowBytes * height);
+    if (!pixels)
+    {
+        fprintf(stderr, "Out of memory reading back the offscreen image\n");
+        return 0;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen->framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        free(pixels);
+        return 0;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    int written = 1;
+    for (int y = height - 1; y >= 0 && written; y--)
+    {
+        written = fwrite(pixels + rowBytes * y, 1, rowBytes, file) == rowBytes;
+    }
+
+    written = fclose(file) == 0 && written;
+    free(pixels);
+
+    if (!written) {fprintf(stderr, "Failed to write %s\n", path);}
+    return written;
+}
+
+static void destroyOffscreenContext(OffscreenContext* offscreen)
+{
+    if (offscreen->framebuffer) {glDeleteFramebuffers(1, &offscreen->framebuffer);}
+    if (offscreen->colorTexture) {glDeleteTextures(1, &offscreen->colorTexture);}
+
+#ifdef _WIN32
+    if (offscreen->window) {glfwDestroyWindow(offscreen->window);}
+#else
+    if (offscreen->display == EGL_NO_DISPLAY) {return;}
+
+    eglMakeCurrent(offscreen->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (offscreen->surface != EGL_NO_SURFACE) {eglDestroySurface(offscreen->display, offscreen->surface);}
+    if (offscreen->context != EGL_NO_CONTEXT) {eglDestroyContext(offscreen->display, offscreen->context);}
+    eglTerminate(offscreen->display);
+#endif
+}
+
+// Everything main creates before the scene, shared by the normal exit and
+// the failures after the GL context exists
+static void shutdownRenderer(SceneBuffers* buffers, StreamRing* frameUniforms, GLuint vao, OffscreenContext* offscreen)
+{
+    glDeleteBuffers(1, &buffers->bvh);
+    glDeleteBuffers(1, &buffers->indices);
+    glDeleteBuffers(1, &buffers->vertices);
+    glDeleteBuffers(1, &buffers->materials);
+    glDeleteBuffers(1, &buffers->triangleMaterials);
+    glDeleteBuffers(1, &buffers->triangles);
+    glDeleteBuffers(1, &buffers->triangleNormals);
+    glDeleteBuffers(1, &buffers->spheres);
+    glDeleteBuffers(1, &buffers->sphereBvh);
+    freeStreamRing(&buffers->staging);
+    freeStreamRing(frameUniforms);
+
+    glDeleteTextures(1, &g_accumTexture);
+    glDeleteTextures(1, &g_outputTexture);
+    glDeleteTextures(1, &g_denoisedTexture);
+    glDeleteTextures(1, &g_denoiseSwapTexture);
+    glDeleteVertexArrays(1, &vao);
+
+    glFinish();
+    destroyOffscreenContext(offscreen);
+    glfwTerminate();
+    threadPoolShutdown();
+}
+
+int main(int argc, char* argv[])
+{
+    char scenePath[512];
+
+    if (argc > 1)
+    {
+        snprintf(scenePath, sizeof(scenePath), "scenes/%s", argv[1]);
+    }
+    else
+    {
+        strncpy(scenePath, "scenes/1.scene", sizeof(scenePath));
+    }
+
+    printf("\nGLTrace, loading: %s\n", scenePath);
+
+    threadPoolInit(&getConfig()->threads);
+
+    const GltConfig* config = getConfig();
+    g_isDay = config->sky;
+    g_enableDenoise = config->denoise;
+
+    if (config->hasCamera)
+    {
+        g_camera.x = config->camera[0];
+        g_camera.y = config->camera[1];
+        g_camera.z = config->camera[2];
+        g_camera.yaw = config->camera[3];
+        g_camera.pitch = config->camera[4];
+    }
+
+    // Offscreen runs a fixed number of frames with the camera held still, then writes the image
+    GLFWwindow* window = NULL;
+    OffscreenContext offscreen;
+    memset(&offscreen, 0, sizeof(OffscreenContext));
+
+    if (config->offscreenPath)
+    {
+        g_newWidth = config->offscreenWidth;
+        g_newHeight = config->offscreenHeight;
+
+        if (!createOffscreenContext(&offscreen) || !createOffscreenTarget(&offscreen, g_newWidth, g_newHeight))
+        {
+            destroyOffscreenContext(&offscreen);
+            glfwTerminate();
+            threadPoolShutdown();
+            return 1;
+        }
+    }
+    else if (!createWindow(&window))
+    {
+        glfwTerminate();
+        threadPoolShutdown();
+        return 1;
+    }
 
     // Buffer setup
     GLuint vao;
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
 
-    GLuint ssboSpheres;
-    GLuint ssboMaterials;
-    GLuint ssboVertices;
-    GLuint ssboIndices;
-    GLuint ssboBVH;
-    GLuint ssboTriangleMaterial;
-
-    glGenBuffers(1, &ssboSpheres);
-    glGenBuffers(1, &ssboMaterials);
-    glGenBuffers(1, &ssboVertices);
-    glGenBuffers(1, &ssboIndices);
-    glGenBuffers(1, &ssboBVH);
-    glGenBuffers(1, &ssboTriangleMaterial);
+    SceneBuffers buffers;
+
+    glGenBuffers(1, &buffers.spheres);
+    glGenBuffers(1, &buffers.materials);
+    glGenBuffers(1, &buffers.vertices);
+    glGenBuffers(1, &buffers.indices);
+    glGenBuffers(1, &buffers.bvh);
+    glGenBuffers(1, &buffers.triangleMaterials);
+    glGenBuffers(1, &buffers.triangles);
+    glGenBuffers(1, &buffers.triangleNormals);
+    glGenBuffers(1, &buffers.sphereBvh);
+
+    StreamRing frameUniforms;
+    memset(&frameUniforms, 0, sizeof(StreamRing));
+    if (!initStreamRing(&buffers.staging, GL_COPY_READ_BUFFER, STREAM_SLOT_BYTES, 16) || !initFrameUniforms(&frameUniforms))
+    {
+        shutdownRenderer(&buffers, &frameUniforms, vao, &offscreen);
+        return 1;
+    }
 
     SceneDescription scene;
 
     if (!loadScene(scenePath, &scene))
     {
         fprintf(stderr, "Failed to load scene %s\n", scenePath);
+        shutdownRenderer(&buffers, &frameUniforms, vao, &offscreen);
         return 1;
     }
 
-    setupSceneData(ssboSpheres, ssboMaterials, ssboVertices, ssboIndices, ssboBVH, ssboTriangleMaterial, &scene);
+    // Watch mode keeps the world mesh and BVH around so edits can be applied in place
+    int watching = config->watch != WATCH_OFF;
+    SceneGeometry geometry;
+    memset(&geometry, 0, sizeof(SceneGeometry));
+
+    // Chunked scenes upload the cells near the camera, falling back to the whole scene
+    int chunked = config->chunkSize > 0.0f;
+    SceneChunks chunks;
+    memset(&chunks, 0, sizeof(SceneChunks));
+
+    if (chunked && watching)
+    {
+        fprintf(stderr, "GLT_WATCH is not supported together with GLT_CHUNK_SIZE, watching is off\n");
+        watching = 0;
+    }
+
+    SceneWatch watch;
+    if (watching) {watchScene(&watch, scenePath, &scene);}
+
+    QuantizationFrame quantFrame;
+    int quantized = chunked ? setupChunkedSceneData(&buffers, &scene, &chunks, &quantFrame) : 0;
+
+    if (quantized < 0) {fprintf(stderr, "Chunked mode failed, uploading the whole scene\n");}
+    chunked = chunked && quantized >= 0;
+    if (!chunked) {quantized = setupSceneData(&buffers, &scene, &quantFrame, watching ? &geometry : NULL);}
+
+    if (quantized < 0)
+    {
+        fprintf(stderr, "Failed to build the scene geometry\n");
+        if (watching) {freeSceneWatch(&watch);}
+        freeSceneGeometry(&geometry);
+        freeSceneChunks(&chunks);
+        freeScene(&scene);
+        shutdownRenderer(&buffers, &frameUniforms, vao, &offscreen);
+        return 1;
+    }
 
-    GLuint computeProgram = createComputeProgram("shaders/raytrace.comp");
+    GLuint computeProgram = createRaytraceProgram(quantized, &quantFrame);
     GLuint displayProgram = createShaderProgram();
-    GLuint denoiseProgram = createComputeProgram("shaders/denoise.comp");
+    GLuint denoiseProgram = createComputeProgram("shaders/denoise.comp", NULL);
+
+    // Neither program is created again, their locations hold for the whole run
+    GLint stepWidthLocation = glGetUniformLocation(denoiseProgram, "u_stepWidth");
+    glUseProgram(displayProgram);
+    glUniform1i(glGetUniformLocation(displayProgram, "u_texture"), 0);
+
+    setupTextures(g_newWidth, g_newHeight);
+
+    GpuTimer gpuTimer;
+    initGpuTimer(&gpuTimer);
 
-    setupTextures(WIDTH, HEIGHT);
+    double renderStart = getTimeSeconds();
+    int renderedFrames = 0;
 
     // Main loop
-    while (!glfwWindowShouldClose(window))
+    while (window ? !glfwWindowShouldClose(window) : g_frameCount < config->offscreenFrames)
     {
-        float currentFrame = (float)glfwGetTime();
+        float currentFrame = window ? (float)glfwGetTime() : (float)(getTimeSeconds() - renderStart);
         g_deltaTime = currentFrame - g_lastFrame;
         g_lastFrame = currentFrame;
 
@@ -574,8 +1536,32 @@ int main(int argc, char* argv[])
             g_framebufferResized = false;
         }
 
-        bool cameraMoved = processInput(window);
+        // Accumulation only restarts when the reload changed something visible
+        if (watching && pollSceneWatch(&watch) &&
+            hotReloadScene(scenePath, &scene, &watch, &buffers, &geometry, &quantFrame, &computeProgram))
+        {
+            g_frameCount = 0;
+        }
+
+        bool cameraMoved = window && processInput(window);
         if (cameraMoved) {g_frameCount = 0;}
+
+        // Cells come and go as the camera crosses them, the stitched tree is rebuilt each time
+        float eye[3] = {g_camera.x, g_camera.y, g_camera.z};
+        if (chunked && updateChunkResidency(&chunks, eye))
+        {
+            int uploaded = uploadResidentChunks(&buffers, &chunks, &quantFrame);
+
+            // Quantized vertices follow the resident bounds, the decode frame lives in the program
+            if (uploaded >= 0 && (uploaded || quantized))
+            {
+                glDeleteProgram(computeProgram);
+                computeProgram = createRaytraceProgram(uploaded, &quantFrame);
+            }
+            if (uploaded >= 0) {quantized = uploaded;}
+            g_frameCount = 0;
+        }
+
         g_frameCount++;
 
         Vec4 forward = {0.0f, 0.0f, 0.0f, 0.0f};
@@ -592,47 +1578,45 @@ int main(int argc, char* argv[])
         Vec4 trueUp = crossProduct(right, forward);
         normalize(&trueUp);
 
-        glUseProgram(computeProgram);
+        FrameUniforms uniforms =
+        {
+            {g_camera.x, g_camera.y, g_camera.z}, g_camera.yaw,
+            {forward.x, forward.y, forward.z}, g_camera.pitch,
+            {right.x, right.y, right.z}, g_frameCount,
+            {trueUp.x, trueUp.y, trueUp.z}, g_isDay,
+            {(float)g_newWidth, (float)g_newHeight}, {0.0f, 0.0f}
+        };
+        pushFrameUniforms(&frameUniforms, &uniforms);
 
-        glUniform1i(glGetUniformLocation(computeProgram, "u_isDay"), g_isDay);
-        glUniform3f(glGetUniformLocation(computeProgram, "u_camForward"), forward.x, forward.y, forward.z);
-        glUniform3f(glGetUniformLocation(computeProgram, "u_camRight"), right.x, right.y, right.z);
-        glUniform3f(glGetUniformLocation(computeProgram, "u_camUp"), trueUp.x, trueUp.y, trueUp.z);
-        glUniform2f(glGetUniformLocation(computeProgram, "u_resolution"), (float)g_newWidth, (float)g_newHeight);
+        glUseProgram(computeProgram);
 
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, g_accumTexture, 0);
 
-        glUniform1i(glGetUniformLocation(computeProgram, "u_frameCount"), g_frameCount);
-        glUniform1i(glGetUniformLocation(computeProgram, "u_historyTexture"), 0);
-        glUniform3f(glGetUniformLocation(computeProgram, "u_cameraPos"), g_camera.x, g_camera.y, g_camera.z);
-        glUniform1f(glGetUniformLocation(computeProgram, "u_cameraYaw"), g_camera.yaw);
-        glUniform1f(glGetUniformLocation(computeProgram, "u_cameraPitch"), g_camera.pitch);
-
         glActiveTexture(GL_TEXTURE0);
-
         glBindTexture(GL_TEXTURE_2D, g_accumTexture);
-        glUniform1i(glGetUniformLocation(computeProgram, "u_historyTexture"), 0);
 
         // RT 
+        beginGpuTimer(&gpuTimer, TIMER_RAYTRACE);
         glBindImageTexture(0, g_outputTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
         glBindImageTexture(1, g_normalTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
         glDispatchCompute((g_newWidth + 15) / 16, (g_newHeight + 15) / 16, 1);
         glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        endGpuTimer();
 
         // Denoiser
         glUseProgram(denoiseProgram);
-        glUniform2f(glGetUniformLocation(denoiseProgram, "u_resolution"), (float)g_newWidth, (float)g_newHeight);
 
         GLuint readTex = g_outputTexture;
         GLuint writeTex = g_denoisedTexture;
 
         int denoisePasses = 3;
 
+        beginGpuTimer(&gpuTimer, TIMER_DENOISE);
         if (g_enableDenoise)
         {
             for (int i = 0; i < denoisePasses; i++)
             {
-                glUniform1i(glGetUniformLocation(denoiseProgram, "u_stepWidth"), 1 << i);
+                glUniform1i(stepWidthLocation, 1 << i);
 
                 glBindImageTexture(0, readTex, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
                 glBindImageTexture(1, g_normalTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
@@ -647,40 +1631,55 @@ int main(int argc, char* argv[])
                 writeTex = (writeTex == g_denoisedTexture) ? g_denoiseSwapTexture : g_denoisedTexture;
             }
         }
+        endGpuTimer();
+        fenceStreamRing(&frameUniforms);
+        fenceStreamRing(&buffers.staging);
+
+        resolveGpuTimer(&gpuTimer, currentFrame, g_newWidth, g_newHeight);
 
         glViewport(0, 0, g_newWidth, g_newHeight);
-        glClear(GL_COLOR_BUFFER_BIT); // Clear default framebuffer
+        glBindFramebuffer(GL_FRAMEBUFFER, offscreen.framebuffer);
+        glClear(GL_COLOR_BUFFER_BIT); // Clear default or offscreen framebuffer
 
         glUseProgram(displayProgram);
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, readTex);
-        glUniform1i(glGetUniformLocation(displayProgram, "u_texture"), 0);
 
         // Draw Fullscreen Quad
         glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
         GLuint temp = g_accumTexture;
         g_accumTexture = g_outputTexture;
         g_outputTexture = temp;
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        renderedFrames++;
+
+        if (window)
+        {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
     }   
 
-    glDeleteBuffers(1, &ssboBVH);
-    glDeleteBuffers(1, &ssboIndices);
-    glDeleteBuffers(1, &ssboVertices);
-    glDeleteBuffers(1, &ssboMaterials);
-    glDeleteBuffers(1, &ssboTriangleMaterial);
+    int status = 0;
+    if (config->offscreenPath)
+    {
+        glFinish();
+        double seconds = getTimeSeconds() - renderStart;
+        printf("Offscreen: %d frames at %dx%d in %.2f s, %.2f ms per frame\n",
+            renderedFrames, g_newWidth, g_newHeight, seconds, seconds * 1000.0 / renderedFrames);
 
-    glDeleteTextures(1, &g_accumTexture);
-    glDeleteTextures(1, &g_outputTexture);
-    glDeleteTextures(1, &g_denoisedTexture);
-    glDeleteTextures(1, &g_denoiseSwapTexture);
-    glDeleteVertexArrays(1, &vao);
+        if (writeOffscreenImage(&offscreen, g_newWidth, g_newHeight, config->offscreenPath)) {printf("Wrote %s\n", config->offscreenPath);}
+        else {status = 1;}
+    }
 
-    glFinish();
-    glfwTerminate();
-    return 0;
+    if (watching) {freeSceneWatch(&watch);}
+    freeSceneGeometry(&geometry);
+    freeSceneChunks(&chunks);
+    freeScene(&scene);
+
+    shutdownRenderer(&buffers, &frameUniforms, vao, &offscreen);
+    return status;
 }
\ No newline at end of file
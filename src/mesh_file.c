@@ -0,0 +1,238 @@
+#include "mesh_file.h"
+#include "bvh.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + MESH_FILE_ALIGN - 1) & ~(uint64_t)(MESH_FILE_ALIGN - 1);
+}
+
+int isMeshFile(const MappedFile* file)
+{
+    return file->size >= MESH_FILE_V1_HEADER_SIZE && memcmp(file->data, MESH_FILE_MAGIC, sizeof(MESH_FILE_MAGIC)) == 0;
+}
+
+// Section must be aligned and lie inside the file
+static int sectionValid(uint64_t offset, uint64_t count, size_t elementSize, size_t fileSize)
+{
+    if (count == 0) {return 1;}
+    if (offset == 0 || offset % MESH_FILE_ALIGN != 0 || offset > fileSize) {return 0;}
+
+    return count <= (fileSize - offset) / elementSize;
+}
+
+// Children must lie after their parent and inside the section, leaves inside
+// the triangles, so every walk over the tree stays in bounds and ends
+static int storedBVHValid(const BVHNode* nodes, uint32_t nodeCount, uint32_t triangleCount)
+{
+    for (uint32_t n = 0; n < nodeCount; n++)
+    {
+        const BVHNode* node = &nodes[n];
+        if (node->triCount > 0)
+        {
+            if ((uint64_t)node->leftFirst + node->triCount > triangleCount) {return 0;}
+        }
+        else if (node->leftFirst <= n || (uint64_t)node->leftFirst + 1 >= nodeCount) {return 0;}
+    }
+    return 1;
+}
+
+int loadMeshImage(const char* name, MappedFile* file, uint64_t offset, uint64_t size, MeshData* mesh)
+{
+    if (offset > file->size || size > file->size - offset || size < MESH_FILE_V1_HEADER_SIZE ||
+        memcmp(file->data + offset, MESH_FILE_MAGIC, sizeof(MESH_FILE_MAGIC)) != 0)
+    {
+        fprintf(stderr, "Invalid or unsupported mesh file: %s\n", name);
+        return 0;
+    }
+
+    const char* image = file->data + offset;
+
+    // Version 1 headers end before the BVH fields, which then read as zero
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(MeshFileHeader));
+    memcpy(&header, image, MESH_FILE_V1_HEADER_SIZE);
+    if (header.version >= 2 && size >= sizeof(MeshFileHeader)) {memcpy(&header, image, sizeof(MeshFileHeader));}
+
+    int hasMaterials = (header.flags & MESH_FILE_HAS_MATERIALS) != 0;
+    int hasNormals = (header.flags & MESH_FILE_HAS_NORMALS) != 0;
+    int hasBVH = (header.flags & MESH_FILE_HAS_BVH) != 0;
+
+    // Counts in 64 bits, triangleCount * 3 wraps in 32 and would pass with a short index section
+    uint64_t triangleCount = header.triangleCount;
+    uint64_t indexCount = triangleCount * 3;
+
+    // Structure only, vertex index values are trusted so the load stays page fault
+    // driven. Tree topology is not, traversal follows it unchecked, see storedBVHValid.
+    if (header.version < 1 || header.version > MESH_FILE_VERSION || header.fileSize != size ||
+        header.indexCount != indexCount ||
+        !sectionValid(header.vertexOffset, header.vertexCount, sizeof(GPUPackedVertex), size) ||
+        !sectionValid(header.indexOffset, indexCount, sizeof(uint32_t), size) ||
+        (hasMaterials && !sectionValid(header.materialOffset, triangleCount, sizeof(uint32_t), size)) ||
+        (hasNormals && !sectionValid(header.normalOffset, header.normalCount, sizeof(GPUPackedVertex), size)) ||
+        (hasNormals && !sectionValid(header.normalIndexOffset, indexCount, sizeof(uint32_t), size)) ||
+        (hasBVH && (header.bvhNodeCount == 0 || !sectionValid(header.bvhOffset, header.bvhNodeCount, sizeof(BVHNode), size))))
+    {
+        fprintf(stderr, "Invalid or unsupported mesh file: %s\n", name);
+        return 0;
+    }
+
+    // Private copy on write view, in place edits like the BVH sort stay local
+    char* base = (char*)file->data + offset;
+
+    retainMappedFile(file);
+    memset(mesh, 0, sizeof(MeshData));
+    mesh->mapping = file;
+
+    mesh->vertices = header.vertexCount ? (GPUPackedVertex*)(base + header.vertexOffset) : NULL;
+    mesh->indices = header.indexCount ? (uint32_t*)(base + header.indexOffset) : NULL;
+    mesh->vertexCount = header.vertexCount;
+    mesh->indexCount = header.indexCount;
+    mesh->triangleCount = header.triangleCount;
+    memcpy(mesh->minBounds, header.minBounds, sizeof(mesh->minBounds));
+    memcpy(mesh->maxBounds, header.maxBounds, sizeof(mesh->maxBounds));
+
+    if (hasMaterials && header.triangleCount) {mesh->triangleMaterials = (uint32_t*)(base + header.materialOffset);}
+
+    if (hasNormals)
+    {
+        mesh->normals = header.normalCount ? (GPUPackedVertex*)(base + header.normalOffset) : NULL;
+        mesh->normalIndices = header.indexCount ? (uint32_t*)(base + header.normalIndexOffset) : NULL;
+        mesh->normalCount = header.normalCount;
+    }
+
+    if (hasBVH && !storedBVHValid((const BVHNode*)(base + header.bvhOffset), header.bvhNodeCount, header.triangleCount))
+    {
+        fprintf(stderr, "Stored BVH of %s is corrupt, rebuilding it\n", name);
+        hasBVH = 0;
+    }
+
+    if (hasBVH)
+    {
+        mesh->bvhNodes = (BVHNode*)(base + header.bvhOffset);
+        mesh->bvhNodeCount = header.bvhNodeCount;
+    }
+
+    return 1;
+}
+
+int loadMeshFile(const char* filename, MappedFile* file, MeshData* mesh)
+{
+    MappedFile* shared = shareMappedFile(file);
+    if (!shared)
+    {
+        fprintf(stderr, "Memory allocation failed for mesh file: %s\n", filename);
+        return 0;
+    }
+
+    int loaded = loadMeshImage(filename, shared, 0, shared->size, mesh);
+    releaseMappedFile(shared);
+
+    return loaded;
+}
+
+uint64_t placeMeshSection(uint64_t* end, size_t bytes)
+{
+    if (bytes == 0) {return 0;}
+
+    uint64_t offset = alignOffset(*end);
+    *end = offset + bytes;
+    return offset;
+}
+
+int padMeshSection(FILE* file, uint64_t offset)
+{
+    static const char zeros[MESH_FILE_ALIGN] = {0};
+    int64_t position = tellFile(file);
+    if (position < 0 || (uint64_t)position > offset || offset - (uint64_t)position > MESH_FILE_ALIGN) {return 0;}
+
+    return fwrite(zeros, 1, (size_t)(offset - (uint64_t)position), file) == offset - (uint64_t)position;
+}
+
+static int writeSection(FILE* file, uint64_t offset, const void* data, size_t bytes)
+{
+    if (bytes == 0) {return 1;}
+
+    return padMeshSection(file, offset) && fwrite(data, 1, bytes, file) == bytes;
+}
+
+int writeMeshImage(FILE* file, const MeshData* mesh)
+{
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(MeshFileHeader));
+
+    memcpy(header.magic, MESH_FILE_MAGIC, sizeof(MESH_FILE_MAGIC));
+    header.version = MESH_FILE_VERSION;
+    header.vertexCount = mesh->vertexCount;
+    header.indexCount = mesh->indexCount;
+    header.triangleCount = mesh->triangleCount;
+    memcpy(header.minBounds, mesh->minBounds, sizeof(header.minBounds));
+    memcpy(header.maxBounds, mesh->maxBounds, sizeof(header.maxBounds));
+
+    size_t vertexBytes = sizeof(GPUPackedVertex) * mesh->vertexCount;
+    size_t indexBytes = sizeof(uint32_t) * mesh->indexCount;
+    size_t materialBytes = mesh->triangleMaterials ? sizeof(uint32_t) * mesh->triangleCount : 0;
+    size_t normalBytes = mesh->normalIndices ? sizeof(GPUPackedVertex) * mesh->normalCount : 0;
+    size_t normalIndexBytes = mesh->normalIndices ? indexBytes : 0;
+    size_t bvhBytes = mesh->bvhNodes ? sizeof(BVHNode) * mesh->bvhNodeCount : 0;
+
+    if (materialBytes) {header.flags |= MESH_FILE_HAS_MATERIALS;}
+    if (normalIndexBytes)
+    {
+        header.flags |= MESH_FILE_HAS_NORMALS;
+        header.normalCount = mesh->normalCount;
+    }
+
+    if (bvhBytes)
+    {
+        header.flags |= MESH_FILE_HAS_BVH;
+        header.bvhNodeCount = mesh->bvhNodeCount;
+    }
+
+    uint64_t end = sizeof(MeshFileHeader);
+
+    header.vertexOffset = placeMeshSection(&end, vertexBytes);
+    header.indexOffset = placeMeshSection(&end, indexBytes);
+    header.materialOffset = placeMeshSection(&end, materialBytes);
+    header.normalOffset = placeMeshSection(&end, normalBytes);
+    header.normalIndexOffset = placeMeshSection(&end, normalIndexBytes);
+    header.bvhOffset = placeMeshSection(&end, bvhBytes);
+    header.fileSize = end;
+
+    // Offsets are relative to the image, which may sit inside a larger file
+    int64_t base = tellFile(file);
+    if (base < 0 || (uint64_t)base % MESH_FILE_ALIGN != 0) {return 0;}
+
+    return fwrite(&header, sizeof(MeshFileHeader), 1, file) == 1 &&
+        writeSection(file, base + header.vertexOffset, mesh->vertices, vertexBytes) &&
+        writeSection(file, base + header.indexOffset, mesh->indices, indexBytes) &&
+        writeSection(file, base + header.materialOffset, mesh->triangleMaterials, materialBytes) &&
+        writeSection(file, base + header.normalOffset, mesh->normals, normalBytes) &&
+        writeSection(file, base + header.normalIndexOffset, mesh->normalIndices, normalIndexBytes) &&
+        writeSection(file, base + header.bvhOffset, mesh->bvhNodes, bvhBytes);
+}
+
+int writeMeshFile(const char* filename, const MeshData* mesh)
+{
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Could not create mesh file: %s\n", filename);
+        return 0;
+    }
+
+    int written = writeMeshImage(file, mesh);
+    if (fclose(file) != 0) {written = 0;}
+
+    if (!written)
+    {
+        fprintf(stderr, "Failed to write mesh file: %s\n", filename);
+        remove(filename);
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,856 @@
+#include "mesh_ingest.h"
+#include "mesh_file.h"
+#include "file_util.h"
+#include "hash_util.h"
+#include "parse_util.h"
+#include "bvh.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// OBJ read window, also the longest line accepted
+#define INGEST_READ_BYTES (8u << 20)
+
+// Triangles moved per read when spill files are split or copied
+#define INGEST_BATCH_TRIANGLES 65536u
+
+// Worst case heap per triangle while a bucket builds: 12 indices, up to 48
+// local vertices, up to 48 vertex remap, 64 nodes, rounded up
+#define INGEST_TRIANGLE_BYTES 192u
+
+// A limit that leaves less than this per bucket is refused, tiny buckets only make the top level deep
+#define INGEST_MIN_BUCKET 4096u
+
+#define INGEST_MAX_DEPTH 24
+#define INGEST_EMPTY_SLOT 0xFFFFFFFFu
+
+// Triangles of one spill file and the box their centroids fall in
+typedef struct
+{
+    uint32_t file;
+    uint32_t triangleCount;
+    float centroidMin[3];
+    float centroidMax[3];
+} IngestBucket;
+
+// One finished bucket, its spill file holds nodes, local vertices, leaf ordered local indices
+typedef struct
+{
+    uint32_t file;
+    uint32_t nodeCount;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    BVHNode root;
+} IngestSubtree;
+
+typedef struct
+{
+    const char* outPath;
+    const float* positions;     // Mapped vertex spill, 3 floats per OBJ vertex
+    uint32_t vertexCount;
+    uint32_t bucketLimit;
+    uint32_t nextFile;
+
+    uint32_t* batch;            // INGEST_BATCH_TRIANGLES * 3 indices
+
+    IngestSubtree* subtrees;
+    uint32_t subtreeCount;
+    uint32_t subtreeCapacity;
+} IngestState;
+
+static void spillPath(const IngestState* state, uint32_t file, char* path, size_t size)
+{
+    snprintf(path, size, "%s.%u.tmp", state->outPath, file);
+}
+
+static FILE* openSpill(const IngestState* state, uint32_t file, const char* mode)
+{
+    char path[1024];
+    spillPath(state, file, path, sizeof(path));
+
+    FILE* handle = fopen(path, mode);
+    if (!handle) {fprintf(stderr, "Could not open spill file: %s\n", path);}
+    return handle;
+}
+
+static void removeSpill(const IngestState* state, uint32_t file)
+{
+    char path[1024];
+    spillPath(state, file, path, sizeof(path));
+    remove(path);
+}
+
+static void resetCentroidBox(IngestBucket* bucket)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        bucket->centroidMin[a] = INFINITY;
+        bucket->centroidMax[a] = -INFINITY;
+    }
+}
+
+static void triangleCentroid(const IngestState* state, const uint32_t* tri, float* c)
+{
+    const float* p0 = &state->positions[tri[0] * 3ull];
+    const float* p1 = &state->positions[tri[1] * 3ull];
+    const float* p2 = &state->positions[tri[2] * 3ull];
+
+    for (int a = 0; a < 3; a++) {c[a] = (p0[a] + p1[a] + p2[a]) * (1.0f / 3.0f);}
+}
+
+static void growCentroidBox(IngestBucket* bucket, const float* c)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        if (c[a] < bucket->centroidMin[a]) {bucket->centroidMin[a] = c[a];}
+        if (c[a] > bucket->centroidMax[a]) {bucket->centroidMax[a] = c[a];}
+    }
+}
+
+typedef struct
+{
+    FILE* vertices;
+    FILE* triangles;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    uint64_t normalCount;   // vn lines seen, ingest keeps positions only
+    uint64_t line;
+} ObjSpill;
+
+// v and f lines of [p, end), which holds whole lines only
+static int spillObjLines(ObjSpill* spill, const char* p, const char* end)
+{
+    while (p < end)
+    {
+        const char* lineEnd = memchr(p, '\n', (size_t)(end - p));
+        if (!lineEnd) {lineEnd = end;}
+        spill->line++;
+
+        p = skipBlanks(p, lineEnd);
+
+        if (lineEnd - p > 1 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            float v[3] = {0.0f, 0.0f, 0.0f};
+            const char* q = p + 1;
+            for (int a = 0; a < 3; a++) {q = parseFloat(skipBlanks(q, lineEnd), lineEnd, &v[a]);}
+
+            if (spill->vertexCount == UINT32_MAX)
+            {
+                fprintf(stderr, "Too many vertices for 32 bit indices\n");
+                return 0;
+            }
+            if (fwrite(v, sizeof(v), 1, spill->vertices) != 1) {return 0;}
+            spill->vertexCount++;
+        }
+        else if (lineEnd - p > 2 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            spill->normalCount++;
+        }
+        else if (lineEnd - p > 1 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            uint32_t first = 0;
+            uint32_t previous = 0;
+            int corners = 0;
+            const char* q = p + 1;
+
+            for (;;)
+            {
+                q = skipBlanks(q, lineEnd);
+                int64_t index;
+                const char* next = parseInt(q, lineEnd, &index);
+                if (next == q) {break;}
+
+                // Texture and normal references are not kept
+                q = next;
+                while (q < lineEnd && *q != ' ' && *q != '\t' && *q != '\r') {q++;}
+
+                if (index < 0) {index += (int64_t)spill->vertexCount + 1;}
+                if (index < 1 || index > (int64_t)spill->vertexCount)
+                {
+                    fprintf(stderr, "Face on line %llu references a vertex not defined before it\n",
+                        (unsigned long long)spill->line);
+                    return 0;
+                }
+
+                uint32_t vertex = (uint32_t)(index - 1);
+                if (corners == 0) {first = vertex;}
+                if (corners >= 2)
+                {
+                    uint32_t tri[3] = {first, previous, vertex};
+                    if (fwrite(tri, sizeof(tri), 1, spill->triangles) != 1) {return 0;}
+                    spill->triangleCount++;
+                }
+
+                previous = vertex;
+                corners++;
+            }
+        }
+
+        p = lineEnd + 1;
+    }
+
+    return 1;
+}
+
+// Streams the OBJ through a fixed window into the vertex spill and the first triangle spill
+static int spillObj(const char* objPath, ObjSpill* spill)
+{
+    FILE* input = fopen(objPath, "rb");
+    if (!input)
+    {
+        fprintf(stderr, "Could not open OBJ: %s\n", objPath);
+        return 0;
+    }
+
+    char* window = malloc(INGEST_READ_BYTES);
+    if (!window)
+    {
+        fprintf(stderr, "Memory allocation for the read window failed\n");
+        fclose(input);
+        return 0;
+    }
+
+    size_t kept = 0;
+    int done = 0;
+    int ok = 1;
+
+    while (ok && !done)
+    {
+        size_t got = fread(window + kept, 1, INGEST_READ_BYTES - kept, input);
+        size_t length = kept + got;
+        done = got == 0;
+
+        if (ferror(input))
+        {
+            fprintf(stderr, "Failed to read OBJ: %s\n", objPath);
+            ok = 0;
+            break;
+        }
+
+        // Whole lines only until the file ends, the partial tail waits for the next read
+        const char* end = window + length;
+        if (!done)
+        {
+            while (end > window && end[-1] != '\n') {end--;}
+            if (end == window && length == INGEST_READ_BYTES)
+            {
+                fprintf(stderr, "OBJ line longer than %u bytes\n", INGEST_READ_BYTES);
+                ok = 0;
+                break;
+            }
+        }
+
+        ok = spillObjLines(spill, window, end);
+
+        kept = (size_t)(window + length - end);
+        memmove(window, end, kept);
+    }
+
+    if (ok && (ferror(spill->vertices) || ferror(spill->triangles)))
+    {
+        fprintf(stderr, "Failed to write spill files\n");
+        ok = 0;
+    }
+
+    free(window);
+    fclose(input);
+    return ok;
+}
+
+static int addSubtree(IngestState* state, const IngestSubtree* subtree)
+{
+    if (state->subtreeCount == state->subtreeCapacity)
+    {
+        uint32_t capacity = state->subtreeCapacity ? state->subtreeCapacity * 2 : 64;
+        IngestSubtree* grown = realloc(state->subtrees, sizeof(IngestSubtree) * capacity);
+        if (!grown) {return 0;}
+        state->subtrees = grown;
+        state->subtreeCapacity = capacity;
+    }
+
+    state->subtrees[state->subtreeCount++] = *subtree;
+    return 1;
+}
+
+// Global to local vertex numbering, open addressing, grows at half load
+typedef struct
+{
+    uint32_t* keys;
+    uint32_t* values;
+    uint32_t mask;
+    uint32_t count;
+} VertexRemap;
+
+static int initRemap(VertexRemap* remap, uint32_t capacity)
+{
+    uint32_t size = 64;
+    while (size < capacity) {size <<= 1;}
+
+    remap->keys = malloc(sizeof(uint32_t) * size);
+    remap->values = malloc(sizeof(uint32_t) * size);
+    remap->mask = size - 1;
+    remap->count = 0;
+
+    if (!remap->keys || !remap->values) {return 0;}
+    memset(remap->keys, 0xFF, sizeof(uint32_t) * size);
+    return 1;
+}
+
+static void freeRemap(VertexRemap* remap)
+{
+    free(remap->keys);
+    free(remap->values);
+}
+
+static uint32_t* findRemapSlot(VertexRemap* remap, uint32_t key)
+{
+    uint32_t slot = hashUint(key) & remap->mask;
+    while (remap->keys[slot] != INGEST_EMPTY_SLOT && remap->keys[slot] != key) {slot = (slot + 1) & remap->mask;}
+    return &remap->keys[slot];
+}
+
+static int growRemap(VertexRemap* remap)
+{
+    VertexRemap grown;
+    if (!initRemap(&grown, (remap->mask + 1) * 2))
+    {
+        freeRemap(&grown);
+        return 0;
+    }
+
+    for (uint32_t i = 0; i <= remap->mask; i++)
+    {
+        if (remap->keys[i] == INGEST_EMPTY_SLOT) {continue;}
+        uint32_t* key = findRemapSlot(&grown, remap->keys[i]);
+        *key = remap->keys[i];
+        grown.values[key - grown.keys] = remap->values[i];
+    }
+    grown.count = remap->count;
+
+    freeRemap(remap);
+    *remap = grown;
+    return 1;
+}
+
+// Local index of a global vertex, UINT32_MAX when the table could not grow
+static uint32_t remapVertex(VertexRemap* remap, uint32_t global)
+{
+    if ((remap->count + 1) * 2 > remap->mask + 1 && !growRemap(remap)) {return UINT32_MAX;}
+
+    uint32_t* key = findRemapSlot(remap, global);
+    uint32_t* value = &remap->values[key - remap->keys];
+    if (*key == INGEST_EMPTY_SLOT)
+    {
+        *key = global;
+        *value = remap->count++;
+    }
+
+    return *value;
+}
+
+// Builds the BVH of one bucket and spills nodes, local vertices and leaf ordered indices
+static int buildSubtree(IngestState* state, const IngestBucket* bucket)
+{
+    uint32_t triangleCount = bucket->triangleCount;
+    int ok = 0;
+
+    MeshData mesh;
+    memset(&mesh, 0, sizeof(MeshData));
+    BVH bvh = {NULL, 0};
+    VertexRemap remap = {NULL, NULL, 0, 0};
+
+    mesh.indices = malloc(sizeof(uint32_t) * 3 * (size_t)triangleCount);
+    if (!mesh.indices || !initRemap(&remap, triangleCount))
+    {
+        fprintf(stderr, "Memory allocation for an ingest bucket failed\n");
+        goto done;
+    }
+
+    FILE* input = openSpill(state, bucket->file, "rb");
+    if (!input) {goto done;}
+    size_t read = fread(mesh.indices, sizeof(uint32_t) * 3, triangleCount, input);
+    fclose(input);
+    if (read != triangleCount)
+    {
+        fprintf(stderr, "Failed to read spill file %u\n", bucket->file);
+        goto done;
+    }
+
+    mesh.indexCount = triangleCount * 3;
+    mesh.triangleCount = triangleCount;
+
+    for (uint32_t i = 0; i < mesh.indexCount; i++)
+    {
+        mesh.indices[i] = remapVertex(&remap, mesh.indices[i]);
+        if (mesh.indices[i] == UINT32_MAX)
+        {
+            fprintf(stderr, "Memory allocation for the vertex remap failed\n");
+            goto done;
+        }
+    }
+
+    mesh.vertexCount = remap.count;
+    mesh.vertices = malloc(sizeof(GPUPackedVertex) * (size_t)mesh.vertexCount);
+    if (!mesh.vertices)
+    {
+        fprintf(stderr, "Memory allocation for an ingest bucket failed\n");
+        goto done;
+    }
+
+    // Bounds of the referenced vertices are the root box of the bucket tree
+    for (int a = 0; a < 3; a++)
+    {
+        mesh.minBounds[a] = INFINITY;
+        mesh.maxBounds[a] = -INFINITY;
+    }
+
+    for (uint32_t i = 0; i <= remap.mask; i++)
+    {
+        if (remap.keys[i] == INGEST_EMPTY_SLOT) {continue;}
+        const float* p = &state->positions[remap.keys[i] * 3ull];
+        GPUPackedVertex* v = &mesh.vertices[remap.values[i]];
+        v->x = p[0];
+        v->y = p[1];
+        v->z = p[2];
+        v->padding = 0.0f;
+
+        for (int a = 0; a < 3; a++)
+        {
+            mesh.minBounds[a] = fminf(mesh.minBounds[a], p[a]);
+            mesh.maxBounds[a] = fmaxf(mesh.maxBounds[a], p[a]);
+        }
+    }
+
+    // The table is done with before the nodes exist, keeps the peak at the estimate
+    freeRemap(&remap);
+    remap.keys = remap.values = NULL;
+
+    // Quiet build, the report would repeat for every bucket
+    if (!buildBVHNodes(&bvh, &mesh, malloc)) {goto done;}
+
+    IngestSubtree subtree;
+    subtree.file = state->nextFile++;
+    subtree.nodeCount = bvh.nodeCount;
+    subtree.vertexCount = mesh.vertexCount;
+    subtree.triangleCount = triangleCount;
+    subtree.root = bvh.nodes[0];
+
+    FILE* output = openSpill(state, subtree.file, "wb");
+    if (!output) {goto done;}
+
+    int written = fwrite(bvh.nodes, sizeof(BVHNode), bvh.nodeCount, output) == bvh.nodeCount &&
+        fwrite(mesh.vertices, sizeof(GPUPackedVertex), mesh.vertexCount, output) == mesh.vertexCount &&
+        fwrite(mesh.indices, sizeof(uint32_t), mesh.indexCount, output) == mesh.indexCount;
+    if (fclose(output) != 0) {written = 0;}
+
+    if (!written)
+    {
+        fprintf(stderr, "Failed to write spill file %u\n", subtree.file);
+        goto done;
+    }
+
+    ok = addSubtree(state, &subtree);
+
+done:
+    freeRemap(&remap);
+    free(bvh.nodes);
+    free(mesh.vertices);
+    free(mesh.indices);
+    removeSpill(state, bucket->file);
+    return ok;
+}
+
+// Centroid box of a bucket read back from its spill file. The root needs it,
+// a box over the vertices would let unreferenced outliers put every centroid
+// into one octant.
+static int measureBucket(IngestState* state, IngestBucket* bucket)
+{
+    FILE* input = openSpill(state, bucket->file, "rb");
+    if (!input) {return 0;}
+
+    resetCentroidBox(bucket);
+    int ok = 1;
+
+    for (uint32_t remaining = bucket->triangleCount; remaining > 0 && ok;)
+    {
+        uint32_t count = remaining < INGEST_BATCH_TRIANGLES ? remaining : INGEST_BATCH_TRIANGLES;
+        if (fread(state->batch, sizeof(uint32_t) * 3, count, input) != count)
+        {
+            fprintf(stderr, "Failed to read spill file %u\n", bucket->file);
+            ok = 0;
+            break;
+        }
+
+        for (uint32_t t = 0; t < count; t++)
+        {
+            float c[3];
+            triangleCentroid(state, &state->batch[t * 3], c);
+            growCentroidBox(bucket, c);
+        }
+
+        remaining -= count;
+    }
+
+    fclose(input);
+    return ok;
+}
+
+// Splits a bucket into centroid octants until every piece fits the per bucket limit
+static int processBucket(IngestState* state, const IngestBucket* bucket, int depth)
+{
+    if (bucket->triangleCount <= state->bucketLimit) {return buildSubtree(state, bucket);}
+
+    if (depth >= INGEST_MAX_DEPTH)
+    {
+        fprintf(stderr, "Ingest buckets still too large after %d splits\n", depth);
+        return 0;
+    }
+
+    float mid[3];
+    for (int a = 0; a < 3; a++) {mid[a] = 0.5f * (bucket->centroidMin[a] + bucket->centroidMax[a]);}
+
+    IngestBucket children[8];
+    FILE* outputs[8] = {NULL};
+    int ok = 1;
+
+    FILE* input = openSpill(state, bucket->file, "rb");
+    if (!input) {ok = 0;}
+
+    for (int c = 0; c < 8 && ok; c++)
+    {
+        children[c].file = state->nextFile++;
+        children[c].triangleCount = 0;
+        resetCentroidBox(&children[c]);
+        outputs[c] = openSpill(state, children[c].file, "wb");
+        if (!outputs[c]) {ok = 0;}
+    }
+
+    uint32_t remaining = bucket->triangleCount;
+    while (ok && remaining > 0)
+    {
+        uint32_t count = remaining < INGEST_BATCH_TRIANGLES ? remaining : INGEST_BATCH_TRIANGLES;
+        if (fread(state->batch, sizeof(uint32_t) * 3, count, input) != count)
+        {
+            fprintf(stderr, "Failed to read spill file %u\n", bucket->file);
+            ok = 0;
+            break;
+        }
+
+        for (uint32_t t = 0; t < count && ok; t++)
+        {
+            const uint32_t* tri = &state->batch[t * 3];
+            float c[3];
+            triangleCentroid(state, tri, c);
+
+            int octant = (c[0] > mid[0]) | ((c[1] > mid[1]) << 1) | ((c[2] > mid[2]) << 2);
+            growCentroidBox(&children[octant], c);
+            children[octant].triangleCount++;
+            if (fwrite(tri, sizeof(uint32_t) * 3, 1, outputs[octant]) != 1) {ok = 0;}
+        }
+
+        remaining -= count;
+    }
+
+    if (input) {fclose(input);}
+    for (int c = 0; c < 8; c++)
+    {
+        if (outputs[c] && fclose(outputs[c]) != 0) {ok = 0;}
+    }
+    removeSpill(state, bucket->file);
+
+    if (!ok) {fprintf(stderr, "Failed to split ingest bucket %u\n", bucket->file);}
+
+    for (int c = 0; c < 8 && ok; c++)
+    {
+        // All centroids on one point, no split can separate them
+        if (children[c].triangleCount == bucket->triangleCount)
+        {
+            fprintf(stderr, "%u triangles share one centroid, raise the memory limit\n", bucket->triangleCount);
+            ok = 0;
+        }
+    }
+
+    for (int c = 0; c < 8; c++)
+    {
+        if (ok && children[c].triangleCount > 0) {ok = processBucket(state, &children[c], depth + 1);}
+        else {removeSpill(state, children[c].file);}
+    }
+
+    return ok;
+}
+
+// Streams the merged .gltm: subtree vertices, indices offset to the shared
+// vertex array, then top level nodes followed by every relocated subtree.
+static int writeIngestedMesh(IngestState* state, const char* meshPath)
+{
+    uint32_t count = state->subtreeCount;
+
+    AABB* bounds = malloc(sizeof(AABB) * count);
+    uint32_t* slots = malloc(sizeof(uint32_t) * count);
+    BVH top = {NULL, 0};
+    FILE* output = NULL;
+    FILE* input = NULL;
+    int ok = 0;
+
+    if (!bounds || !slots)
+    {
+        fprintf(stderr, "Memory allocation for the top level failed\n");
+        goto done;
+    }
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(MeshFileHeader));
+    memcpy(header.magic, MESH_FILE_MAGIC, sizeof(MESH_FILE_MAGIC));
+    header.version = MESH_FILE_VERSION;
+    header.flags = MESH_FILE_HAS_BVH;
+
+    for (int a = 0; a < 3; a++)
+    {
+        header.minBounds[a] = INFINITY;
+        header.maxBounds[a] = -INFINITY;
+    }
+
+    uint64_t vertexCount = 0;
+    uint64_t triangleCount = 0;
+    uint64_t nodeCount = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const IngestSubtree* subtree = &state->subtrees[i];
+        for (int a = 0; a < 3; a++)
+        {
+            bounds[i].min[a] = subtree->root.aabbMin[a];
+            bounds[i].max[a] = subtree->root.aabbMax[a];
+            if (bounds[i].min[a] < header.minBounds[a]) {header.minBounds[a] = bounds[i].min[a];}
+            if (bounds[i].max[a] > header.maxBounds[a]) {header.maxBounds[a] = bounds[i].max[a];}
+        }
+
+        vertexCount += subtree->vertexCount;
+        triangleCount += subtree->triangleCount;
+        nodeCount += subtree->nodeCount - 1;
+    }
+
+    if (!buildBVHTopLevel(&top, bounds, count, slots)) {goto done;}
+    nodeCount += top.nodeCount;
+
+    if (vertexCount > UINT32_MAX || triangleCount * 3 > UINT32_MAX || nodeCount > UINT32_MAX)
+    {
+        fprintf(stderr, "Ingested mesh exceeds 32 bit indices\n");
+        goto done;
+    }
+
+    header.vertexCount = (uint32_t)vertexCount;
+    header.triangleCount = (uint32_t)triangleCount;
+    header.indexCount = (uint32_t)(triangleCount * 3);
+    header.bvhNodeCount = (uint32_t)nodeCount;
+
+    uint64_t end = sizeof(MeshFileHeader);
+    header.vertexOffset = placeMeshSection(&end, sizeof(GPUPackedVertex) * (size_t)vertexCount);
+    header.indexOffset = placeMeshSection(&end, sizeof(uint32_t) * (size_t)header.indexCount);
+    header.bvhOffset = placeMeshSection(&end, sizeof(BVHNode) * (size_t)nodeCount);
+    header.fileSize = end;
+
+    output = fopen(meshPath, "wb");
+    if (!output)
+    {
+        fprintf(stderr, "Could not create mesh file: %s\n", meshPath);
+        goto done;
+    }
+
+    if (fwrite(&header, sizeof(MeshFileHeader), 1, output) != 1) {goto done;}
+
+    // The batch holds 3 * INGEST_BATCH_TRIANGLES words, vertices and nodes move in pieces that fit
+    const uint32_t vertexBatch = (uint32_t)(sizeof(uint32_t) * 3 * INGEST_BATCH_TRIANGLES / sizeof(GPUPackedVertex));
+    const uint32_t nodeBatch = (uint32_t)(sizeof(uint32_t) * 3 * INGEST_BATCH_TRIANGLES / sizeof(BVHNode));
+
+    if (!padMeshSection(output, header.vertexOffset)) {goto done;}
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const IngestSubtree* subtree = &state->subtrees[i];
+        input = openSpill(state, subtree->file, "rb");
+        if (!input || seekFile(input, (int64_t)sizeof(BVHNode) * subtree->nodeCount, SEEK_SET) != 0) {goto done;}
+
+        for (uint32_t v = 0; v < subtree->vertexCount; v += vertexBatch)
+        {
+            uint32_t n = subtree->vertexCount - v < vertexBatch ? subtree->vertexCount - v : vertexBatch;
+            if (fread(state->batch, sizeof(GPUPackedVertex), n, input) != n ||
+                fwrite(state->batch, sizeof(GPUPackedVertex), n, output) != n) {goto done;}
+        }
+
+        fclose(input);
+        input = NULL;
+    }
+
+    if (!padMeshSection(output, header.indexOffset)) {goto done;}
+    uint32_t vertexBase = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const IngestSubtree* subtree = &state->subtrees[i];
+        int64_t skip = (int64_t)sizeof(BVHNode) * subtree->nodeCount + (int64_t)sizeof(GPUPackedVertex) * subtree->vertexCount;
+        input = openSpill(state, subtree->file, "rb");
+        if (!input || seekFile(input, skip, SEEK_SET) != 0) {goto done;}
+
+        for (uint32_t t = 0; t < subtree->triangleCount; t += INGEST_BATCH_TRIANGLES)
+        {
+            uint32_t n = subtree->triangleCount - t < INGEST_BATCH_TRIANGLES ? subtree->triangleCount - t : INGEST_BATCH_TRIANGLES;
+            if (fread(state->batch, sizeof(uint32_t) * 3, n, input) != n) {goto done;}
+            for (uint32_t k = 0; k < n * 3; k++) {state->batch[k] += vertexBase;}
+            if (fwrite(state->batch, sizeof(uint32_t) * 3, n, output) != n) {goto done;}
+        }
+
+        fclose(input);
+        input = NULL;
+        vertexBase += subtree->vertexCount;
+    }
+
+    // Top level first, each subtree root goes into its slot, nodes 1.. follow in subtree order
+    uint32_t nodeBase = top.nodeCount;
+    uint32_t triangleBase = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        BVHNode root = state->subtrees[i].root;
+        relocateBVHNode(&root, nodeBase, triangleBase);
+        top.nodes[slots[i]] = root;
+
+        nodeBase += state->subtrees[i].nodeCount - 1;
+        triangleBase += state->subtrees[i].triangleCount;
+    }
+
+    if (!padMeshSection(output, header.bvhOffset) ||
+        fwrite(top.nodes, sizeof(BVHNode), top.nodeCount, output) != top.nodeCount) {goto done;}
+
+    nodeBase = top.nodeCount;
+    triangleBase = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const IngestSubtree* subtree = &state->subtrees[i];
+        input = openSpill(state, subtree->file, "rb");
+        if (!input || seekFile(input, (int64_t)sizeof(BVHNode), SEEK_SET) != 0) {goto done;}
+
+        BVHNode* nodes = (BVHNode*)state->batch;
+        for (uint32_t k = 1; k < subtree->nodeCount; k += nodeBatch)
+        {
+            uint32_t n = subtree->nodeCount - k < nodeBatch ? subtree->nodeCount - k : nodeBatch;
+            if (fread(nodes, sizeof(BVHNode), n, input) != n) {goto done;}
+            for (uint32_t j = 0; j < n; j++) {relocateBVHNode(&nodes[j], nodeBase, triangleBase);}
+            if (fwrite(nodes, sizeof(BVHNode), n, output) != n) {goto done;}
+        }
+
+        fclose(input);
+        input = NULL;
+        nodeBase += subtree->nodeCount - 1;
+        triangleBase += subtree->triangleCount;
+    }
+
+    ok = 1;
+
+done:
+    if (input) {fclose(input);}
+    if (output && fclose(output) != 0) {ok = 0;}
+    if (output && !ok)
+    {
+        fprintf(stderr, "Failed to write mesh file: %s\n", meshPath);
+        remove(meshPath);
+    }
+
+    free(top.nodes);
+    free(slots);
+    free(bounds);
+    return ok;
+}
+
+int ingestObj(const char* objPath, const char* meshPath, size_t memoryLimit)
+{
+    double start = getTimeSeconds();
+
+    IngestState state;
+    memset(&state, 0, sizeof(IngestState));
+    state.outPath = meshPath;
+
+    // File 0 holds vertices, file 1 the triangles as read
+    uint32_t vertexFile = state.nextFile++;
+    IngestBucket root;
+    root.file = state.nextFile++;
+
+    ObjSpill spill;
+    memset(&spill, 0, sizeof(ObjSpill));
+    spill.vertices = openSpill(&state, vertexFile, "wb");
+    spill.triangles = openSpill(&state, root.file, "wb");
+
+    int ok = spill.vertices && spill.triangles && spillObj(objPath, &spill);
+    if (spill.vertices && fclose(spill.vertices) != 0) {ok = 0;}
+    if (spill.triangles && fclose(spill.triangles) != 0) {ok = 0;}
+
+    if (ok && spill.triangleCount == 0)
+    {
+        fprintf(stderr, "No triangles in %s\n", objPath);
+        ok = 0;
+    }
+
+    if (ok && spill.normalCount > 0)
+    {
+        printf("%llu vn normals in %s dropped, ingested meshes carry positions only\n",
+            (unsigned long long)spill.normalCount, objPath);
+    }
+
+    // Positions stay mapped for the whole run, the page cache holds what the buckets touch
+    size_t fixedBytes = (size_t)INGEST_READ_BYTES + sizeof(uint32_t) * 3 * INGEST_BATCH_TRIANGLES +
+        sizeof(float) * 3 * (size_t)spill.vertexCount;
+    if (ok)
+    {
+        size_t perBucket = memoryLimit > fixedBytes ? (memoryLimit - fixedBytes) / INGEST_TRIANGLE_BYTES : 0;
+        if (perBucket < INGEST_MIN_BUCKET)
+        {
+            fprintf(stderr, "Memory limit of %zu MB is too small for %u vertices, need at least %zu MB\n",
+                memoryLimit >> 20, spill.vertexCount,
+                ((fixedBytes + (size_t)INGEST_MIN_BUCKET * INGEST_TRIANGLE_BYTES) >> 20) + 1);
+            ok = 0;
+        }
+        state.bucketLimit = perBucket > UINT32_MAX ? UINT32_MAX : (uint32_t)perBucket;
+    }
+
+    MappedFile vertices = {0};
+    char path[1024];
+    spillPath(&state, vertexFile, path, sizeof(path));
+    if (ok && !mapFile(path, &vertices)) {ok = 0;}
+
+    state.positions = (const float*)vertices.data;
+    state.vertexCount = spill.vertexCount;
+    state.batch = malloc(sizeof(uint32_t) * 3 * INGEST_BATCH_TRIANGLES);
+    if (ok && !state.batch)
+    {
+        fprintf(stderr, "Memory allocation for the ingest batch failed\n");
+        ok = 0;
+    }
+
+    double parsed = getTimeSeconds();
+
+    if (ok)
+    {
+        root.triangleCount = spill.triangleCount;
+        ok = measureBucket(&state, &root) && processBucket(&state, &root, 0);
+    }
+
+    double built = getTimeSeconds();
+
+    if (ok) {ok = writeIngestedMesh(&state, meshPath);}
+
+    if (ok)
+    {
+        printf("Ingested %u vertices, %u triangles in %u buckets of at most %u (parse %.2f s, build %.2f s, write %.2f s)\n",
+            spill.vertexCount, spill.triangleCount, state.subtreeCount, state.bucketLimit,
+            parsed - start, built - parsed, getTimeSeconds() - built);
+    }
+
+    if (vertices.data) {unmapFile(&vertices);}
+
+    // Whatever a failure left behind, every spill file number was handed out from nextFile
+    for (uint32_t file = 0; file < state.nextFile; file++) {removeSpill(&state, file);}
+
+    free(state.batch);
+    free(state.subtrees);
+    return ok;
+}
@@ -0,0 +1,595 @@
+#include "mesh_lod.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Open border edges get a perpendicular plane this many times heavier than faces
+#define LOD_BORDER_WEIGHT 100.0
+
+// Collapses that turn an adjacent face further than this (cos ~78 deg) are rejected
+#define LOD_MIN_NORMAL_DOT 0.2
+
+// Symmetric 4x4 plane quadric: a2 ab ac ad b2 bc bd c2 cd d2
+typedef struct
+{
+    double q[10];
+} Quadric;
+
+// Lazily invalidated: stale when either vertex moved since the push
+typedef struct
+{
+    double cost;
+    float position[3];
+    uint32_t a, b;
+    uint32_t stampA, stampB;
+} CollapseCandidate;
+
+typedef struct
+{
+    CollapseCandidate* items;
+    size_t count;
+    size_t capacity;
+} CollapseHeap;
+
+// Triangles around a vertex, may hold dead triangles until compacted
+typedef struct
+{
+    uint32_t* items;
+    uint32_t count;
+    uint32_t capacity;
+} TriangleList;
+
+typedef struct
+{
+    double (*positions)[3];
+    Quadric* quadrics;
+    uint32_t* stamps;
+    uint8_t* removed;
+    TriangleList* adjacency;
+
+    uint32_t* indices;
+    uint8_t* dead;
+    uint32_t triangleCount;
+    uint32_t aliveTriangles;
+
+    CollapseHeap heap;
+} LodState;
+
+static void addPlane(Quadric* quadric, const double* n, double d, double weight)
+{
+    double* q = quadric->q;
+
+    q[0] += weight * n[0] * n[0]; q[1] += weight * n[0] * n[1]; q[2] += weight * n[0] * n[2]; q[3] += weight * n[0] * d;
+    q[4] += weight * n[1] * n[1]; q[5] += weight * n[1] * n[2]; q[6] += weight * n[1] * d;
+    q[7] += weight * n[2] * n[2]; q[8] += weight * n[2] * d;
+    q[9] += weight * d * d;
+}
+
+static double quadricError(const Quadric* quadric, const double* p)
+{
+    const double* q = quadric->q;
+    double x = p[0], y = p[1], z = p[2];
+
+    return q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x
+        + q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y
+        + q[7] * z * z + 2.0 * q[8] * z
+        + q[9];
+}
+
+static void cross(const double* a, const double* b, double* out)
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static double dot(const double* a, const double* b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void faceNormal(const double* p0, const double* p1, const double* p2, double* n)
+{
+    double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    cross(e1, e2, n);
+}
+
+// Minimiser of the combined quadric when it is well conditioned, otherwise
+// the best of both ends and the midpoint
+static double collapseTarget(const LodState* state, uint32_t a, uint32_t b, double* out)
+{
+    Quadric q;
+    for (int i = 0; i < 10; i++) {q.q[i] = state->quadrics[a].q[i] + state->quadrics[b].q[i];}
+
+    const double* pa = state->positions[a];
+    const double* pb = state->positions[b];
+    double candidates[4][3];
+    int candidateCount = 0;
+
+    const double* m = q.q;
+    double det = m[0] * (m[4] * m[7] - m[5] * m[5]) - m[1] * (m[1] * m[7] - m[5] * m[2]) + m[2] * (m[1] * m[5] - m[4] * m[2]);
+    double scale = m[0] * m[4] * m[7];
+
+    if (fabs(det) > 1e-10 * fabs(scale) && det != 0.0)
+    {
+        double r[3] = {-m[3], -m[6], -m[8]};
+        double* p = candidates[candidateCount++];
+
+        // Cramer's rule on the symmetric 3x3 block
+        p[0] = (r[0] * (m[4] * m[7] - m[5] * m[5]) - m[1] * (r[1] * m[7] - m[5] * r[2]) + m[2] * (r[1] * m[5] - m[4] * r[2])) / det;
+        p[1] = (m[0] * (r[1] * m[7] - m[5] * r[2]) - r[0] * (m[1] * m[7] - m[5] * m[2]) + m[2] * (m[1] * r[2] - r[1] * m[2])) / det;
+        p[2] = (m[0] * (m[4] * r[2] - r[1] * m[5]) - m[1] * (m[1] * r[2] - r[1] * m[2]) + r[0] * (m[1] * m[5] - m[4] * m[2])) / det;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        candidates[candidateCount][i] = pa[i];
+        candidates[candidateCount + 1][i] = pb[i];
+        candidates[candidateCount + 2][i] = 0.5 * (pa[i] + pb[i]);
+    }
+    candidateCount += 3;
+
+    // Midpoint unless something beats it, also covers NaN errors
+    double best = INFINITY;
+    memcpy(out, candidates[candidateCount - 1], sizeof(double) * 3);
+
+    for (int c = 0; c < candidateCount; c++)
+    {
+        double error = quadricError(&q, candidates[c]);
+        if (error < best)
+        {
+            best = error;
+            memcpy(out, candidates[c], sizeof(double) * 3);
+        }
+    }
+
+    return best > 0.0 ? best : 0.0;
+}
+
+static int heapPush(CollapseHeap* heap, const CollapseCandidate* candidate)
+{
+    if (heap->count == heap->capacity)
+    {
+        size_t capacity = heap->capacity ? heap->capacity * 2 : 1024;
+        CollapseCandidate* items = realloc(heap->items, sizeof(CollapseCandidate) * capacity);
+        if (!items) {return 0;}
+
+        heap->items = items;
+        heap->capacity = capacity;
+    }
+
+    size_t i = heap->count++;
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (heap->items[parent].cost <= candidate->cost) {break;}
+
+        heap->items[i] = heap->items[parent];
+        i = parent;
+    }
+    heap->items[i] = *candidate;
+
+    return 1;
+}
+
+static CollapseCandidate heapPop(CollapseHeap* heap)
+{
+    CollapseCandidate top = heap->items[0];
+    CollapseCandidate last = heap->items[--heap->count];
+
+    size_t i = 0;
+    for (;;)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= heap->count) {break;}
+        if (child + 1 < heap->count && heap->items[child + 1].cost < heap->items[child].cost) {child++;}
+        if (last.cost <= heap->items[child].cost) {break;}
+
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->count > 0) {heap->items[i] = last;}
+
+    return top;
+}
+
+static int pushCandidate(LodState* state, uint32_t a, uint32_t b)
+{
+    CollapseCandidate candidate;
+    double target[3];
+
+    candidate.cost = collapseTarget(state, a, b, target);
+    candidate.position[0] = (float)target[0];
+    candidate.position[1] = (float)target[1];
+    candidate.position[2] = (float)target[2];
+    candidate.a = a;
+    candidate.b = b;
+    candidate.stampA = state->stamps[a];
+    candidate.stampB = state->stamps[b];
+
+    return heapPush(&state->heap, &candidate);
+}
+
+static int listAppend(TriangleList* list, uint32_t triangle)
+{
+    if (list->count == list->capacity)
+    {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 8;
+        uint32_t* items = realloc(list->items, sizeof(uint32_t) * capacity);
+        if (!items) {return 0;}
+
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    list->items[list->count++] = triangle;
+    return 1;
+}
+
+// Would moving a and b to p fold any surviving face over?
+static int collapseFlips(const LodState* state, uint32_t a, uint32_t b, const double* p)
+{
+    uint32_t ends[2] = {a, b};
+
+    for (int e = 0; e < 2; e++)
+    {
+        const TriangleList* list = &state->adjacency[ends[e]];
+
+        for (uint32_t i = 0; i < list->count; i++)
+        {
+            uint32_t t = list->items[i];
+            if (state->dead[t]) {continue;}
+
+            const uint32_t* tri = &state->indices[3 * t];
+            int hasA = tri[0] == a || tri[1] == a || tri[2] == a;
+            int hasB = tri[0] == b || tri[1] == b || tri[2] == b;
+
+            // Faces on the collapsed edge disappear
+            if (hasA && hasB) {continue;}
+
+            const double* before[3];
+            const double* after[3];
+            for (int c = 0; c < 3; c++)
+            {
+                before[c] = state->positions[tri[c]];
+                after[c] = (tri[c] == a || tri[c] == b) ? p : before[c];
+            }
+
+            double nBefore[3];
+            double nAfter[3];
+            faceNormal(before[0], before[1], before[2], nBefore);
+            faceNormal(after[0], after[1], after[2], nAfter);
+
+            double lengths = sqrt(dot(nBefore, nBefore) * dot(nAfter, nAfter));
+            if (lengths == 0.0 || dot(nBefore, nAfter) < LOD_MIN_NORMAL_DOT * lengths) {return 1;}
+        }
+    }
+
+    return 0;
+}
+
+// b merges into a, which moves to p
+static int collapseEdge(LodState* state, uint32_t a, uint32_t b, const double* p)
+{
+    memcpy(state->positions[a], p, sizeof(double) * 3);
+    for (int i = 0; i < 10; i++) {state->quadrics[a].q[i] += state->quadrics[b].q[i];}
+
+    TriangleList* listB = &state->adjacency[b];
+
+    for (uint32_t i = 0; i < listB->count; i++)
+    {
+        uint32_t t = listB->items[i];
+        if (state->dead[t]) {continue;}
+
+        uint32_t* tri = &state->indices[3 * t];
+
+        if (tri[0] == a || tri[1] == a || tri[2] == a)
+        {
+            state->dead[t] = 1;
+            state->aliveTriangles--;
+            continue;
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            if (tri[c] == b) {tri[c] = a;}
+        }
+        if (!listAppend(&state->adjacency[a], t)) {return 0;}
+    }
+
+    free(listB->items);
+    memset(listB, 0, sizeof(TriangleList));
+    state->removed[b] = 1;
+    state->stamps[a]++;
+
+    // Drop dead faces around a, then requeue every edge leaving it
+    TriangleList* listA = &state->adjacency[a];
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < listA->count; i++)
+    {
+        uint32_t t = listA->items[i];
+        if (!state->dead[t]) {listA->items[kept++] = t;}
+    }
+    listA->count = kept;
+
+    for (uint32_t i = 0; i < listA->count; i++)
+    {
+        const uint32_t* tri = &state->indices[3 * listA->items[i]];
+
+        for (int c = 0; c < 3; c++)
+        {
+            if (tri[c] != a && !pushCandidate(state, a, tri[c])) {return 0;}
+        }
+    }
+
+    return 1;
+}
+
+static int compareEdgeKeys(const void* x, const void* y)
+{
+    uint64_t a = *(const uint64_t*)x;
+    uint64_t b = *(const uint64_t*)y;
+
+    return (a > b) - (a < b);
+}
+
+// Face planes weighted by area, plus a perpendicular plane along every open
+// edge. Then every edge goes on the heap once, whatever its winding.
+static int initQuadrics(LodState* state)
+{
+    uint32_t triangleCount = state->triangleCount;
+
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        const uint32_t* tri = &state->indices[3 * t];
+        double n[3];
+        faceNormal(state->positions[tri[0]], state->positions[tri[1]], state->positions[tri[2]], n);
+
+        double length = sqrt(dot(n, n));
+        if (length == 0.0) {continue;}
+
+        for (int i = 0; i < 3; i++) {n[i] /= length;}
+        double d = -dot(n, state->positions[tri[0]]);
+
+        for (int c = 0; c < 3; c++) {addPlane(&state->quadrics[tri[c]], n, d, 0.5 * length);}
+    }
+
+    // Edge keys (min << 32 | max), an edge used by a single face is open
+    uint64_t* edges = malloc(sizeof(uint64_t) * triangleCount * 3);
+    if (!edges) {return 0;}
+
+    // Zero area faces were dropped already, their edges would hide open ones
+    size_t edgeCount = 0;
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        if (state->dead[t]) {continue;}
+
+        for (int c = 0; c < 3; c++)
+        {
+            uint32_t v0 = state->indices[3 * t + c];
+            uint32_t v1 = state->indices[3 * t + (c + 1) % 3];
+            uint64_t lo = v0 < v1 ? v0 : v1;
+            uint64_t hi = v0 < v1 ? v1 : v0;
+
+            edges[edgeCount++] = (lo << 32) | hi;
+        }
+    }
+
+    qsort(edges, edgeCount, sizeof(uint64_t), compareEdgeKeys);
+
+    for (size_t i = 0; i < edgeCount; )
+    {
+        size_t run = i + 1;
+        while (run < edgeCount && edges[run] == edges[i]) {run++;}
+
+        if (run - i == 1)
+        {
+            uint32_t v0 = (uint32_t)(edges[i] >> 32);
+            uint32_t v1 = (uint32_t)edges[i];
+
+            // Normal of the one face using this edge
+            const TriangleList* list = &state->adjacency[v0];
+            for (uint32_t k = 0; k < list->count; k++)
+            {
+                const uint32_t* tri = &state->indices[3 * list->items[k]];
+                if (tri[0] != v1 && tri[1] != v1 && tri[2] != v1) {continue;}
+
+                double n[3];
+                faceNormal(state->positions[tri[0]], state->positions[tri[1]], state->positions[tri[2]], n);
+
+                const double* p0 = state->positions[v0];
+                const double* p1 = state->positions[v1];
+                double edge[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+                double plane[3];
+                cross(edge, n, plane);
+
+                double length = sqrt(dot(plane, plane));
+                if (length > 0.0)
+                {
+                    for (int a = 0; a < 3; a++) {plane[a] /= length;}
+                    double d = -dot(plane, p0);
+                    double weight = LOD_BORDER_WEIGHT * dot(edge, edge);
+
+                    addPlane(&state->quadrics[v0], plane, d, weight);
+                    addPlane(&state->quadrics[v1], plane, d, weight);
+                }
+                break;
+            }
+        }
+
+        i = run;
+    }
+
+    // Costs need the finished quadrics, so a second pass over the unique keys
+    int ok = 1;
+    for (size_t i = 0; i < edgeCount && ok; i++)
+    {
+        if (i > 0 && edges[i] == edges[i - 1]) {continue;}
+        ok = pushCandidate(state, (uint32_t)(edges[i] >> 32), (uint32_t)edges[i]);
+    }
+
+    free(edges);
+    return ok;
+}
+
+static void freeLodState(LodState* state, uint32_t vertexCount)
+{
+    if (state->adjacency)
+    {
+        for (uint32_t v = 0; v < vertexCount; v++) {free(state->adjacency[v].items);}
+    }
+
+    free(state->positions);
+    free(state->quadrics);
+    free(state->stamps);
+    free(state->removed);
+    free(state->adjacency);
+    free(state->indices);
+    free(state->dead);
+    free(state->heap.items);
+}
+
+static int writeLod(const LodState* state, uint32_t vertexCount, MeshData* lod)
+{
+    memset(lod, 0, sizeof(MeshData));
+
+    uint32_t* remap = malloc(sizeof(uint32_t) * vertexCount);
+    if (!remap) {return 0;}
+    memset(remap, 0xFF, sizeof(uint32_t) * vertexCount);
+
+    uint32_t keptVertices = 0;
+    for (uint32_t t = 0; t < state->triangleCount; t++)
+    {
+        if (state->dead[t]) {continue;}
+
+        for (int c = 0; c < 3; c++)
+        {
+            uint32_t v = state->indices[3 * t + c];
+            if (remap[v] == 0xFFFFFFFFu) {remap[v] = keptVertices++;}
+        }
+    }
+
+    lod->vertices = malloc(sizeof(GPUPackedVertex) * (keptVertices ? keptVertices : 1));
+    lod->indices = malloc(sizeof(uint32_t) * 3 * (state->aliveTriangles ? state->aliveTriangles : 1));
+    if (!lod->vertices || !lod->indices)
+    {
+        free(remap);
+        freeMeshData(lod);
+        return 0;
+    }
+
+    for (int a = 0; a < 3; a++)
+    {
+        lod->minBounds[a] = INFINITY;
+        lod->maxBounds[a] = -INFINITY;
+    }
+
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        if (remap[v] == 0xFFFFFFFFu) {continue;}
+
+        GPUPackedVertex* out = &lod->vertices[remap[v]];
+        out->x = (float)state->positions[v][0];
+        out->y = (float)state->positions[v][1];
+        out->z = (float)state->positions[v][2];
+        out->padding = 1.0f;
+
+        const float p[3] = {out->x, out->y, out->z};
+        for (int a = 0; a < 3; a++)
+        {
+            if (p[a] < lod->minBounds[a]) {lod->minBounds[a] = p[a];}
+            if (p[a] > lod->maxBounds[a]) {lod->maxBounds[a] = p[a];}
+        }
+    }
+
+    uint32_t outTri = 0;
+    for (uint32_t t = 0; t < state->triangleCount; t++)
+    {
+        if (state->dead[t]) {continue;}
+
+        for (int c = 0; c < 3; c++) {lod->indices[3 * outTri + c] = remap[state->indices[3 * t + c]];}
+        outTri++;
+    }
+
+    lod->vertexCount = keptVertices;
+    lod->triangleCount = outTri;
+    lod->indexCount = outTri * 3;
+
+    free(remap);
+    return 1;
+}
+
+int simplifyMesh(const MeshData* source, MeshData* lod, uint32_t targetTriangles)
+{
+    uint32_t vertexCount = source->vertexCount;
+    uint32_t triangleCount = source->triangleCount;
+
+    LodState state;
+    memset(&state, 0, sizeof(LodState));
+
+    state.positions = malloc(sizeof(double) * 3 * vertexCount);
+    state.quadrics = calloc(vertexCount, sizeof(Quadric));
+    state.stamps = calloc(vertexCount, sizeof(uint32_t));
+    state.removed = calloc(vertexCount, 1);
+    state.adjacency = calloc(vertexCount, sizeof(TriangleList));
+    state.indices = malloc(sizeof(uint32_t) * 3 * triangleCount);
+    state.dead = calloc(triangleCount, 1);
+    state.triangleCount = triangleCount;
+    state.aliveTriangles = triangleCount;
+
+    int ok = state.positions && state.quadrics && state.stamps && state.removed && state.adjacency && state.indices && state.dead;
+
+    if (ok)
+    {
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            state.positions[v][0] = source->vertices[v].x;
+            state.positions[v][1] = source->vertices[v].y;
+            state.positions[v][2] = source->vertices[v].z;
+        }
+        memcpy(state.indices, source->indices, sizeof(uint32_t) * 3 * triangleCount);
+
+        for (uint32_t t = 0; t < triangleCount && ok; t++)
+        {
+            const uint32_t* tri = &state.indices[3 * t];
+
+            // Zero area input faces go first, they only cost memory
+            if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+            {
+                state.dead[t] = 1;
+                state.aliveTriangles--;
+                continue;
+            }
+
+            for (int c = 0; c < 3 && ok; c++) {ok = listAppend(&state.adjacency[tri[c]], t);}
+        }
+    }
+
+    ok = ok && initQuadrics(&state);
+
+    while (ok && state.aliveTriangles > targetTriangles && state.heap.count > 0)
+    {
+        CollapseCandidate candidate = heapPop(&state.heap);
+        uint32_t a = candidate.a;
+        uint32_t b = candidate.b;
+
+        if (state.removed[a] || state.removed[b]) {continue;}
+        if (state.stamps[a] != candidate.stampA || state.stamps[b] != candidate.stampB) {continue;}
+
+        double p[3] = {candidate.position[0], candidate.position[1], candidate.position[2]};
+        if (collapseFlips(&state, a, b, p)) {continue;}
+
+        ok = collapseEdge(&state, a, b, p);
+    }
+
+    ok = ok && writeLod(&state, vertexCount, lod);
+
+    if (!ok) {fprintf(stderr, "Memory allocation failed for mesh simplification\n");}
+
+    freeLodState(&state, vertexCount);
+    return ok;
+}
@@ -0,0 +1,282 @@
+#include "mesh_weld.h"
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#define WELD_EMPTY 0xFFFFFFFFu
+
+// Open addressing, one entry per kept vertex. Several kept vertices can
+// share a cell, lookups walk the probe chain until an empty slot.
+typedef struct
+{
+    int32_t cell[3];
+    uint32_t vertex;
+} WeldEntry;
+
+typedef struct
+{
+    WeldEntry* entries;
+    uint32_t mask;
+} WeldTable;
+
+static inline uint32_t hashCell(const int32_t* cell)
+{
+    uint32_t h = (uint32_t)cell[0] * 73856093u ^ (uint32_t)cell[1] * 19349663u ^ (uint32_t)cell[2] * 83492791u;
+    return h ^ (h >> 16);
+}
+
+// Exact mode keys on the float bits, -0 and +0 share a key
+static inline int32_t exactKey(float f)
+{
+    if (f == 0.0f) {return 0;}
+
+    int32_t bits;
+    memcpy(&bits, &f, sizeof(int32_t));
+    return bits;
+}
+
+static int withinTolerance(const GPUPackedVertex* a, const GPUPackedVertex* b, float tolerance)
+{
+    return fabsf(a->x - b->x) <= tolerance && fabsf(a->y - b->y) <= tolerance && fabsf(a->z - b->z) <= tolerance;
+}
+
+static uint32_t findInCell(const WeldTable* table, const int32_t* cell, const GPUPackedVertex* kept,
+    const GPUPackedVertex* v, float tolerance)
+{
+    for (uint32_t slot = hashCell(cell) & table->mask; ; slot = (slot + 1) & table->mask)
+    {
+        const WeldEntry* entry = &table->entries[slot];
+        if (entry->vertex == WELD_EMPTY) {return WELD_EMPTY;}
+
+        if (entry->cell[0] == cell[0] && entry->cell[1] == cell[1] && entry->cell[2] == cell[2] &&
+            withinTolerance(&kept[entry->vertex], v, tolerance))
+        {
+            return entry->vertex;
+        }
+    }
+}
+
+static void insertCell(WeldTable* table, const int32_t* cell, uint32_t vertex)
+{
+    uint32_t slot = hashCell(cell) & table->mask;
+    while (table->entries[slot].vertex != WELD_EMPTY) {slot = (slot + 1) & table->mask;}
+
+    memcpy(table->entries[slot].cell, cell, sizeof(int32_t) * 3);
+    table->entries[slot].vertex = vertex;
+}
+
+static int isDegenerate(const GPUPackedVertex* vertices, const uint32_t* tri)
+{
+    if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) {return 1;}
+
+    const GPUPackedVertex* a = &vertices[tri[0]];
+    const GPUPackedVertex* b = &vertices[tri[1]];
+    const GPUPackedVertex* c = &vertices[tri[2]];
+
+    float e1[3] = {b->x - a->x, b->y - a->y, b->z - a->z};
+    float e2[3] = {c->x - a->x, c->y - a->y, c->z - a->z};
+
+    float n[3] =
+    {
+        e1[1] * e2[2] - e1[2] * e2[1],
+        e1[2] * e2[0] - e1[0] * e2[2],
+        e1[0] * e2[1] - e1[1] * e2[0]
+    };
+
+    return n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f;
+}
+
+int weldMesh(MeshData* mesh, float tolerance)
+{
+    uint32_t vertexCount = mesh->vertexCount;
+    uint32_t triangleCount = mesh->triangleCount;
+    if (vertexCount == 0) {return 1;}
+
+    // Binary meshes are welded when converted, their arrays live in the mapping
+    if (mesh->mapping) {return 1;}
+
+    size_t bytesBefore = sizeof(GPUPackedVertex) * vertexCount + sizeof(uint32_t) * mesh->indexCount;
+
+    // Cells twice the tolerance wide, so the +-tolerance box around a vertex
+    // touches at most 2 cells per axis
+    float cellSize = 2.0f * tolerance;
+    int exact = !(tolerance > 0.0f);
+
+    uint32_t tableSize = 1024;
+    while (tableSize < vertexCount * 2u) {tableSize *= 2;}
+
+    WeldTable table;
+    table.entries = malloc(sizeof(WeldEntry) * tableSize);
+    table.mask = tableSize - 1;
+
+    uint32_t* remap = malloc(sizeof(uint32_t) * vertexCount);
+    GPUPackedVertex* kept = malloc(sizeof(GPUPackedVertex) * vertexCount);
+
+    if (!table.entries || !remap || !kept)
+    {
+        fprintf(stderr, "Memory allocation failed for vertex weld\n");
+        free(table.entries);
+        free(remap);
+        free(kept);
+        return 0;
+    }
+
+    memset(table.entries, 0xFF, sizeof(WeldEntry) * tableSize);
+
+    // First occurrence of every position becomes the kept vertex
+    uint32_t keptCount = 0;
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        const GPUPackedVertex* v = &mesh->vertices[i];
+        uint32_t match = WELD_EMPTY;
+        int32_t home[3];
+
+        if (exact)
+        {
+            home[0] = exactKey(v->x);
+            home[1] = exactKey(v->y);
+            home[2] = exactKey(v->z);
+            match = findInCell(&table, home, kept, v, 0.0f);
+        }
+        else
+        {
+            const float p[3] = {v->x, v->y, v->z};
+            int32_t lo[3];
+            int32_t hi[3];
+
+            for (int a = 0; a < 3; a++)
+            {
+                home[a] = (int32_t)floorf(p[a] / cellSize);
+                lo[a] = (int32_t)floorf((p[a] - tolerance) / cellSize);
+                hi[a] = (int32_t)floorf((p[a] + tolerance) / cellSize);
+            }
+
+            for (int32_t x = lo[0]; x <= hi[0] && match == WELD_EMPTY; x++)
+            {
+                for (int32_t y = lo[1]; y <= hi[1] && match == WELD_EMPTY; y++)
+                {
+                    for (int32_t z = lo[2]; z <= hi[2] && match == WELD_EMPTY; z++)
+                    {
+                        int32_t cell[3] = {x, y, z};
+                        match = findInCell(&table, cell, kept, v, tolerance);
+                    }
+                }
+            }
+        }
+
+        if (match == WELD_EMPTY)
+        {
+            match = keptCount++;
+            kept[match] = *v;
+            insertCell(&table, home, match);
+        }
+
+        remap[i] = match;
+    }
+
+    free(table.entries);
+
+    // Remap and compact the triangles, corner data moves with them
+    uint32_t* used = calloc(keptCount, sizeof(uint32_t));
+    if (!used)
+    {
+        fprintf(stderr, "Memory allocation failed for vertex weld\n");
+        free(remap);
+        free(kept);
+        return 0;
+    }
+
+    uint32_t outTri = 0;
+
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        uint32_t tri[3];
+        for (int c = 0; c < 3; c++) {tri[c] = remap[mesh->indices[3 * t + c]];}
+
+        if (isDegenerate(kept, tri)) {continue;}
+
+        for (int c = 0; c < 3; c++)
+        {
+            mesh->indices[3 * outTri + c] = tri[c];
+            used[tri[c]] = 1;
+
+            if (mesh->normalIndices) {mesh->normalIndices[3 * outTri + c] = mesh->normalIndices[3 * t + c];}
+        }
+
+        if (mesh->triangleMaterials) {mesh->triangleMaterials[outTri] = mesh->triangleMaterials[t];}
+
+        outTri++;
+    }
+
+    free(remap);
+
+    // Drop vertices only degenerate triangles used, keeping the original order
+    uint32_t finalCount = 0;
+    for (uint32_t i = 0; i < keptCount; i++)
+    {
+        used[i] = used[i] ? finalCount++ : WELD_EMPTY;
+    }
+
+    GPUPackedVertex* vertices = allocFirstTouch(sizeof(GPUPackedVertex) * (finalCount ? finalCount : 1));
+    if (!vertices)
+    {
+        fprintf(stderr, "Memory allocation failed for vertex weld\n");
+        free(used);
+        free(kept);
+        return 0;
+    }
+
+    mesh->minBounds[0] = mesh->minBounds[1] = mesh->minBounds[2] = FLT_MAX;
+    mesh->maxBounds[0] = mesh->maxBounds[1] = mesh->maxBounds[2] = -FLT_MAX;
+
+    for (uint32_t i = 0; i < keptCount; i++)
+    {
+        if (used[i] == WELD_EMPTY) {continue;}
+
+        GPUPackedVertex* v = &vertices[used[i]];
+        *v = kept[i];
+
+        const float p[3] = {v->x, v->y, v->z};
+        for (int a = 0; a < 3; a++)
+        {
+            if (p[a] < mesh->minBounds[a]) {mesh->minBounds[a] = p[a];}
+            if (p[a] > mesh->maxBounds[a]) {mesh->maxBounds[a] = p[a];}
+        }
+    }
+
+    for (uint32_t i = 0; i < outTri * 3; i++) {mesh->indices[i] = used[mesh->indices[i]];}
+
+    free(used);
+    free(kept);
+    free(mesh->vertices);
+
+    mesh->vertices = vertices;
+    mesh->vertexCount = finalCount;
+    mesh->triangleCount = outTri;
+    mesh->indexCount = outTri * 3;
+
+    // Give back the dropped triangles
+    if (mesh->indexCount > 0)
+    {
+        uint32_t* indices = realloc(mesh->indices, sizeof(uint32_t) * mesh->indexCount);
+        if (indices) {mesh->indices = indices;}
+
+        if (mesh->normalIndices)
+        {
+            uint32_t* normalIndices = realloc(mesh->normalIndices, sizeof(uint32_t) * mesh->indexCount);
+            if (normalIndices) {mesh->normalIndices = normalIndices;}
+        }
+    }
+
+    size_t bytesAfter = sizeof(GPUPackedVertex) * mesh->vertexCount + sizeof(uint32_t) * mesh->indexCount;
+
+    printf("Welded: %u -> %u vertices, %u -> %u triangles (%.2f -> %.2f MB)\n", vertexCount, mesh->vertexCount,
+        triangleCount, mesh->triangleCount, bytesBefore / (1024.0 * 1024.0), bytesAfter / (1024.0 * 1024.0));
+
+    return 1;
+}
@@ -1,166 +1,568 @@
 #include "obj_loader.h"
+#include "file_util.h"
+#include "mesh_file.h"
+#include "parse_util.h"
+#include "thread_pool.h"
+#include "timer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
 
+typedef struct
+{
+    GPUPackedVertex* data;
+    uint32_t count;
+    uint32_t capacity;
+} ObjVertexArray;
+
+typedef struct
+{
+    uint32_t* data;
+    uint32_t count;
+    uint32_t capacity;
+
+    // Positions in data holding a chunk local index from a negative
+    // reference, the chunk's base is added when stitching
+    uint32_t* relative;
+    uint32_t relativeCount;
+    uint32_t relativeCapacity;
+} ObjIndexArray;
+
+typedef struct
+{
+    ObjVertexArray positions;
+    ObjVertexArray normals;
+
+    ObjIndexArray positionIndices;
+
+    // Empty until the chunk's first vn reference, then one per position index
+    ObjIndexArray normalIndices;
+} ObjArrays;
+
+// One v/vt/vn face corner, normal 0 when absent
+typedef struct
+{
+    int64_t position;
+    int64_t normal;
+} ObjCorner;
+
+// Newline aligned slice of the file, parsed independently
+typedef struct
+{
+    const char* begin;
+    const char* end;
+
+    ObjArrays arrays;
+    float minBounds[3];
+    float maxBounds[3];
+
+    uint32_t vertexBase;
+    uint32_t normalBase;
+    uint32_t indexBase;
+    int ok;
+    int badIndex;
+} ObjChunk;
+
+typedef struct
+{
+    ObjChunk* chunks;
+    GPUPackedVertex* vertices;
+    GPUPackedVertex* normals;
+    uint32_t* indices;
+    uint32_t* normalIndices;
+    uint32_t vertexCount;
+    uint32_t normalCount;
+} ObjStitchJob;
+
+// Smallest slice worth handing to another worker
+#define OBJ_CHUNK_MIN_BYTES (1u << 20)
+
 void freeMeshData(MeshData* mesh)
 {
-    if (mesh->vertices) free(mesh->vertices);
-    if (mesh->indices) free(mesh->indices);
+    if (mesh->mapping)
+    {
+        releaseMappedFile(mesh->mapping);
+    }
+    else
+    {
+        if (mesh->vertices) free(mesh->vertices);
+        if (mesh->indices) free(mesh->indices);
+        if (mesh->normals) free(mesh->normals);
+        if (mesh->normalIndices) free(mesh->normalIndices);
+        if (mesh->bvhNodes) free(mesh->bvhNodes);
+        if (mesh->triangleMaterials) free(mesh->triangleMaterials);
+    }
 
     mesh->vertices = NULL;
     mesh->indices = NULL;
+    mesh->normals = NULL;
+    mesh->normalIndices = NULL;
+    mesh->bvhNodes = NULL;
+    mesh->triangleMaterials = NULL;
+    mesh->mapping = NULL;
     mesh->vertexCount = 0;
     mesh->indexCount = 0;
+    mesh->normalCount = 0;
+    mesh->bvhNodeCount = 0;
 }
 
-int loadObj(const char* filename, MeshData* mesh)
+static inline int isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static inline const char* skipToken(const char* p, const char* end)
 {
-    FILE* file = fopen(filename, "r");
+    while (p < end && !isBlank(*p) && *p != '\n' && *p != '\r') {p++;}
+    return p;
+}
+
+// Makes room for one more element
+static int growArray(void** data, uint32_t* capacity, uint32_t count, size_t elementSize, uint32_t initial)
+{
+    if (count < *capacity) {return 1;}
+
+    uint32_t grownCapacity = *capacity ? *capacity * 2 : initial;
+    void* grown = realloc(*data, elementSize * grownCapacity);
+    if (!grown) {return 0;}
+
+    *data = grown;
+    *capacity = grownCapacity;
+    return 1;
+}
+
+// Releases unused growth, the array is kept when shrinking fails
+static void* trimArray(void* data, uint32_t count, size_t elementSize)
+{
+    if (!data || count == 0) {return data;}
+
+    void* trimmed = realloc(data, elementSize * count);
+    return trimmed ? trimmed : data;
+}
+
+static int pushVertex(ObjVertexArray* array, const float* v, float w)
+{
+    if (!growArray((void**)&array->data, &array->capacity, array->count, sizeof(GPUPackedVertex), 4096)) {return 0;}
+
+    GPUPackedVertex* vertex = &array->data[array->count++];
+    vertex->x = v[0];
+    vertex->y = v[1];
+    vertex->z = v[2];
+    vertex->padding = w;
+
+    return 1;
+}
+
+static int pushRawIndex(ObjIndexArray* array, uint32_t value)
+{
+    if (!growArray((void**)&array->data, &array->capacity, array->count, sizeof(uint32_t), 3 * 8192)) {return 0;}
+
+    array->data[array->count++] = value;
+    return 1;
+}
+
+// reference is the OBJ value, elementCount the chunk's elements read so far
+static int pushIndex(ObjIndexArray* array, int64_t reference, uint32_t elementCount)
+{
+    if (reference > 0) {return pushRawIndex(array, (uint32_t)(reference - 1));}
+
+    if (!growArray((void**)&array->relative, &array->relativeCapacity, array->relativeCount, sizeof(uint32_t), 1024)) {return 0;}
 
-    if (!file)
+    // Local index, negative when it points into an earlier chunk. Index 0 is
+    // invalid in OBJ and is left pointing far past the end to fail validation.
+    int64_t local = reference < 0 ? (int64_t)elementCount + reference : 0x7FFFFFFF;
+
+    array->relative[array->relativeCount++] = array->count;
+    return pushRawIndex(array, (uint32_t)(int32_t)local);
+}
+
+static int pushCorner(ObjArrays* arrays, const ObjCorner* corner)
+{
+    if (!pushIndex(&arrays->positionIndices, corner->position, arrays->positions.count)) {return 0;}
+
+    ObjIndexArray* normalIndices = &arrays->normalIndices;
+
+    // Common case: no normals seen yet in this chunk
+    if (corner->normal == 0 && normalIndices->count == 0) {return 1;}
+
+    // First vn reference, earlier corners had none
+    while (normalIndices->count + 1 < arrays->positionIndices.count)
     {
-        fprintf(stderr, "Could not open OBJ file: %s\n", filename);
-        return 0;
+        if (!pushRawIndex(normalIndices, OBJ_NO_NORMAL)) {return 0;}
     }
 
-    // Init bounds
-    mesh->minBounds[0] = mesh->minBounds[1] = mesh->minBounds[2] = FLT_MAX;
-    mesh->maxBounds[0] = mesh->maxBounds[1] = mesh->maxBounds[2] = -FLT_MAX;
+    if (corner->normal == 0) {return pushRawIndex(normalIndices, OBJ_NO_NORMAL);}
+
+    return pushIndex(normalIndices, corner->normal, arrays->normals.count);
+}
+
+static void freeObjArrays(ObjArrays* arrays)
+{
+    free(arrays->positions.data);
+    free(arrays->normals.data);
+    free(arrays->positionIndices.data);
+    free(arrays->positionIndices.relative);
+    free(arrays->normalIndices.data);
+    free(arrays->normalIndices.relative);
+    memset(arrays, 0, sizeof(ObjArrays));
+}
+
+// v, v/vt, v//vn or v/vt/vn, returns p unchanged when there is no position
+static const char* parseCorner(const char* p, const char* end, ObjCorner* corner)
+{
+    const char* next = parseInt(p, end, &corner->position);
+    if (next == p) {return p;}
+
+    corner->normal = 0;
+
+    if (next < end && *next == '/')
+    {
+        int64_t texture;
+        next = parseInt(next + 1, end, &texture);
+
+        if (next < end && *next == '/') {next = parseInt(next + 1, end, &corner->normal);}
+    }
+
+    return next;
+}
 
-    uint32_t vCount = 0;
-    uint32_t tCount = 0;
-    char line[1024];
+static const char* parseVector(const char* p, const char* end, float* v)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        p = skipBlanks(p, end);
+        p = parseFloat(p, end, &v[a]);
+    }
 
-    // Count vertices and triangles
-    while (fgets(line, sizeof(line), file))
+    return p;
+}
+
+// One pass over the chunk, lines may be any length
+static int parseObj(ObjChunk* chunk)
+{
+    const char* p = chunk->begin;
+    const char* end = chunk->end;
+    ObjArrays* arrays = &chunk->arrays;
+
+    while (p < end)
     {
-        if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+        p = skipBlanks(p, end);
+
+        if (end - p > 1 && p[0] == 'v' && isBlank(p[1]))
         {
-            vCount++;
+            float v[3] = {0.0f, 0.0f, 0.0f};
+            p = parseVector(p + 2, end, v);
+
+            if (!pushVertex(&arrays->positions, v, 1.0f)) {return 0;}
+
+            // Update bounding box
+            for (int a = 0; a < 3; a++)
+            {
+                if (v[a] < chunk->minBounds[a]) {chunk->minBounds[a] = v[a];}
+                if (v[a] > chunk->maxBounds[a]) {chunk->maxBounds[a] = v[a];}
+            }
+        }
+        else if (end - p > 2 && p[0] == 'v' && p[1] == 'n' && isBlank(p[2]))
+        {
+            float n[3] = {0.0f, 0.0f, 0.0f};
+            p = parseVector(p + 3, end, n);
+
+            if (!pushVertex(&arrays->normals, n, 0.0f)) {return 0;}
         }
-        else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+        else if (end - p > 1 && p[0] == 'f' && isBlank(p[1]))
         {
-            int verticesInFace = 0;
-            char* p = line + 1;
+            // Fan around the first corner, streamed so polygons have no size limit
+            ObjCorner first = {0, 0};
+            ObjCorner previous = {0, 0};
+            int count = 0;
+            p++;
 
-            while (*p != '\0')
+            while (1)
             {
-                // Skip space before word
-                while (*p == ' ' || *p == '\t') p++;
+                p = skipBlanks(p, end);
+                if (p >= end || *p == '\n' || *p == '\r') {break;}
 
-                if (*p == '\0' || *p == '\n' || *p == '\r') break;
+                ObjCorner corner;
+                const char* token = p;
+                const char* next = parseCorner(token, end, &corner);
+                p = skipToken(next, end);
 
-                verticesInFace++;
+                if (next == token) {continue;}
 
-                while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
-            }
+                if (count == 0) {first = corner;}
+                else if (count >= 2)
+                {
+                    if (!pushCorner(arrays, &first) || !pushCorner(arrays, &previous) || !pushCorner(arrays, &corner)) {return 0;}
+                }
 
-            // 3 vertices -> 1 triangle
-            // 4 vertices -> 2 triangles
-            if (verticesInFace >= 3)
-            {
-                tCount += (verticesInFace - 2);
+                previous = corner;
+                count++;
             }
         }
+
+        // Rest of the line
+        const char* newline = memchr(p, '\n', (size_t)(end - p));
+        p = newline ? newline + 1 : end;
     }
 
-    mesh->vertexCount = vCount;
-    mesh->triangleCount = tCount;
-    mesh->indexCount = tCount * 3;
+    return 1;
+}
+
+static void parseChunkRange(void* context, size_t begin, size_t end, int worker)
+{
+    ObjChunk* chunks = context;
 
-    // Allocate memory
-    mesh->vertices = (GPUPackedVertex*)malloc(sizeof(GPUPackedVertex) * mesh->vertexCount);
-    mesh->indices = (uint32_t*)malloc(sizeof(uint32_t) * mesh->indexCount);
+    for (size_t i = begin; i < end; i++) {chunks[i].ok = parseObj(&chunks[i]);}
+}
+
+static void copyArray(void* destination, const void* source, uint32_t count, size_t elementSize)
+{
+    // A single chunk is stitched in place
+    if (destination != source && count > 0) {memcpy(destination, source, elementSize * count);}
+}
 
-    if (!mesh->vertices || !mesh->indices)
+// Adds the chunk base to negative references, then checks every index is in range
+static int resolveIndices(uint32_t* indices, const ObjIndexArray* array, uint32_t base, uint32_t limit, int allowMissing)
+{
+    for (uint32_t r = 0; r < array->relativeCount; r++)
     {
-        fprintf(stderr, "Memory allocation failed for OBJ: %s\n", filename);
-        fclose(file);
+        uint32_t i = array->relative[r];
+        indices[i] = (uint32_t)((int64_t)base + (int32_t)indices[i]);
+    }
+
+    for (uint32_t i = 0; i < array->count; i++)
+    {
+        if (indices[i] >= limit && !(allowMissing && indices[i] == OBJ_NO_NORMAL)) {return 0;}
+    }
+
+    return 1;
+}
+
+// Copies a chunk to its prefix sum offsets and resolves its negative references
+static void stitchChunkRange(void* context, size_t begin, size_t end, int worker)
+{
+    ObjStitchJob* job = context;
+
+    for (size_t c = begin; c < end; c++)
+    {
+        ObjChunk* chunk = &job->chunks[c];
+        ObjArrays* arrays = &chunk->arrays;
+
+        if (arrays->positions.count > 0)
+        {
+            copyArray(job->vertices + chunk->vertexBase, arrays->positions.data, arrays->positions.count, sizeof(GPUPackedVertex));
+        }
+        if (arrays->normals.count > 0)
+        {
+            copyArray(job->normals + chunk->normalBase, arrays->normals.data, arrays->normals.count, sizeof(GPUPackedVertex));
+        }
+
+        uint32_t indexCount = arrays->positionIndices.count;
+        if (indexCount == 0) {continue;}
+
+        uint32_t* indices = job->indices + chunk->indexBase;
+        copyArray(indices, arrays->positionIndices.data, indexCount, sizeof(uint32_t));
+
+        if (!resolveIndices(indices, &arrays->positionIndices, chunk->vertexBase, job->vertexCount, 0)) {chunk->badIndex = 1;}
+
+        if (!job->normalIndices) {continue;}
+
+        uint32_t* normalIndices = job->normalIndices + chunk->indexBase;
+
+        if (arrays->normalIndices.count == 0)
+        {
+            for (uint32_t i = 0; i < indexCount; i++) {normalIndices[i] = OBJ_NO_NORMAL;}
+        }
+        else
+        {
+            copyArray(normalIndices, arrays->normalIndices.data, indexCount, sizeof(uint32_t));
+
+            if (!resolveIndices(normalIndices, &arrays->normalIndices, chunk->normalBase, job->normalCount, 1)) {chunk->badIndex = 1;}
+        }
+    }
+}
+
+int loadObj(const char* filename, MeshData* mesh)
+{
+    double start = getTimeSeconds();
+
+    MappedFile file;
+    if (!mapFile(filename, &file))
+    {
+        fprintf(stderr, "Could not open OBJ file: %s\n", filename);
         return 0;
     }
 
-    // Parse data
-    rewind(file);
+    // Preprocessed binary mesh, no parsing needed
+    if (isMeshFile(&file))
+    {
+        size_t size = file.size;
+        if (!loadMeshFile(filename, &file, mesh)) {return 0;}
+
+        printf("\nMapped %s: %u vertices, %u triangles (%.1f MB)\n", filename, mesh->vertexCount, mesh->triangleCount,
+            size / (1024.0 * 1024.0));
+        return 1;
+    }
+
+    // A few chunks per worker evens out dense and sparse regions of the file
+    size_t chunkCount = (size_t)threadPoolSize() * 4;
+    if (file.size / chunkCount < OBJ_CHUNK_MIN_BYTES) {chunkCount = file.size / OBJ_CHUNK_MIN_BYTES;}
+    if (chunkCount < 1 || threadPoolSize() == 1) {chunkCount = 1;}
+
+    ObjChunk* chunks = calloc(chunkCount, sizeof(ObjChunk));
+    if (!chunks)
+    {
+        fprintf(stderr, "Memory allocation failed for OBJ: %s\n", filename);
+        unmapFile(&file);
+        return 0;
+    }
 
-    uint32_t vPtr = 0;
-    uint32_t iPtr = 0;
+    // Cut points moved forward past the next newline
+    const char* fileEnd = file.data + file.size;
+    const char* cursor = file.data;
 
-    while (fgets(line, sizeof(line), file))
+    for (size_t i = 0; i < chunkCount; i++)
     {
-        // Parse vertex
-        if (line[0] == 'v' && line[1] == ' ')
+        const char* cut = (i + 1 == chunkCount) ? fileEnd : file.data + file.size / chunkCount * (i + 1);
+        if (cut < cursor) {cut = cursor;}
+
+        if (cut < fileEnd)
         {
-            float x, y, z;
-            sscanf(line, "v %f %f %f", &x, &y, &z);
+            const char* newline = memchr(cut, '\n', (size_t)(fileEnd - cut));
+            cut = newline ? newline + 1 : fileEnd;
+        }
 
-            mesh->vertices[vPtr].x = x;
-            mesh->vertices[vPtr].y = y;
-            mesh->vertices[vPtr].z = z;
-            mesh->vertices[vPtr].padding = 1.0f;
+        chunks[i].begin = cursor;
+        chunks[i].end = cut;
 
-            // Update bounding box
-            if (x < mesh->minBounds[0]) {mesh->minBounds[0] = x;}
-            if (y < mesh->minBounds[1]) {mesh->minBounds[1] = y;}
-            if (z < mesh->minBounds[2]) {mesh->minBounds[2] = z;}
-
-            if (x > mesh->maxBounds[0]) {mesh->maxBounds[0] = x;}
-            if (y > mesh->maxBounds[1]) {mesh->maxBounds[1] = y;}
-            if (z > mesh->maxBounds[2]) {mesh->maxBounds[2] = z;}    
-            
-            vPtr++;
+        for (int a = 0; a < 3; a++)
+        {
+            chunks[i].minBounds[a] = FLT_MAX;
+            chunks[i].maxBounds[a] = -FLT_MAX;
         }
 
-        // Parse face
-        else if (line[0] == 'f' && line[1] == ' ')
+        cursor = cut;
+    }
+
+    parallelFor(chunkCount, 1, parseChunkRange, chunks);
+
+    // Prefix sums give each chunk its place in the final arrays
+    int ok = 1;
+    int hasNormalIndices = 0;
+    uint32_t vertexCount = 0;
+    uint32_t normalCount = 0;
+    uint32_t indexCount = 0;
+
+    // Init bounds
+    mesh->minBounds[0] = mesh->minBounds[1] = mesh->minBounds[2] = FLT_MAX;
+    mesh->maxBounds[0] = mesh->maxBounds[1] = mesh->maxBounds[2] = -FLT_MAX;
+
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        ObjArrays* arrays = &chunks[i].arrays;
+        ok &= chunks[i].ok;
+
+        chunks[i].vertexBase = vertexCount;
+        chunks[i].normalBase = normalCount;
+        chunks[i].indexBase = indexCount;
+        vertexCount += arrays->positions.count;
+        normalCount += arrays->normals.count;
+        indexCount += arrays->positionIndices.count;
+        hasNormalIndices |= (arrays->normalIndices.count > 0);
+
+        for (int a = 0; a < 3; a++)
         {
-            unsigned int v[4];
-            int count = 0;
+            if (chunks[i].minBounds[a] < mesh->minBounds[a]) {mesh->minBounds[a] = chunks[i].minBounds[a];}
+            if (chunks[i].maxBounds[a] > mesh->maxBounds[a]) {mesh->maxBounds[a] = chunks[i].maxBounds[a];}
+        }
+    }
 
-            char* p = line + 1;
-            
-            while (count < 4)
-            {
-                // 1. Skip leading whitespace
-                while (*p == ' ' || *p == '\t') {p++;}
-                if (*p == '\0' || *p == '\n' || *p == '\r') {break;}
+    ObjStitchJob job = {chunks, NULL, NULL, NULL, NULL, vertexCount, normalCount};
 
-                char* endPtr;
-                v[count] = (unsigned int)strtoul(p, &endPtr, 10);
+    if (ok && chunkCount == 1)
+    {
+        // Stitched in place, only the unused growth is given back
+        ObjArrays* arrays = &chunks[0].arrays;
 
-                if (endPtr == p) 
-                {
-                    p++;
-                    continue; 
-                }
+        job.vertices = trimArray(arrays->positions.data, vertexCount, sizeof(GPUPackedVertex));
+        job.normals = trimArray(arrays->normals.data, normalCount, sizeof(GPUPackedVertex));
+        job.indices = trimArray(arrays->positionIndices.data, indexCount, sizeof(uint32_t));
+        job.normalIndices = trimArray(arrays->normalIndices.data, indexCount, sizeof(uint32_t));
 
-                count++;
-                p = endPtr; 
+        arrays->positions.data = job.vertices;
+        arrays->normals.data = job.normals;
+        arrays->positionIndices.data = job.indices;
+        arrays->normalIndices.data = job.normalIndices;
 
-                while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {p++;}
-            }
+        stitchChunkRange(&job, 0, 1, 0);
 
-            if (count >= 3)
-            {
-                // First triangle
-                mesh->indices[iPtr++] = v[0] - 1;
-                mesh->indices[iPtr++] = v[1] - 1;
-                mesh->indices[iPtr++] = v[2] - 1;
+        // Now owned by the mesh
+        arrays->positions.data = NULL;
+        arrays->normals.data = NULL;
+        arrays->positionIndices.data = NULL;
+        arrays->normalIndices.data = NULL;
+    }
+    else if (ok)
+    {
+        job.vertices = allocFirstTouch(sizeof(GPUPackedVertex) * vertexCount);
+        job.indices = allocFirstTouch(sizeof(uint32_t) * indexCount);
+        if (normalCount > 0) {job.normals = allocFirstTouch(sizeof(GPUPackedVertex) * normalCount);}
+        if (hasNormalIndices) {job.normalIndices = allocFirstTouch(sizeof(uint32_t) * indexCount);}
 
-                if (count == 4)
-                {
-                    // Second triangle (if quad)
-                    mesh->indices[iPtr++] = v[0] - 1;
-                    mesh->indices[iPtr++] = v[2] - 1;
-                    mesh->indices[iPtr++] = v[3] - 1;
-                }
-            }
+        if ((!job.vertices && vertexCount) || (!job.indices && indexCount) ||
+            (!job.normals && normalCount) || (!job.normalIndices && hasNormalIndices && indexCount))
+        {
+            ok = 0;
+        }
+        else
+        {
+            parallelFor(chunkCount, 1, stitchChunkRange, &job);
         }
     }
 
-    fclose(file);
-    printf("\nLoaded %s: %d vertices, %d triangles\n", filename, mesh->vertexCount, mesh->triangleCount);
+    if (!ok) {fprintf(stderr, "Memory allocation failed for OBJ: %s\n", filename);}
+
+    int badIndex = 0;
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        badIndex |= chunks[i].badIndex;
+        freeObjArrays(&chunks[i].arrays);
+    }
+
+    size_t fileSize = file.size;
+    free(chunks);
+    unmapFile(&file);
+
+    if (ok && badIndex)
+    {
+        fprintf(stderr, "Face references a missing vertex or normal in OBJ: %s\n", filename);
+        ok = 0;
+    }
+
+    if (!ok)
+    {
+        free(job.vertices);
+        free(job.normals);
+        free(job.indices);
+        free(job.normalIndices);
+        return 0;
+    }
+
+    mesh->normals = job.normals;
+    mesh->normalIndices = job.normalIndices;
+    mesh->normalCount = normalCount;
+    mesh->vertices = job.vertices;
+    mesh->indices = job.indices;
+    mesh->vertexCount = vertexCount;
+    mesh->indexCount = indexCount;
+    mesh->triangleCount = indexCount / 3;
+
+    double seconds = getTimeSeconds() - start;
+    double megabytes = fileSize / (1024.0 * 1024.0);
+
+    printf("\nLoaded %s: %d vertices, %d triangles (%.1f MB in %.1f ms, %.1f MB/s, %d chunks)\n", filename,
+        mesh->vertexCount, mesh->triangleCount, megabytes, seconds * 1000.0, megabytes / (seconds > 0.0 ? seconds : 1e-9), (int)chunkCount);
     return 1;
 }
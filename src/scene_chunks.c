@@ -0,0 +1,510 @@
+#include "scene_chunks.h"
+#include "mesh_file.h"
+#include "thread_pool.h"
+#include "triangle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Cell counts above this mean the cell size is far too small for the scene
+#define MAX_CHUNK_GRID (1 << 22)
+
+// Same layout uploadGeometry produces for float vertices
+static size_t chunkGpuBytes(const MeshData* mesh, const BVH* bvh)
+{
+    size_t perTriangle = sizeof(uint32_t) * 3 + sizeof(uint32_t) * 2;
+#if WATERTIGHT_TRIANGLES
+    perTriangle += sizeof(PrecomputedTriangle);
+#endif
+
+    return sizeof(GPUPackedVertex) * mesh->vertexCount + perTriangle * mesh->triangleCount + sizeof(BVHNode) * bvh->nodeCount;
+}
+
+static int compareUint32(const void* a, const void* b)
+{
+    uint32_t ua = *(const uint32_t*)a;
+    uint32_t ub = *(const uint32_t*)b;
+
+    return (ua > ub) - (ua < ub);
+}
+
+// Copies the listed triangles of world with their own vertex numbering
+static int extractChunkMesh(const MeshData* world, const uint32_t* triangles, uint32_t count, MeshData* mesh)
+{
+    memset(mesh, 0, sizeof(MeshData));
+
+    // Sorted unique corners are the new vertex order, a corner's new index is its rank
+    uint32_t* used = malloc(sizeof(uint32_t) * 3 * (size_t)count);
+    if (!used) {return 0;}
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memcpy(&used[3 * (size_t)i], &world->indices[3 * (size_t)triangles[i]], sizeof(uint32_t) * 3);
+    }
+    qsort(used, 3 * (size_t)count, sizeof(uint32_t), compareUint32);
+
+    uint32_t unique = 0;
+    for (size_t i = 0; i < 3 * (size_t)count; i++)
+    {
+        if (unique == 0 || used[i] != used[unique - 1]) {used[unique++] = used[i];}
+    }
+
+    mesh->vertices = malloc(sizeof(GPUPackedVertex) * unique);
+    mesh->indices = malloc(sizeof(uint32_t) * 3 * (size_t)count);
+    mesh->triangleMaterials = malloc(sizeof(uint32_t) * count);
+    if (!mesh->vertices || !mesh->indices || !mesh->triangleMaterials)
+    {
+        free(used);
+        freeMeshData(mesh);
+        return 0;
+    }
+
+    for (int a = 0; a < 3; a++)
+    {
+        mesh->minBounds[a] = INFINITY;
+        mesh->maxBounds[a] = -INFINITY;
+    }
+
+    for (uint32_t v = 0; v < unique; v++)
+    {
+        const GPUPackedVertex* p = &world->vertices[used[v]];
+        mesh->vertices[v] = *p;
+
+        float position[3] = {p->x, p->y, p->z};
+        for (int a = 0; a < 3; a++)
+        {
+            mesh->minBounds[a] = fminf(mesh->minBounds[a], position[a]);
+            mesh->maxBounds[a] = fmaxf(mesh->maxBounds[a], position[a]);
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            const uint32_t* rank = bsearch(&world->indices[3 * (size_t)triangles[i] + k], used, unique, sizeof(uint32_t), compareUint32);
+            mesh->indices[3 * (size_t)i + k] = (uint32_t)(rank - used);
+        }
+        mesh->triangleMaterials[i] = world->triangleMaterials[triangles[i]];
+    }
+
+    mesh->vertexCount = unique;
+    mesh->indexCount = 3 * count;
+    mesh->triangleCount = count;
+
+    free(used);
+    return 1;
+}
+
+typedef struct
+{
+    SceneChunks* chunks;
+    const MeshData* world;
+    const uint32_t* cellTriangles;  // Triangles grouped by chunk
+    const uint32_t* cellFirst;      // Start of chunk i in cellTriangles
+    size_t* workerNodes;            // BVH nodes built per worker, cached cells are freed before the summary
+    int failed;
+} ChunkBuildJob;
+
+static void buildChunkRange(void* context, size_t begin, size_t end, int worker)
+{
+    ChunkBuildJob* job = context;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        SceneChunk* chunk = &job->chunks->chunks[i];
+
+        if (!extractChunkMesh(job->world, &job->cellTriangles[job->cellFirst[i]], chunk->triangleCount, &chunk->mesh))
+        {
+            job->failed = 1;
+            continue;
+        }
+
+        // Quiet build, the reports would interleave across workers
+        if (!buildBVHNodes(&chunk->bvh, &chunk->mesh, allocFirstTouch))
+        {
+            job->failed = 1;
+            continue;
+        }
+        job->workerNodes[worker] += chunk->bvh.nodeCount;
+
+        memcpy(chunk->minBounds, chunk->mesh.minBounds, sizeof(chunk->minBounds));
+        memcpy(chunk->maxBounds, chunk->mesh.maxBounds, sizeof(chunk->maxBounds));
+        chunk->gpuBytes = chunkGpuBytes(&chunk->mesh, &chunk->bvh);
+
+        if (!chunk->cachePath) {continue;}
+
+        // The file carries the tree, reloading the cell skips the build
+        chunk->mesh.bvhNodes = chunk->bvh.nodes;
+        chunk->mesh.bvhNodeCount = chunk->bvh.nodeCount;
+        int written = writeMeshFile(chunk->cachePath, &chunk->mesh);
+        chunk->mesh.bvhNodes = NULL;
+        chunk->mesh.bvhNodeCount = 0;
+
+        if (!written)
+        {
+            free(chunk->cachePath);
+            chunk->cachePath = NULL;
+            continue;
+        }
+
+        freeMeshData(&chunk->mesh);
+        free(chunk->bvh.nodes);
+        memset(&chunk->bvh, 0, sizeof(BVH));
+    }
+}
+
+int buildSceneChunks(SceneChunks* chunks, const MeshData* world, float cellSize, size_t budget, const char* cacheDir)
+{
+    memset(chunks, 0, sizeof(SceneChunks));
+    chunks->cellSize = cellSize;
+    chunks->budget = budget;
+
+    if (world->triangleCount == 0 || !(cellSize > 0.0f)) {return 0;}
+
+    // Cells are counted from the lowest occupied one, coordinates stay absolute
+    int* cellOf = malloc(sizeof(int) * 2 * (size_t)world->triangleCount);
+    if (!cellOf) {return 0;}
+
+    int minCell[2] = {INT32_MAX, INT32_MAX};
+    int maxCell[2] = {INT32_MIN, INT32_MIN};
+
+    for (uint32_t t = 0; t < world->triangleCount; t++)
+    {
+        const GPUPackedVertex* v0 = &world->vertices[world->indices[3 * (size_t)t]];
+        const GPUPackedVertex* v1 = &world->vertices[world->indices[3 * (size_t)t + 1]];
+        const GPUPackedVertex* v2 = &world->vertices[world->indices[3 * (size_t)t + 2]];
+
+        float centroid[2] = {(v0->x + v1->x + v2->x) / 3.0f, (v0->z + v1->z + v2->z) / 3.0f};
+        for (int a = 0; a < 2; a++)
+        {
+            double cell = floor((double)centroid[a] / cellSize);
+            int clamped = cell < INT32_MIN / 2 ? INT32_MIN / 2 : cell > INT32_MAX / 2 ? INT32_MAX / 2 : (int)cell;
+
+            cellOf[2 * (size_t)t + a] = clamped;
+            if (clamped < minCell[a]) {minCell[a] = clamped;}
+            if (clamped > maxCell[a]) {maxCell[a] = clamped;}
+        }
+    }
+
+    int64_t gridX = (int64_t)maxCell[0] - minCell[0] + 1;
+    int64_t gridZ = (int64_t)maxCell[1] - minCell[1] + 1;
+    if (gridX * gridZ > MAX_CHUNK_GRID)
+    {
+        fprintf(stderr, "Chunk size %g makes a %lld x %lld grid, use larger cells\n", cellSize, (long long)gridX, (long long)gridZ);
+        free(cellOf);
+        return 0;
+    }
+
+    // Counting sort of the triangles by grid cell
+    uint32_t* cellStart = calloc((size_t)(gridX * gridZ) + 1, sizeof(uint32_t));
+    uint32_t* cellTriangles = malloc(sizeof(uint32_t) * world->triangleCount);
+    int ok = cellStart && cellTriangles;
+
+    for (uint32_t t = 0; ok && t < world->triangleCount; t++)
+    {
+        int64_t cell = (cellOf[2 * (size_t)t] - minCell[0]) + (int64_t)(cellOf[2 * (size_t)t + 1] - minCell[1]) * gridX;
+        cellStart[cell + 1]++;
+    }
+
+    for (int64_t c = 0; ok && c < gridX * gridZ; c++)
+    {
+        if (cellStart[c + 1] > 0) {chunks->chunkCount++;}
+        cellStart[c + 1] += cellStart[c];
+    }
+
+    chunks->chunks = ok ? calloc(chunks->chunkCount, sizeof(SceneChunk)) : NULL;
+    uint32_t* cellFirst = ok ? malloc(sizeof(uint32_t) * chunks->chunkCount) : NULL;
+    size_t* workerNodes = calloc((size_t)threadPoolSize(), sizeof(size_t));
+    size_t totalNodes = 0;
+    ok = ok && chunks->chunks && cellFirst && workerNodes;
+
+    if (ok)
+    {
+        int chunk = 0;
+        for (int64_t c = 0; c < gridX * gridZ; c++)
+        {
+            uint32_t count = cellStart[c + 1] - cellStart[c];
+            if (count == 0) {continue;}
+
+            SceneChunk* target = &chunks->chunks[chunk];
+            target->cellX = minCell[0] + (int)(c % gridX);
+            target->cellZ = minCell[1] + (int)(c / gridX);
+            target->triangleCount = count;
+            cellFirst[chunk++] = cellStart[c];
+
+            if (cacheDir)
+            {
+                char path[512];
+                snprintf(path, sizeof(path), "%s/cell_%d_%d.gltm", cacheDir, target->cellX, target->cellZ);
+                target->cachePath = strdup(path);
+            }
+        }
+
+        // Fills every cell from its start, ends up one cell further
+        for (uint32_t t = 0; t < world->triangleCount; t++)
+        {
+            int64_t cell = (cellOf[2 * (size_t)t] - minCell[0]) + (int64_t)(cellOf[2 * (size_t)t + 1] - minCell[1]) * gridX;
+            cellTriangles[cellStart[cell]++] = t;
+        }
+
+        ChunkBuildJob job = {chunks, world, cellTriangles, cellFirst, workerNodes, 0};
+        parallelFor((size_t)chunks->chunkCount, 1, buildChunkRange, &job);
+        ok = !job.failed;
+        for (int w = 0; w < threadPoolSize(); w++) {totalNodes += workerNodes[w];}
+    }
+
+    free(cellOf);
+    free(cellStart);
+    free(cellTriangles);
+    free(cellFirst);
+    free(workerNodes);
+
+    if (!ok)
+    {
+        fprintf(stderr, "Failed to split the scene into chunks\n");
+        freeSceneChunks(chunks);
+        return 0;
+    }
+
+    size_t totalBytes = 0;
+    for (int i = 0; i < chunks->chunkCount; i++) {totalBytes += chunks->chunks[i].gpuBytes;}
+
+    printf("Chunks: %d cells of %g units, %zu BVH nodes, %.1f MB in all, budget %.1f MB\n", chunks->chunkCount, cellSize,
+        totalNodes, totalBytes / (1024.0 * 1024.0), budget / (1024.0 * 1024.0));
+
+    return 1;
+}
+
+typedef struct
+{
+    float distance;
+    int chunk;
+} ChunkDistance;
+
+static int compareChunkDistances(const void* a, const void* b)
+{
+    float da = ((const ChunkDistance*)a)->distance;
+    float db = ((const ChunkDistance*)b)->distance;
+
+    return (da > db) - (da < db);
+}
+
+// Squared distance from p to the cell's box, 0 inside
+static float chunkDistance(const SceneChunk* chunk, const float* p)
+{
+    float distance = 0.0f;
+    for (int a = 0; a < 3; a++)
+    {
+        float d = fmaxf(fmaxf(chunk->minBounds[a] - p[a], p[a] - chunk->maxBounds[a]), 0.0f);
+        distance += d * d;
+    }
+    return distance;
+}
+
+static int loadChunk(SceneChunk* chunk)
+{
+    if (chunk->bvh.nodes) {return 1;}
+
+    // Maps the cache file and copies its stored tree, quietly since cells load
+    // and evict as the camera moves and the residency summary says enough
+    MappedFile file;
+    if (!mapFile(chunk->cachePath, &file)) {return 0;}
+    if (!isMeshFile(&file))
+    {
+        unmapFile(&file);
+        return 0;
+    }
+    if (!loadMeshFile(chunk->cachePath, &file, &chunk->mesh)) {return 0;}
+
+    if (!buildBVHNodes(&chunk->bvh, &chunk->mesh, allocFirstTouch))
+    {
+        freeMeshData(&chunk->mesh);
+        return 0;
+    }
+
+    return 1;
+}
+
+static void evictChunk(SceneChunk* chunk)
+{
+    if (!chunk->cachePath) {return;}
+
+    freeMeshData(&chunk->mesh);
+    free(chunk->bvh.nodes);
+    memset(&chunk->bvh, 0, sizeof(BVH));
+}
+
+int updateChunkResidency(SceneChunks* chunks, const float* camera)
+{
+    if (chunks->chunkCount == 0) {return 0;}
+
+    if (chunks->placed)
+    {
+        float moved = 0.0f;
+        for (int a = 0; a < 3; a++) {moved += (camera[a] - chunks->lastCamera[a]) * (camera[a] - chunks->lastCamera[a]);}
+
+        float threshold = 0.25f * chunks->cellSize;
+        if (moved < threshold * threshold) {return 0;}
+    }
+
+    memcpy(chunks->lastCamera, camera, sizeof(chunks->lastCamera));
+    chunks->placed = 1;
+
+    ChunkDistance* order = malloc(sizeof(ChunkDistance) * chunks->chunkCount);
+    if (!order) {return 0;}
+
+    for (int i = 0; i < chunks->chunkCount; i++)
+    {
+        order[i].distance = chunkDistance(&chunks->chunks[i], camera);
+        order[i].chunk = i;
+    }
+    qsort(order, chunks->chunkCount, sizeof(ChunkDistance), compareChunkDistances);
+
+    // Nearest first without gaps, admission stops at the first cell over the
+    // budget so a far small cell never takes the place of a nearer one
+    int changed = 0;
+    size_t used = 0;
+    int count = 0;
+    int full = 0;
+
+    for (int i = 0; i < chunks->chunkCount; i++)
+    {
+        SceneChunk* chunk = &chunks->chunks[order[i].chunk];
+        full = full || (count > 0 && used + chunk->gpuBytes > chunks->budget);
+        int wanted = !full;
+
+        if (wanted && !chunk->resident)
+        {
+            if (!loadChunk(chunk))
+            {
+                fprintf(stderr, "Failed to load chunk %d %d from %s\n", chunk->cellX, chunk->cellZ, chunk->cachePath);
+                continue;
+            }
+            chunk->resident = 1;
+            changed = 1;
+        }
+        else if (!wanted && chunk->resident)
+        {
+            evictChunk(chunk);
+            chunk->resident = 0;
+            changed = 1;
+        }
+
+        if (chunk->resident)
+        {
+            used += chunk->gpuBytes;
+            count++;
+        }
+    }
+
+    free(order);
+
+    chunks->residentBytes = used;
+    chunks->residentCount = count;
+
+    if (changed)
+    {
+        printf("Chunks: %d of %d cells resident, %.1f MB\n", count, chunks->chunkCount, used / (1024.0 * 1024.0));
+    }
+
+    return changed;
+}
+
+int buildResidentMesh(const SceneChunks* chunks, MeshData* mesh, BVH* bvh)
+{
+    memset(mesh, 0, sizeof(MeshData));
+    memset(bvh, 0, sizeof(BVH));
+
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
+    for (int i = 0; i < chunks->chunkCount; i++)
+    {
+        const SceneChunk* chunk = &chunks->chunks[i];
+        if (!chunk->resident) {continue;}
+
+        vertexCount += chunk->mesh.vertexCount;
+        triangleCount += chunk->mesh.triangleCount;
+    }
+
+    if (chunks->residentCount == 0 || vertexCount > UINT32_MAX || triangleCount * 3 > UINT32_MAX) {return 0;}
+
+    mesh->vertices = allocFirstTouch(sizeof(GPUPackedVertex) * vertexCount);
+    mesh->indices = allocFirstTouch(sizeof(uint32_t) * 3 * triangleCount);
+    mesh->triangleMaterials = allocFirstTouch(sizeof(uint32_t) * triangleCount);
+
+    BVH* trees = calloc(chunks->residentCount, sizeof(BVH));
+    uint32_t* triangleBases = calloc(chunks->residentCount, sizeof(uint32_t));
+    int ok = mesh->vertices && mesh->indices && mesh->triangleMaterials && trees && triangleBases;
+
+    uint32_t vertexBase = 0;
+    uint32_t triangleBase = 0;
+    int tree = 0;
+
+    for (int a = 0; a < 3; a++)
+    {
+        mesh->minBounds[a] = INFINITY;
+        mesh->maxBounds[a] = -INFINITY;
+    }
+
+    for (int i = 0; ok && i < chunks->chunkCount; i++)
+    {
+        const SceneChunk* chunk = &chunks->chunks[i];
+        if (!chunk->resident) {continue;}
+
+        const MeshData* cell = &chunk->mesh;
+        memcpy(&mesh->vertices[vertexBase], cell->vertices, sizeof(GPUPackedVertex) * cell->vertexCount);
+        memcpy(&mesh->triangleMaterials[triangleBase], cell->triangleMaterials, sizeof(uint32_t) * cell->triangleCount);
+
+        for (uint32_t k = 0; k < cell->indexCount; k++)
+        {
+            mesh->indices[3 * (size_t)triangleBase + k] = cell->indices[k] + vertexBase;
+        }
+
+        for (int a = 0; a < 3; a++)
+        {
+            mesh->minBounds[a] = fminf(mesh->minBounds[a], chunk->minBounds[a]);
+            mesh->maxBounds[a] = fmaxf(mesh->maxBounds[a], chunk->maxBounds[a]);
+        }
+
+        trees[tree] = chunk->bvh;
+        triangleBases[tree++] = triangleBase;
+
+        vertexBase += cell->vertexCount;
+        triangleBase += cell->triangleCount;
+    }
+
+    mesh->vertexCount = (uint32_t)vertexCount;
+    mesh->indexCount = (uint32_t)(3 * triangleCount);
+    mesh->triangleCount = (uint32_t)triangleCount;
+
+    ok = ok && mergeBVHSubtrees(bvh, trees, triangleBases, (uint32_t)tree);
+
+    free(trees);
+    free(triangleBases);
+
+    if (!ok)
+    {
+        fprintf(stderr, "Failed to stitch the resident chunks\n");
+        freeMeshData(mesh);
+        return 0;
+    }
+
+    return 1;
+}
+
+void freeSceneChunks(SceneChunks* chunks)
+{
+    for (int i = 0; chunks->chunks && i < chunks->chunkCount; i++)
+    {
+        SceneChunk* chunk = &chunks->chunks[i];
+        freeMeshData(&chunk->mesh);
+        free(chunk->bvh.nodes);
+        free(chunk->cachePath);
+    }
+
+    free(chunks->chunks);
+    memset(chunks, 0, sizeof(SceneChunks));
+}
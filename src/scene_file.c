@@ -0,0 +1,314 @@
+#include "scene_file.h"
+#include "mesh_file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int isSceneFile(const MappedFile* file)
+{
+    return file->size >= sizeof(SceneFileHeader) && memcmp(file->data, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC)) == 0;
+}
+
+// Section must be aligned, lie inside the file and hold whole elements
+static int sectionValid(const SceneFileSection* section, size_t fileSize)
+{
+    if (section->offset % SCENE_FILE_ALIGN != 0 || section->offset > fileSize || section->size > fileSize - section->offset) {return 0;}
+    if (section->type == SCENE_SECTION_SOURCES || section->type == SCENE_SECTION_MESH) {return 1;}
+
+    return section->count <= INT32_MAX && section->size == (uint64_t)section->count * section->elementSize;
+}
+
+// POD sections are used in place, a layout change shows up as a size mismatch
+static const void* sectionArray(const char* base, const SceneFileSection* section, size_t elementSize, const char* what)
+{
+    if (section->elementSize != elementSize)
+    {
+        fprintf(stderr, "Scene %s stored as %u byte records, expected %zu\n", what, section->elementSize, elementSize);
+        return NULL;
+    }
+
+    return base + section->offset;
+}
+
+// Same rules as the lod and lod_camera directives of the text format
+static int lodValid(const SceneLod* lod)
+{
+    if (lod->levels < 0 || (lod->levels > 0 && !(lod->ratio > 0.0f && lod->ratio < 1.0f))) {return 0;}
+    return !lod->useCamera || lod->distance > 0.0f;
+}
+
+static int readSources(SceneDescription* scene, const char* data, uint64_t size, uint32_t count)
+{
+    if (count == 0) {return 1;}
+    if (count > INT32_MAX) {return 0;}
+
+    scene->sourcePaths = calloc(count, sizeof(char*));
+    scene->meshSources = calloc(count, sizeof(MeshData));
+    if (!scene->sourcePaths || !scene->meshSources) {return 0;}
+
+    const char* p = data;
+    const char* end = data + size;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const char* terminator = memchr(p, '\0', (size_t)(end - p));
+        if (!terminator) {return 0;}
+
+        scene->sourcePaths[i] = strdup(p);
+        if (!scene->sourcePaths[i]) {return 0;}
+        scene->numberOfSources++;
+
+        p = terminator + 1;
+    }
+
+    return 1;
+}
+
+int loadSceneFile(const char* filename, MappedFile* file, SceneDescription* scene)
+{
+    SceneFileHeader header;
+    memcpy(&header, file->data, sizeof(SceneFileHeader));
+
+    if (header.version != SCENE_FILE_VERSION || header.fileSize != file->size ||
+        header.sectionCount > (file->size - sizeof(SceneFileHeader)) / sizeof(SceneFileSection))
+    {
+        fprintf(stderr, "Invalid or unsupported scene file: %s\n", filename);
+        unmapFile(file);
+        return 0;
+    }
+
+    scene->mapping = shareMappedFile(file);
+    if (!scene->mapping)
+    {
+        fprintf(stderr, "Memory allocation failed for scene file: %s\n", filename);
+        return 0;
+    }
+
+    // Private copy on write view, the loader remaps instance sources in place.
+    // The embedded meshes share it, each with a reference of its own.
+    const char* base = scene->mapping->data;
+    size_t fileSize = scene->mapping->size;
+    const SceneFileSection* table = (const SceneFileSection*)(base + sizeof(SceneFileHeader));
+
+    // Meshes wait for the second pass, they are checked against the source count
+    for (uint32_t i = 0; i < header.sectionCount; i++)
+    {
+        const SceneFileSection* section = &table[i];
+        int ok = sectionValid(section, fileSize);
+
+        if (ok && section->type == SCENE_SECTION_MATERIALS)
+        {
+            scene->materials = (Material*)sectionArray(base, section, sizeof(Material), "materials");
+            scene->materialCount = (int)section->count;
+            ok = scene->materials != NULL;
+        }
+        else if (ok && section->type == SCENE_SECTION_INSTANCES)
+        {
+            scene->meshInstances = (MeshInstance*)sectionArray(base, section, sizeof(MeshInstance), "instances");
+            scene->numberOfInstances = (int)section->count;
+            ok = scene->meshInstances != NULL;
+        }
+        else if (ok && section->type == SCENE_SECTION_SPHERES)
+        {
+            scene->spheres = (Sphere*)sectionArray(base, section, sizeof(Sphere), "spheres");
+            scene->sphereCount = (int)section->count;
+            ok = scene->spheres != NULL;
+        }
+        else if (ok && section->type == SCENE_SECTION_LOD)
+        {
+            const SceneLod* lod = sectionArray(base, section, sizeof(SceneLod), "lod settings");
+            if (lod && section->count == 1 && !lodValid(lod))
+            {
+                fprintf(stderr, "Bad lod settings, %d levels at ratio %g, camera distance %g\n", lod->levels, lod->ratio, lod->distance);
+                lod = NULL;
+            }
+
+            if (lod && section->count == 1) {scene->lod = *lod;}
+            else {ok = 0;}
+        }
+        else if (ok && section->type == SCENE_SECTION_SOURCES)
+        {
+            ok = scene->numberOfSources == 0 && readSources(scene, base + section->offset, section->size, section->count);
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "Invalid section %u in scene file: %s\n", i, filename);
+            return 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < header.sectionCount; i++)
+    {
+        const SceneFileSection* section = &table[i];
+        if (section->type != SCENE_SECTION_MESH) {continue;}
+
+        if (section->count >= (uint32_t)scene->numberOfSources || scene->meshSources[section->count].mapping)
+        {
+            fprintf(stderr, "Invalid section %u in scene file: %s\n", i, filename);
+            return 0;
+        }
+
+        MeshData* mesh = &scene->meshSources[section->count];
+        if (!loadMeshImage(scene->sourcePaths[section->count], scene->mapping, section->offset, section->size, mesh)) {return 0;}
+
+        printf("\nMapped %s: %u vertices, %u triangles (%.1f MB)\n", scene->sourcePaths[section->count], mesh->vertexCount,
+            mesh->triangleCount, section->size / (1024.0 * 1024.0));
+    }
+
+    // Same rule as the text loader, out of range sources point past every source
+    for (int i = 0; i < scene->numberOfInstances; i++)
+    {
+        MeshInstance* instance = &scene->meshInstances[i];
+        if (instance->meshSourceIndex < 0 || instance->meshSourceIndex > scene->numberOfSources)
+        {
+            instance->meshSourceIndex = scene->numberOfSources;
+        }
+    }
+
+    return 1;
+}
+
+static int padSection(FILE* file)
+{
+    static const char zeros[SCENE_FILE_ALIGN] = {0};
+    int64_t position = tellFile(file);
+    if (position < 0) {return 0;}
+
+    size_t padding = (SCENE_FILE_ALIGN - (size_t)position % SCENE_FILE_ALIGN) % SCENE_FILE_ALIGN;
+    return fwrite(zeros, 1, padding, file) == padding;
+}
+
+// Opens a section at the next aligned position, closeSection records its size
+static int openSection(FILE* file, SceneFileSection* section, uint32_t type, uint32_t count, uint32_t elementSize)
+{
+    if (!padSection(file)) {return 0;}
+
+    memset(section, 0, sizeof(SceneFileSection));
+    section->type = type;
+    section->count = count;
+    section->elementSize = elementSize;
+    int64_t position = tellFile(file);
+    if (position < 0) {return 0;}
+
+    section->offset = (uint64_t)position;
+    return 1;
+}
+
+static int closeSection(FILE* file, SceneFileSection* section)
+{
+    int64_t end = tellFile(file);
+    if (end < 0) {return 0;}
+
+    section->size = (uint64_t)end - section->offset;
+    return 1;
+}
+
+static int writeArraySection(FILE* file, SceneFileSection* section, uint32_t type, const void* data, int count, size_t elementSize)
+{
+    return openSection(file, section, type, (uint32_t)count, (uint32_t)elementSize) &&
+        fwrite(data, elementSize, (size_t)count, file) == (size_t)count &&
+        closeSection(file, section);
+}
+
+int writeSceneFile(const char* filename, const SceneDescription* scene, int embedMeshes)
+{
+    uint32_t sectionCount = 0;
+    if (scene->materialCount > 0) {sectionCount++;}
+    if (scene->numberOfSources > 0) {sectionCount++;}
+    if (scene->numberOfInstances > 0) {sectionCount++;}
+    if (scene->sphereCount > 0) {sectionCount++;}
+    if (scene->lod.levels > 0 || scene->lod.useCamera) {sectionCount++;}
+
+    for (int i = 0; embedMeshes && i < scene->numberOfSources; i++)
+    {
+        if (scene->meshSources[i].indices) {sectionCount++;}
+    }
+
+    SceneFileSection* table = calloc(sectionCount ? sectionCount : 1, sizeof(SceneFileSection));
+    if (!table) {return 0;}
+
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Could not create scene file: %s\n", filename);
+        free(table);
+        return 0;
+    }
+
+    SceneFileHeader header;
+    memset(&header, 0, sizeof(SceneFileHeader));
+    memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC));
+    header.version = SCENE_FILE_VERSION;
+    header.sectionCount = sectionCount;
+
+    // Header and table are written again once the sections know their place
+    int written = fwrite(&header, sizeof(SceneFileHeader), 1, file) == 1 &&
+        fwrite(table, sizeof(SceneFileSection), sectionCount, file) == sectionCount;
+
+    uint32_t s = 0;
+
+    if (written && scene->materialCount > 0)
+    {
+        written = writeArraySection(file, &table[s++], SCENE_SECTION_MATERIALS, scene->materials, scene->materialCount, sizeof(Material));
+    }
+
+    if (written && scene->numberOfSources > 0)
+    {
+        SceneFileSection* section = &table[s++];
+        written = openSection(file, section, SCENE_SECTION_SOURCES, (uint32_t)scene->numberOfSources, 1);
+
+        for (int i = 0; written && i < scene->numberOfSources; i++)
+        {
+            size_t length = strlen(scene->sourcePaths[i]) + 1;
+            written = fwrite(scene->sourcePaths[i], 1, length, file) == length;
+        }
+
+        written = written && closeSection(file, section);
+    }
+
+    if (written && scene->numberOfInstances > 0)
+    {
+        written = writeArraySection(file, &table[s++], SCENE_SECTION_INSTANCES, scene->meshInstances, scene->numberOfInstances, sizeof(MeshInstance));
+    }
+
+    if (written && scene->sphereCount > 0)
+    {
+        written = writeArraySection(file, &table[s++], SCENE_SECTION_SPHERES, scene->spheres, scene->sphereCount, sizeof(Sphere));
+    }
+
+    if (written && (scene->lod.levels > 0 || scene->lod.useCamera))
+    {
+        written = writeArraySection(file, &table[s++], SCENE_SECTION_LOD, &scene->lod, 1, sizeof(SceneLod));
+    }
+
+    for (int i = 0; written && embedMeshes && i < scene->numberOfSources; i++)
+    {
+        if (!scene->meshSources[i].indices) {continue;}
+
+        SceneFileSection* section = &table[s++];
+        written = openSection(file, section, SCENE_SECTION_MESH, (uint32_t)i, 1) &&
+            writeMeshImage(file, &scene->meshSources[i]) &&
+            closeSection(file, section);
+    }
+
+    int64_t fileSize = tellFile(file);
+    header.fileSize = fileSize < 0 ? 0 : (uint64_t)fileSize;
+
+    written = written && fileSize >= 0 && seekFile(file, 0, SEEK_SET) == 0 &&
+        fwrite(&header, sizeof(SceneFileHeader), 1, file) == 1 &&
+        fwrite(table, sizeof(SceneFileSection), sectionCount, file) == sectionCount;
+
+    if (fclose(file) != 0) {written = 0;}
+    free(table);
+
+    if (!written)
+    {
+        fprintf(stderr, "Failed to write scene file: %s\n", filename);
+        remove(filename);
+        return 0;
+    }
+
+    return 1;
+}
@@ -1,8 +1,19 @@
 #include "scene_loader.h"
+#include "bvh.h"
+#include "config.h"
+#include "file_util.h"
+#include "hash_util.h"
+#include "mesh_lod.h"
+#include "mesh_weld.h"
+#include "parse_util.h"
+#include "scene_file.h"
+#include "simd_math.h"
+#include "thread_pool.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 static void zeroScene(SceneDescription* scene)
 {
@@ -22,164 +33,1157 @@ void freeScene(SceneDescription* scene)
         free(scene->meshSources);
     }
 
-    free(scene->materials);
-    free(scene->meshInstances);
-    free(scene->spheres);
+    if (scene->sourcePaths)
+    {
+        for (int i = 0; i < scene->numberOfSources; i++) {free(scene->sourcePaths[i]);}
+        free(scene->sourcePaths);
+    }
+
+    // Binary scenes keep these arrays in their mapping
+    if (scene->mapping)
+    {
+        releaseMappedFile(scene->mapping);
+    }
+    else
+    {
+        free(scene->materials);
+        free(scene->meshInstances);
+        free(scene->spheres);
+    }
 
     zeroScene(scene);
 }
 
-int loadScene(const char* scenePath, SceneDescription* scene)
+// Whitespace separated tokens over the mapped scene file
+typedef struct
 {
-    FILE* file = fopen(scenePath, "r");
+    const char* p;
+    const char* end;
+} SceneReader;
 
-    if (!file) 
+static int readFloat(SceneReader* reader, float* out)
+{
+    const char* p = skipWhitespace(reader->p, reader->end);
+    const char* next = parseFloat(p, reader->end, out);
+    if (next == p) {return 0;}
+
+    reader->p = next;
+    return 1;
+}
+
+static int readFloats(SceneReader* reader, float** out, int count)
+{
+    for (int i = 0; i < count; i++)
     {
-        fprintf(stderr, "Failed to open scene file: %s\n", scenePath);
-        return 0;
+        if (!readFloat(reader, out[i])) {return 0;}
     }
+    return 1;
+}
 
-    zeroScene(scene);
+static int readInt(SceneReader* reader, int* out)
+{
+    const char* p = skipWhitespace(reader->p, reader->end);
+    int64_t value;
+    const char* next = parseInt(p, reader->end, &value);
+    if (next == p || value < INT32_MIN || value > INT32_MAX) {return 0;}
+
+    reader->p = next;
+    *out = (int)value;
+    return 1;
+}
 
-    if (fscanf(file, "%d", &scene->materialCount) != 1)
+static int readWord(SceneReader* reader, char* out, size_t size)
+{
+    const char* p = skipWhitespace(reader->p, reader->end);
+    size_t length = 0;
+
+    while (p < reader->end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
     {
-        fclose(file);
-        return 0;
+        if (length + 1 < size) {out[length++] = *p;}
+        p++;
     }
 
-    scene->materials = calloc(scene->materialCount, sizeof(Material));
+    out[length] = '\0';
+    reader->p = p;
+    return length > 0;
+}
+
+// Generator directives expand into instances appended after the listed ones,
+// in directive order, once the whole file parsed
+typedef enum
+{
+    GENERATOR_GRID,
+    GENERATOR_LINE,
+    GENERATOR_SCATTER
+} GeneratorType;
 
-    if (!scene->materials)
+typedef struct
+{
+    GeneratorType type;
+    MeshInstance base;      // Source, material, scale and rotation of every instance, pos = first / min corner
+    float to[3];            // Grid: step, line: end point, scatter: max corner
+    int counts[3];          // Grid cells per axis, line and scatter use counts[0]
+    uint32_t seed;
+    float yawJitter;        // Scatter turns rotation.y by up to this much
+    int first;              // First instance it writes
+    int count;
+} InstanceGenerator;
+
+typedef struct
+{
+    int instance;
+    int level;
+} InstanceLod;
+
+typedef struct
+{
+    const int* sourceRemap;
+    int listedSources;
+
+    InstanceGenerator* generators;
+    int generatorCount;
+    int generatorCapacity;
+    int generatedInstances;
+
+    // lod_instance may name generated instances, applied after the expansion
+    InstanceLod* lods;
+    int lodCount;
+    int lodCapacity;
+} DirectiveState;
+
+static void* growArray(void* array, int* capacity, int needed, size_t elementSize)
+{
+    if (needed <= *capacity) {return array;}
+
+    int grown = *capacity ? *capacity * 2 : 16;
+    void* resized = realloc(array, (size_t)grown * elementSize);
+    if (resized) {*capacity = grown;}
+    return resized;
+}
+
+// Stateless per instance random numbers, the expansion gives the same scene on
+// any worker count
+static float randomUnit(uint32_t seed, uint32_t index, uint32_t stream)
+{
+    uint32_t h = hashUint(seed ^ hashUint(index * 4u + stream));
+    return (float)(h >> 8) * (1.0f / 16777216.0f);
+}
+
+static void generateInstance(const InstanceGenerator* generator, int i, MeshInstance* out)
+{
+    *out = generator->base;
+    float* pos = &out->pos.x;
+
+    if (generator->type == GENERATOR_GRID)
     {
-        freeScene(scene);
-        fclose(file);
-        return 0;
+        int cell[3] = {i % generator->counts[0], (i / generator->counts[0]) % generator->counts[1], i / (generator->counts[0] * generator->counts[1])};
+        for (int a = 0; a < 3; a++) {pos[a] += generator->to[a] * (float)cell[a];}
+    }
+    else if (generator->type == GENERATOR_LINE)
+    {
+        float t = generator->count > 1 ? (float)i / (float)(generator->count - 1) : 0.0f;
+        for (int a = 0; a < 3; a++) {pos[a] += (generator->to[a] - pos[a]) * t;}
+    }
+    else
+    {
+        for (int a = 0; a < 3; a++) {pos[a] += (generator->to[a] - pos[a]) * randomUnit(generator->seed, (uint32_t)i, (uint32_t)a);}
+        out->rotation.y += generator->yawJitter * randomUnit(generator->seed, (uint32_t)i, 3);
     }
+}
 
-    for (int i = 0; i < scene->materialCount; i++)
+typedef struct
+{
+    const InstanceGenerator* generator;
+    MeshInstance* instances;
+} GeneratorJob;
+
+static void generateRange(void* context, size_t begin, size_t end, int worker)
+{
+    GeneratorJob* job = context;
+    (void)worker;
+
+    for (size_t i = begin; i < end; i++)
     {
-        Material* m = &scene->materials[i];
+        generateInstance(job->generator, (int)i, &job->instances[job->generator->first + i]);
+    }
+}
 
-        if (fscanf(
-            file,
-            "%f %f %f %f %f %f %f %f",
-            &m->cr, &m->cg, &m->cb,
-            &m->visibility,
-            &m->roughness,
-            &m->metallic,
-            &m->emission,
-            &m->opacity
-        ) != 8)
+static int expandGenerators(SceneDescription* scene, DirectiveState* state)
+{
+    if (state->generatedInstances > 0)
+    {
+        int total = scene->numberOfInstances + state->generatedInstances;
+        MeshInstance* instances = realloc(scene->meshInstances, sizeof(MeshInstance) * (size_t)total);
+        if (!instances)
         {
-            fprintf(stderr, "Failed to read material %d\n", i);
-            freeScene(scene);
-            fclose(file);
+            fprintf(stderr, "Memory allocation failed for %d generated instances\n", state->generatedInstances);
             return 0;
         }
+
+        scene->meshInstances = instances;
+        scene->numberOfInstances = total;
+
+        for (int g = 0; g < state->generatorCount; g++)
+        {
+            GeneratorJob job = {&state->generators[g], instances};
+            parallelFor((size_t)state->generators[g].count, 4096, generateRange, &job);
+        }
     }
 
-    if (fscanf(file, "%d", &scene->numberOfSources) != 1)
+    for (int i = 0; i < state->lodCount; i++)
     {
-        freeScene(scene);
-        fclose(file);
-        return 0;
+        scene->meshInstances[state->lods[i].instance].lodLevel = state->lods[i].level;
     }
 
-    scene->meshSources = calloc(scene->numberOfSources, sizeof(MeshData));
-    if(!scene->meshSources)
+    return 1;
+}
+
+// <source> <material> fields shared by every generator, <sx sy sz> <rx ry rz> come last
+static int readGeneratorBase(SceneReader* reader, const DirectiveState* state, const SceneDescription* scene, MeshInstance* base)
+{
+    memset(base, 0, sizeof(MeshInstance));
+
+    int listed;
+    if (!readInt(reader, &listed) || !readInt(reader, &base->materialIndex)) {return 0;}
+
+    // Same rule as listed instances, out of range sources are skipped by buildSceneMesh
+    base->meshSourceIndex = (listed >= 0 && listed < state->listedSources) ? state->sourceRemap[listed] : scene->numberOfSources;
+    base->pos.a = 1.0f;
+    base->scale.a = 1.0f;
+    base->rotation.a = 1.0f;
+    base->lodLevel = -1;
+    return 1;
+}
+
+static int readGeneratorTransform(SceneReader* reader, MeshInstance* base)
+{
+    float* fields[] =
     {
-        freeScene(scene);
-        fclose(file);
+        &base->scale.x, &base->scale.y, &base->scale.z,
+        &base->rotation.x, &base->rotation.y, &base->rotation.z
+    };
+    return readFloats(reader, fields, 6);
+}
+
+static int addGenerator(DirectiveState* state, const SceneDescription* scene, InstanceGenerator* generator, int64_t count)
+{
+    if (count < 0 || count > INT32_MAX - (int64_t)scene->numberOfInstances - state->generatedInstances)
+    {
+        fprintf(stderr, "Generator would make more than %d instances\n", INT32_MAX);
         return 0;
     }
 
-    for (int i = 0; i < scene->numberOfSources; i++)
+    InstanceGenerator* generators = growArray(state->generators, &state->generatorCapacity, state->generatorCount + 1, sizeof(InstanceGenerator));
+    if (!generators) {return 0;}
+    state->generators = generators;
+
+    generator->first = scene->numberOfInstances + state->generatedInstances;
+    generator->count = (int)count;
+    generators[state->generatorCount++] = *generator;
+    state->generatedInstances += (int)count;
+    return 1;
+}
+
+// Optional keyword lines after the spheres
+//   lod <levels> <ratio>                simplified copies of every used source
+//   lod_camera <x> <y> <z> <distance>   level 0 inside distance, one more per doubling
+//   lod_instance <instance> <level>     explicit level, wins over lod_camera
+//   grid <source> <material> <x y z> <nx ny nz> <dx dy dz> <sx sy sz> <rx ry rz>
+//                                       nx * ny * nz instances, x fastest
+//   line <source> <material> <count> <x0 y0 z0> <x1 y1 z1> <sx sy sz> <rx ry rz>
+//                                       evenly spaced, both ends included
+//   scatter <source> <material> <count> <seed> <min xyz> <max xyz> <sx sy sz> <rx ry rz> <yaw>
+//                                       uniform in the box, rotation y turned by up to yaw
+static int parseDirectives(SceneReader* reader, SceneDescription* scene, DirectiveState* state)
+{
+    char word[64];
+
+    while (readWord(reader, word, sizeof(word)))
     {
-        char path[512];
-        
-        if ((fscanf(file, "%511s", path) != 1) || (!loadObj(path, &scene->meshSources[i])))
+        SceneLod* lod = &scene->lod;
+
+        if (strcmp(word, "lod") == 0)
+        {
+            if (!readInt(reader, &lod->levels) || !readFloat(reader, &lod->ratio) ||
+                lod->levels < 0 || !(lod->ratio > 0.0f && lod->ratio < 1.0f))
+            {
+                fprintf(stderr, "Bad lod directive, expected: lod <levels> <ratio between 0 and 1>\n");
+                return 0;
+            }
+        }
+        else if (strcmp(word, "lod_camera") == 0)
+        {
+            float* fields[] = {&lod->camera[0], &lod->camera[1], &lod->camera[2], &lod->distance};
+            if (!readFloats(reader, fields, 4) || !(lod->distance > 0.0f))
+            {
+                fprintf(stderr, "Bad lod_camera directive, expected: lod_camera <x> <y> <z> <distance>\n");
+                return 0;
+            }
+            lod->useCamera = 1;
+        }
+        else if (strcmp(word, "lod_instance") == 0)
+        {
+            InstanceLod entry;
+            if (!readInt(reader, &entry.instance) || !readInt(reader, &entry.level) ||
+                entry.instance < 0 || entry.instance >= scene->numberOfInstances + state->generatedInstances || entry.level < 0)
+            {
+                fprintf(stderr, "Bad lod_instance directive, expected: lod_instance <instance> <level>\n");
+                return 0;
+            }
+
+            InstanceLod* lods = growArray(state->lods, &state->lodCapacity, state->lodCount + 1, sizeof(InstanceLod));
+            if (!lods) {return 0;}
+            state->lods = lods;
+            lods[state->lodCount++] = entry;
+        }
+        else if (strcmp(word, "grid") == 0)
+        {
+            InstanceGenerator generator = {GENERATOR_GRID};
+            MeshInstance* base = &generator.base;
+            float* fields[] = {&base->pos.x, &base->pos.y, &base->pos.z};
+            float* steps[] = {&generator.to[0], &generator.to[1], &generator.to[2]};
+
+            if (!readGeneratorBase(reader, state, scene, base) || !readFloats(reader, fields, 3) ||
+                !readInt(reader, &generator.counts[0]) || !readInt(reader, &generator.counts[1]) || !readInt(reader, &generator.counts[2]) ||
+                !readFloats(reader, steps, 3) || !readGeneratorTransform(reader, base) ||
+                generator.counts[0] < 1 || generator.counts[1] < 1 || generator.counts[2] < 1)
+            {
+                fprintf(stderr, "Bad grid directive, expected: grid <source> <material> <x y z> <nx ny nz> <dx dy dz> <sx sy sz> <rx ry rz>\n");
+                return 0;
+            }
+
+            int64_t count = (int64_t)generator.counts[0] * generator.counts[1];
+            count = count > INT32_MAX ? -1 : count * generator.counts[2];
+            if (!addGenerator(state, scene, &generator, count)) {return 0;}
+        }
+        else if (strcmp(word, "line") == 0)
+        {
+            InstanceGenerator generator = {GENERATOR_LINE};
+            MeshInstance* base = &generator.base;
+            float* fields[] = {&base->pos.x, &base->pos.y, &base->pos.z, &generator.to[0], &generator.to[1], &generator.to[2]};
+
+            if (!readGeneratorBase(reader, state, scene, base) || !readInt(reader, &generator.counts[0]) ||
+                !readFloats(reader, fields, 6) || !readGeneratorTransform(reader, base) || generator.counts[0] < 1)
+            {
+                fprintf(stderr, "Bad line directive, expected: line <source> <material> <count> <x0 y0 z0> <x1 y1 z1> <sx sy sz> <rx ry rz>\n");
+                return 0;
+            }
+
+            if (!addGenerator(state, scene, &generator, generator.counts[0])) {return 0;}
+        }
+        else if (strcmp(word, "scatter") == 0)
+        {
+            InstanceGenerator generator = {GENERATOR_SCATTER};
+            MeshInstance* base = &generator.base;
+            float* fields[] = {&base->pos.x, &base->pos.y, &base->pos.z, &generator.to[0], &generator.to[1], &generator.to[2]};
+            int seed;
+
+            if (!readGeneratorBase(reader, state, scene, base) || !readInt(reader, &generator.counts[0]) || !readInt(reader, &seed) ||
+                !readFloats(reader, fields, 6) || !readGeneratorTransform(reader, base) || !readFloat(reader, &generator.yawJitter) ||
+                generator.counts[0] < 1 || seed < 0)
+            {
+                fprintf(stderr, "Bad scatter directive, expected: scatter <source> <material> <count> <seed> <min xyz> <max xyz> <sx sy sz> <rx ry rz> <yaw>\n");
+                return 0;
+            }
+
+            generator.seed = (uint32_t)seed;
+            if (!addGenerator(state, scene, &generator, generator.counts[0])) {return 0;}
+        }
+        else
         {
-            fprintf(stderr, "Failed to load mesh: %s\n", path);
-            freeScene(scene);
-            fclose(file);
+            fprintf(stderr, "Unknown scene directive '%s'\n", word);
             return 0;
         }
     }
 
-    if (fscanf(file, "%d", &scene->numberOfInstances) != 1)
+    return expandGenerators(scene, state);
+}
+
+static int parseSpheres(SceneReader* reader, SceneDescription* scene)
+{
+    if (!readInt(reader, &scene->sphereCount))
     {
-        freeScene(scene);
-        fclose(file);
+        scene->sphereCount = 0;
+        return 1;
+    }
+
+    if (scene->sphereCount < 0)
+    {
+        fprintf(stderr, "Bad sphere count %d\n", scene->sphereCount);
+        scene->sphereCount = 0;
         return 0;
     }
 
-    scene->meshInstances = calloc(scene->numberOfInstances, sizeof(MeshInstance));
+    if (scene->sphereCount > 0)
+    {
+        scene->spheres = calloc(scene->sphereCount, sizeof(Sphere));
+        if (!scene->spheres) {return 0;}
 
-    if (!scene->meshInstances)
+        for (int i = 0; i < scene->sphereCount; i++)
+        {
+            Sphere* s = &scene->spheres[i];
+            float* fields[] = {&s->px, &s->py, &s->pz, &s->radius};
+
+            if (!readFloats(reader, fields, 4) || !readInt(reader, &s->materialIndex))
+            {
+                fprintf(stderr, "Failed to read sphere %d\n", i);
+                return 0;
+            }
+            s->padding[0] = 1.0f;
+            s->padding[1] = 1.0f;
+            s->padding[2] = 1.0f;
+        }
+    }
+
+    return 1;
+}
+
+static int parseScene(SceneReader* reader, SceneDescription* scene)
+{
+    if (!readInt(reader, &scene->materialCount)) {return 0;}
+
+    scene->materials = calloc(scene->materialCount, sizeof(Material));
+    if (!scene->materials) {return 0;}
+
+    for (int i = 0; i < scene->materialCount; i++)
     {
-        freeScene(scene);
-        fclose(file);
+        Material* m = &scene->materials[i];
+        float* fields[] = {&m->cr, &m->cg, &m->cb, &m->visibility, &m->roughness, &m->metallic, &m->emission, &m->opacity};
+
+        if (!readFloats(reader, fields, 8))
+        {
+            fprintf(stderr, "Failed to read material %d\n", i);
+            return 0;
+        }
+    }
+
+    // Only the paths here, loadSources reads the meshes once the whole file parsed
+    int listedSources;
+    if (!readInt(reader, &listedSources) || listedSources < 0) {return 0;}
+
+    scene->sourcePaths = calloc(listedSources, sizeof(char*));
+    scene->meshSources = calloc(listedSources, sizeof(MeshData));
+    int* sourceRemap = malloc(sizeof(int) * (listedSources + 1));
+    if (!scene->sourcePaths || !scene->meshSources || !sourceRemap)
+    {
+        free(sourceRemap);
         return 0;
     }
 
+    for (int i = 0; i < listedSources; i++)
+    {
+        char path[512];
+
+        if (!readWord(reader, path, sizeof(path)))
+        {
+            fprintf(stderr, "Failed to read mesh path %d\n", i);
+            free(sourceRemap);
+            return 0;
+        }
+
+        // Identical paths share one load
+        int unique = 0;
+        while (unique < scene->numberOfSources && strcmp(scene->sourcePaths[unique], path) != 0) {unique++;}
+
+        if (unique == scene->numberOfSources)
+        {
+            scene->sourcePaths[unique] = strdup(path);
+            if (!scene->sourcePaths[unique])
+            {
+                free(sourceRemap);
+                return 0;
+            }
+            scene->numberOfSources++;
+        }
+
+        sourceRemap[i] = unique;
+    }
+
+    if (!readInt(reader, &scene->numberOfInstances)) {free(sourceRemap); return 0;}
+
+    scene->meshInstances = calloc(scene->numberOfInstances, sizeof(MeshInstance));
+    if (!scene->meshInstances) {free(sourceRemap); return 0;}
+
     for (int i = 0; i < scene->numberOfInstances; i++)
     {
         MeshInstance* inst = &scene->meshInstances[i];
-
-        if (fscanf(
-            file,
-            "%f %f %f %f %f %f %f %f %f %d %d",
+        float* fields[] =
+        {
             &inst->pos.x, &inst->pos.y, &inst->pos.z,
             &inst->scale.x, &inst->scale.y, &inst->scale.z,
-            &inst->rotation.x, &inst->rotation.y, &inst->rotation.z,
-            &inst->materialIndex,
-            &inst->meshSourceIndex
-        ) != 11)
+            &inst->rotation.x, &inst->rotation.y, &inst->rotation.z
+        };
+
+        if (!readFloats(reader, fields, 9) || !readInt(reader, &inst->materialIndex) || !readInt(reader, &inst->meshSourceIndex))
         {
             fprintf(stderr, "Failed to read instance %d\n", i);
-            freeScene(scene);
-            fclose(file);
+            free(sourceRemap);
             return 0;
         }
 
+        // Out of range indices stay out of range and are skipped by buildSceneMesh
+        int listed = inst->meshSourceIndex;
+        inst->meshSourceIndex = (listed >= 0 && listed < listedSources) ? sourceRemap[listed] : scene->numberOfSources;
+
         inst->pos.a = 1.0f;
         inst->scale.a = 1.0f;
         inst->rotation.a = 1.0f;
+        inst->lodLevel = -1;
     }
 
-    if (fscanf(file, "%d", &scene->sphereCount) != 1)
+    // Sphere section is optional, directives may follow the instances directly
+    int parsed = parseSpheres(reader, scene);
+
+    DirectiveState state = {sourceRemap, listedSources};
+    parsed = parsed && parseDirectives(reader, scene, &state);
+
+    free(state.generators);
+    free(state.lods);
+    free(sourceRemap);
+    return parsed;
+}
+
+typedef struct
+{
+    SceneDescription* scene;
+    float weldTolerance;
+    int* loaded;
+} SourceLoadJob;
+
+static void loadSourceRange(void* context, size_t begin, size_t end, int worker)
+{
+    SourceLoadJob* job = context;
+
+    for (size_t i = begin; i < end; i++)
     {
-        scene->sphereCount = 0;
-        fclose(file);
-        return 1;
+        MeshData* mesh = &job->scene->meshSources[i];
+
+        // Embedded in a binary scene or handed over by reloadScene
+        if (mesh->mapping || mesh->vertices)
+        {
+            job->loaded[i] = 1;
+            continue;
+        }
+
+        job->loaded[i] = loadObj(job->scene->sourcePaths[i], mesh);
+        if (job->loaded[i] && job->weldTolerance >= 0.0f) {job->loaded[i] = weldMesh(mesh, job->weldTolerance);}
     }
+}
 
-    if (scene->sphereCount > 0)
+static int loadSources(SceneDescription* scene)
+{
+    int count = scene->numberOfSources;
+    if (count == 0) {return 1;}
+
+    int* loaded = calloc(count, sizeof(int));
+    if (!loaded) {return 0;}
+
+    // Config is read here, getConfig is not safe to call first from a worker
+    const GltConfig* config = getConfig();
+    SourceLoadJob job = {scene, config->weldTolerance, loaded};
+
+    // One source per task. A single source loads on the caller instead, so its
+    // chunked parse still spreads over the whole pool.
+    if (config->parallelLoad && count > 1) {parallelFor(count, 1, loadSourceRange, &job);}
+    else {loadSourceRange(&job, 0, count, 0);}
+
+    int failed = 0;
+    for (int i = 0; i < count; i++)
     {
-        scene->spheres = calloc(scene->sphereCount, sizeof(Sphere));
-        if (!scene->spheres)
+        if (!loaded[i])
         {
-            freeScene(scene);
-            fclose(file);
-            return 0;
+            fprintf(stderr, "Failed to load mesh: %s\n", scene->sourcePaths[i]);
+            failed++;
         }
+    }
 
-        for (int i = 0; i < scene->sphereCount; i++)
+    free(loaded);
+    return failed == 0;
+}
+
+typedef struct
+{
+    SceneDescription* scene;
+    const int* wantedLevels;    // Deepest level any instance asked for, per source
+    MeshData** chains;          // Levels 1..n per source
+    int* madeLevels;
+    int ok;
+} LodBuildJob;
+
+static void buildLodRange(void* context, size_t begin, size_t end, int worker)
+{
+    LodBuildJob* job = context;
+    float ratio = job->scene->lod.ratio;
+
+    for (size_t s = begin; s < end; s++)
+    {
+        int wanted = job->wantedLevels[s];
+        if (wanted == 0) {continue;}
+
+        job->chains[s] = calloc(wanted, sizeof(MeshData));
+        if (!job->chains[s]) {job->ok = 0; continue;}
+
+        // Each level simplifies the one before, stops once nothing collapses
+        const MeshData* previous = &job->scene->meshSources[s];
+        for (int level = 0; level < wanted; level++)
         {
-            Sphere* s = &scene->spheres[i];
-            if (fscanf(file, "%f %f %f %f %d", &s->px, &s->py, &s->pz, &s->radius, &s->materialIndex) != 5)
+            uint32_t target = (uint32_t)(previous->triangleCount * ratio);
+            MeshData* lod = &job->chains[s][level];
+
+            if (!simplifyMesh(previous, lod, target)) {job->ok = 0; break;}
+
+            job->madeLevels[s] = level + 1;
+            if (lod->triangleCount == previous->triangleCount) {break;}
+            previous = lod;
+        }
+    }
+}
+
+static int instanceLevel(const SceneDescription* scene, const MeshInstance* instance)
+{
+    const SceneLod* lod = &scene->lod;
+    int level = 0;
+
+    if (instance->lodLevel >= 0) {level = instance->lodLevel;}
+    else if (lod->useCamera)
+    {
+        float dx = instance->pos.x - lod->camera[0];
+        float dy = instance->pos.y - lod->camera[1];
+        float dz = instance->pos.z - lod->camera[2];
+        float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+        if (distance >= lod->distance) {level = 1 + (int)floorf(log2f(distance / lod->distance));}
+    }
+
+    return level < lod->levels ? level : lod->levels;
+}
+
+// Simplifies every source as deep as its instances need, appends the levels as
+// extra sources and points the instances at them
+static int buildLods(SceneDescription* scene)
+{
+    if (scene->lod.levels == 0) {return 1;}
+
+    int sourceCount = scene->numberOfSources;
+    int* wantedLevels = calloc(sourceCount, sizeof(int));
+    int* instanceLevels = calloc(scene->numberOfInstances, sizeof(int));
+    MeshData** chains = calloc(sourceCount, sizeof(MeshData*));
+    int* madeLevels = calloc(sourceCount, sizeof(int));
+    int ok = wantedLevels && instanceLevels && chains && madeLevels;
+
+    for (int i = 0; i < scene->numberOfInstances && ok; i++)
+    {
+        const MeshInstance* instance = &scene->meshInstances[i];
+        int src = instance->meshSourceIndex;
+        if (src >= sourceCount) {continue;}
+
+        instanceLevels[i] = instanceLevel(scene, instance);
+        if (instanceLevels[i] > wantedLevels[src]) {wantedLevels[src] = instanceLevels[i];}
+    }
+
+    int extra = 0;
+    if (ok)
+    {
+        LodBuildJob job = {scene, wantedLevels, chains, madeLevels, 1};
+        parallelFor(sourceCount, 1, buildLodRange, &job);
+        ok = job.ok;
+
+        for (int s = 0; s < sourceCount; s++) {extra += madeLevels[s];}
+    }
+
+    if (ok && extra > 0)
+    {
+        MeshData* sources = realloc(scene->meshSources, sizeof(MeshData) * (sourceCount + extra));
+        if (sources) {scene->meshSources = sources;}
+        char** paths = realloc(scene->sourcePaths, sizeof(char*) * (sourceCount + extra));
+        if (paths) {scene->sourcePaths = paths;}
+        ok = sources && paths;
+    }
+
+    // First appended index per source, level k lives at firstLevel[s] + k - 1
+    int* firstLevel = ok ? calloc(sourceCount, sizeof(int)) : NULL;
+    ok = ok && firstLevel;
+
+    uint64_t trianglesBefore = 0;
+    uint64_t trianglesAfter = 0;
+
+    if (ok)
+    {
+        int next = sourceCount;
+        for (int s = 0; s < sourceCount; s++)
+        {
+            firstLevel[s] = next;
+
+            for (int level = 0; level < madeLevels[s]; level++)
             {
-                fprintf(stderr, "Failed to read sphere %d\n", i);
-                freeScene(scene);
-                fclose(file);
-                return 0;
+                size_t length = strlen(scene->sourcePaths[s]) + 16;
+                char* path = malloc(length);
+                if (path) {snprintf(path, length, "%s#lod%d", scene->sourcePaths[s], level + 1);}
+
+                // Ownership moves to the scene, freeScene takes it from here
+                scene->meshSources[next] = chains[s][level];
+                memset(&chains[s][level], 0, sizeof(MeshData));
+                scene->sourcePaths[next] = path;
+                scene->numberOfSources = ++next;
+
+                if (!path) {ok = 0;}
             }
-            s->padding[0] = 1.0f;
-            s->padding[1] = 1.0f;
-            s->padding[2] = 1.0f;
+        }
+
+        for (int i = 0; i < scene->numberOfInstances && ok; i++)
+        {
+            MeshInstance* instance = &scene->meshInstances[i];
+            int src = instance->meshSourceIndex;
+
+            // Out of range instances keep pointing past every source
+            if (src >= sourceCount)
+            {
+                instance->meshSourceIndex = scene->numberOfSources;
+                continue;
+            }
+
+            trianglesBefore += scene->meshSources[src].triangleCount;
+
+            int level = instanceLevels[i] < madeLevels[src] ? instanceLevels[i] : madeLevels[src];
+            if (level > 0) {instance->meshSourceIndex = firstLevel[src] + level - 1;}
+
+            trianglesAfter += scene->meshSources[instance->meshSourceIndex].triangleCount;
+        }
+    }
+
+    if (ok)
+    {
+        printf("LOD: %d levels for %d source(s), instanced triangles %llu -> %llu\n", extra, sourceCount,
+            (unsigned long long)trianglesBefore, (unsigned long long)trianglesAfter);
+    }
+    else
+    {
+        fprintf(stderr, "Failed to build mesh LODs\n");
+    }
+
+    // Anything not handed over, only left on failure
+    for (int s = 0; chains && s < sourceCount; s++)
+    {
+        if (!chains[s]) {continue;}
+        for (int level = 0; level < wantedLevels[s]; level++) {freeMeshData(&chains[s][level]);}
+        free(chains[s]);
+    }
+
+    free(firstLevel);
+    free(chains);
+    free(madeLevels);
+    free(instanceLevels);
+    free(wantedLevels);
+    return ok;
+}
+
+int readScene(const char* scenePath, SceneDescription* scene)
+{
+    MappedFile file;
+
+    if (!mapFile(scenePath, &file))
+    {
+        fprintf(stderr, "Failed to open scene file: %s\n", scenePath);
+        return 0;
+    }
+
+    zeroScene(scene);
+
+    int loaded;
+    if (isSceneFile(&file)) {loaded = loadSceneFile(scenePath, &file, scene);}
+    else
+    {
+        SceneReader reader = {file.data, file.data + file.size};
+        loaded = parseScene(&reader, scene);
+        unmapFile(&file);
+    }
+
+    if (!loaded) {freeScene(scene);}
+
+    return loaded;
+}
+
+int loadScene(const char* scenePath, SceneDescription* scene)
+{
+    if (!readScene(scenePath, scene)) {return 0;}
+
+    int loaded = loadSources(scene);
+    if (loaded) {loaded = buildLods(scene);}
+    if (!loaded) {freeScene(scene);}
+
+    return loaded;
+}
+
+static int isStalePath(const char* path, const char* const* stalePaths, int staleCount)
+{
+    for (int i = 0; i < staleCount; i++)
+    {
+        if (strcmp(path, stalePaths[i]) == 0) {return 1;}
+    }
+    return 0;
+}
+
+int reloadScene(const char* scenePath, SceneDescription* previous, const char* const* stalePaths, int staleCount,
+    SceneDescription* scene, int* loadedSources)
+{
+    *loadedSources = 0;
+    if (!readScene(scenePath, scene)) {return 0;}
+
+    // Previous source behind every adopted mesh plus one, 0 for meshes loaded here
+    int* adopted = calloc(scene->numberOfSources > 0 ? scene->numberOfSources : 1, sizeof(int));
+    if (!adopted)
+    {
+        freeScene(scene);
+        return 0;
+    }
+
+    for (int i = 0; i < scene->numberOfSources; i++)
+    {
+        if (scene->meshSources[i].mapping) {continue;}
+
+        const char* path = scene->sourcePaths[i];
+        if (isStalePath(path, stalePaths, staleCount))
+        {
+            (*loadedSources)++;
+            continue;
+        }
+
+        int found = 0;
+        for (int j = 0; j < previous->numberOfSources && !found; j++)
+        {
+            if (strcmp(previous->sourcePaths[j], path) != 0 || !previous->meshSources[j].vertices) {continue;}
+
+            scene->meshSources[i] = previous->meshSources[j];
+            adopted[i] = j + 1;
+            found = 1;
+        }
+
+        if (!found) {(*loadedSources)++;}
+    }
+
+    // LOD levels get appended past the listed sources
+    int listedSources = scene->numberOfSources;
+
+    int loaded = loadSources(scene);
+    if (loaded) {loaded = buildLods(scene);}
+
+    // Both scenes point at the adopted meshes now, exactly one of them keeps them
+    for (int i = 0; i < listedSources; i++)
+    {
+        if (adopted[i] == 0) {continue;}
+
+        MeshData* owner = loaded ? &previous->meshSources[adopted[i] - 1] : &scene->meshSources[i];
+        memset(owner, 0, sizeof(MeshData));
+    }
+    free(adopted);
+
+    if (!loaded) {freeScene(scene);}
+
+    return loaded;
+}
+
+int diffScenes(const SceneDescription* before, const SceneDescription* after)
+{
+    int diff = 0;
+
+    if (before->materialCount != after->materialCount ||
+        (after->materialCount > 0 && memcmp(before->materials, after->materials, sizeof(Material) * after->materialCount) != 0))
+    {
+        diff |= SCENE_DIFF_MATERIALS;
+    }
+
+    if (before->sphereCount != after->sphereCount ||
+        (after->sphereCount > 0 && memcmp(before->spheres, after->spheres, sizeof(Sphere) * after->sphereCount) != 0))
+    {
+        diff |= SCENE_DIFF_SPHERES;
+    }
+
+    if (before->numberOfSources != after->numberOfSources || before->numberOfInstances != after->numberOfInstances)
+    {
+        return diff | SCENE_DIFF_GEOMETRY;
+    }
+
+    for (int i = 0; i < after->numberOfSources; i++)
+    {
+        if (strcmp(before->sourcePaths[i], after->sourcePaths[i]) != 0) {return diff | SCENE_DIFF_GEOMETRY;}
+    }
+
+    for (int i = 0; i < after->numberOfInstances; i++)
+    {
+        const MeshInstance* a = &before->meshInstances[i];
+        const MeshInstance* b = &after->meshInstances[i];
+
+        // Resolved source, so LOD level changes count as geometry
+        if (a->meshSourceIndex != b->meshSourceIndex) {return diff | SCENE_DIFF_GEOMETRY;}
+        if (a->materialIndex != b->materialIndex) {diff |= SCENE_DIFF_INSTANCE_MATERIALS;}
+
+        if (memcmp(&a->pos, &b->pos, sizeof(Vec4)) != 0 || memcmp(&a->scale, &b->scale, sizeof(Vec4)) != 0 ||
+            memcmp(&a->rotation, &b->rotation, sizeof(Vec4)) != 0)
+        {
+            diff |= SCENE_DIFF_TRANSFORMS;
         }
     }
 
-    fclose(file);
+    return diff;
+}
+
+// Ingested sources bring their own BVH. When every instance only moves and
+// scales such a source the boxes map exactly, so the trees are joined instead
+// of building one over the whole scene.
+static void mergeInstanceTrees(const SceneDescription* scene, MeshData* combined)
+{
+    int treeCount = 0;
+
+    for (int i = 0; i < scene->numberOfInstances; i++)
+    {
+        const MeshInstance* instance = &scene->meshInstances[i];
+        if (instance->meshSourceIndex >= scene->numberOfSources) {continue;}
+
+        const MeshData* source = &scene->meshSources[instance->meshSourceIndex];
+        if (source->triangleCount == 0) {continue;}
+
+        int moveScaleOnly = instance->rotation.x == 0.0f && instance->rotation.y == 0.0f && instance->rotation.z == 0.0f &&
+            instance->scale.x > 0.0f && instance->scale.y > 0.0f && instance->scale.z > 0.0f;
+        if (!source->bvhNodes || !moveScaleOnly) {return;}
+
+        treeCount++;
+    }
+
+    if (treeCount == 0) {return;}
+
+    BVH* trees = calloc(treeCount, sizeof(BVH));
+    uint32_t* triangleBases = calloc(treeCount, sizeof(uint32_t));
+    int ok = trees && triangleBases;
+
+    int tree = 0;
+    uint32_t triangleBase = 0;
+
+    for (int i = 0; i < scene->numberOfInstances && ok; i++)
+    {
+        const MeshInstance* instance = &scene->meshInstances[i];
+        if (instance->meshSourceIndex >= scene->numberOfSources) {continue;}
+
+        const MeshData* source = &scene->meshSources[instance->meshSourceIndex];
+        if (source->triangleCount == 0) {continue;}
+
+        BVH* copy = &trees[tree];
+        copy->nodes = malloc(sizeof(BVHNode) * source->bvhNodeCount);
+        if (!copy->nodes) {ok = 0; break;}
+        copy->nodeCount = source->bvhNodeCount;
+
+        // Same transform as the vertices, so every box still holds its triangles
+        Mat4 modelMatrix = transformMatrix(instance->pos, instance->scale, instance->rotation);
+        Affine3x4 affine = affineFromMat4(&modelMatrix);
+
+        for (uint32_t n = 0; n < copy->nodeCount; n++)
+        {
+            BVHNode* node = &copy->nodes[n];
+            *node = source->bvhNodes[n];
+
+            AABB box;
+            memcpy(box.min, node->aabbMin, sizeof(box.min));
+            memcpy(box.max, node->aabbMax, sizeof(box.max));
+            transformBoxes(&affine, &box, &box, 1);
+            memcpy(node->aabbMin, box.min, sizeof(box.min));
+            memcpy(node->aabbMax, box.max, sizeof(box.max));
+        }
+
+        triangleBases[tree++] = triangleBase;
+        triangleBase += source->indexCount / 3;
+    }
+
+    BVH merged;
+    if (ok && mergeBVHSubtrees(&merged, trees, triangleBases, treeCount))
+    {
+        combined->bvhNodes = merged.nodes;
+        combined->bvhNodeCount = merged.nodeCount;
+    }
+
+    for (int t = 0; trees && t < treeCount; t++) {free(trees[t].nodes);}
+    free(trees);
+    free(triangleBases);
+}
+
+// Vertices and triangles handed to a worker at a time, large instances are
+// split over several workers
+#define FLATTEN_GRAIN 16384
+
+typedef struct
+{
+    const SceneDescription* scene;
+    MeshData* mesh;
+
+    // Instances with a source, and where each one's vertices and triangles
+    // start in the combined mesh, one extra entry holding the totals
+    const int* instances;
+    const uint32_t* vertexStart;
+    const uint32_t* triangleStart;
+    int instanceCount;
+
+    float (*bounds)[6];     // Per worker min xyz, max xyz
+} FlattenJob;
+
+// Listed instance holding element, from the last start not above it
+static int findInstance(const uint32_t* start, int count, uint32_t element)
+{
+    int lo = 0, hi = count - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (start[mid] <= element) {lo = mid;}
+        else {hi = mid - 1;}
+    }
+    return lo;
+}
+
+static void flattenVertexRange(void* context, size_t begin, size_t end, int worker)
+{
+    FlattenJob* job = context;
+    float* bounds = job->bounds[worker];
+
+    for (int k = findInstance(job->vertexStart, job->instanceCount, (uint32_t)begin); k < job->instanceCount && job->vertexStart[k] < end; k++)
+    {
+        const MeshInstance* instance = &job->scene->meshInstances[job->instances[k]];
+        const MeshData* source = &job->scene->meshSources[instance->meshSourceIndex];
+
+        uint32_t first = job->vertexStart[k] > begin ? job->vertexStart[k] : (uint32_t)begin;
+        uint32_t last = job->vertexStart[k + 1] < end ? job->vertexStart[k + 1] : (uint32_t)end;
+        if (first >= last) {continue;}
+
+        Mat4 modelMatrix = transformMatrix(instance->pos, instance->scale, instance->rotation);
+        Affine3x4 affine = affineFromMat4(&modelMatrix);
+        transformPoints(&affine, &source->vertices[first - job->vertexStart[k]].x, &job->mesh->vertices[first].x,
+            last - first, bounds, bounds + 3);
+    }
+}
+
+static void flattenTriangleRange(void* context, size_t begin, size_t end, int worker)
+{
+    FlattenJob* job = context;
+    (void)worker;
+
+    for (int k = findInstance(job->triangleStart, job->instanceCount, (uint32_t)begin); k < job->instanceCount && job->triangleStart[k] < end; k++)
+    {
+        const MeshInstance* instance = &job->scene->meshInstances[job->instances[k]];
+        const MeshData* source = &job->scene->meshSources[instance->meshSourceIndex];
+
+        uint32_t first = job->triangleStart[k] > begin ? job->triangleStart[k] : (uint32_t)begin;
+        uint32_t last = job->triangleStart[k + 1] < end ? job->triangleStart[k + 1] : (uint32_t)end;
+        uint32_t vertexOffset = job->vertexStart[k];
+
+        const uint32_t* sourceIndices = &source->indices[3 * (size_t)(first - job->triangleStart[k])];
+        uint32_t* indices = &job->mesh->indices[3 * (size_t)first];
+        for (size_t i = 0; i < 3 * (size_t)(last - first); i++) {indices[i] = sourceIndices[i] + vertexOffset;}
+
+        for (uint32_t t = first; t < last; t++) {job->mesh->triangleMaterials[t] = instance->materialIndex;}
+    }
+}
+
+int buildSceneMesh(SceneDescription* scene, MeshData* combinedMesh)
+{
+    memset(combinedMesh, 0, sizeof(MeshData));
+
+    int* instances = malloc(sizeof(int) * (scene->numberOfInstances + 1));
+    uint32_t* vertexStart = malloc(sizeof(uint32_t) * (scene->numberOfInstances + 1));
+    uint32_t* triangleStart = malloc(sizeof(uint32_t) * (scene->numberOfInstances + 1));
+    int workerCount = threadPoolSize();
+    float (*bounds)[6] = malloc(sizeof(float[6]) * workerCount);
+
+    if (!instances || !vertexStart || !triangleStart || !bounds)
+    {
+        fprintf(stderr, "Memory allocation failed for %d scene instances\n", scene->numberOfInstances);
+        free(instances);
+        free(vertexStart);
+        free(triangleStart);
+        free(bounds);
+        return 0;
+    }
+
+    int instanceCount = 0;
+    uint64_t totalVertices = 0;
+    uint64_t totalTriangles = 0;
+
+    for (int i = 0; i < scene->numberOfInstances; i++)
+    {
+        int srcIndex = scene->meshInstances[i].meshSourceIndex;
+
+        if (srcIndex >= scene->numberOfSources) {continue;}
+
+        instances[instanceCount] = i;
+        vertexStart[instanceCount] = (uint32_t)totalVertices;
+        triangleStart[instanceCount++] = (uint32_t)totalTriangles;
+
+        totalVertices += scene->meshSources[srcIndex].vertexCount;
+        totalTriangles += scene->meshSources[srcIndex].indexCount / 3;
+    }
+
+    // Starts are 32 bit and so are the indices the GPU reads
+    if (totalVertices > UINT32_MAX || totalTriangles * 3 > UINT32_MAX)
+    {
+        fprintf(stderr, "Scene mesh exceeds 32 bit indices, %llu vertices and %llu triangles\n",
+            (unsigned long long)totalVertices, (unsigned long long)totalTriangles);
+        free(instances);
+        free(vertexStart);
+        free(triangleStart);
+        free(bounds);
+        return 0;
+    }
+
+    vertexStart[instanceCount] = (uint32_t)totalVertices;
+    triangleStart[instanceCount] = (uint32_t)totalTriangles;
+
+    combinedMesh->vertices = (GPUPackedVertex*)allocFirstTouch(sizeof(GPUPackedVertex) * (size_t)totalVertices);
+    combinedMesh->indices = (uint32_t*)allocFirstTouch(sizeof(uint32_t) * 3 * (size_t)totalTriangles);
+    combinedMesh->triangleMaterials = (uint32_t*)allocFirstTouch(sizeof(uint32_t) * (size_t)totalTriangles);
+
+    if ((totalVertices > 0 && !combinedMesh->vertices) || (totalTriangles > 0 && (!combinedMesh->indices || !combinedMesh->triangleMaterials)))
+    {
+        fprintf(stderr, "Memory allocation failed for a scene mesh of %llu vertices and %llu triangles\n",
+            (unsigned long long)totalVertices, (unsigned long long)totalTriangles);
+        freeMeshData(combinedMesh);
+        memset(combinedMesh, 0, sizeof(MeshData));
+        free(instances);
+        free(vertexStart);
+        free(triangleStart);
+        free(bounds);
+        return 0;
+    }
+
+    combinedMesh->vertexCount = (uint32_t)totalVertices;
+    combinedMesh->indexCount = (uint32_t)(3 * totalTriangles);
+    combinedMesh->triangleCount = (uint32_t)totalTriangles;
+
+    for (int w = 0; w < workerCount; w++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            bounds[w][a] = INFINITY;
+            bounds[w][a + 3] = -INFINITY;
+        }
+    }
+
+    FlattenJob job = {scene, combinedMesh, instances, vertexStart, triangleStart, instanceCount, bounds};
+    parallelFor((size_t)totalVertices, FLATTEN_GRAIN, flattenVertexRange, &job);
+    parallelFor((size_t)totalTriangles, FLATTEN_GRAIN, flattenTriangleRange, &job);
+
+    // World bounds come out of the transform pass, buildBVH takes them as the root box
+    for (int a = 0; a < 3; a++)
+    {
+        combinedMesh->minBounds[a] = INFINITY;
+        combinedMesh->maxBounds[a] = -INFINITY;
+        for (int w = 0; w < workerCount; w++)
+        {
+            combinedMesh->minBounds[a] = fminf(combinedMesh->minBounds[a], bounds[w][a]);
+            combinedMesh->maxBounds[a] = fmaxf(combinedMesh->maxBounds[a], bounds[w][a + 3]);
+        }
+    }
+
+    free(instances);
+    free(vertexStart);
+    free(triangleStart);
+    free(bounds);
+
+    mergeInstanceTrees(scene, combinedMesh);
+
     return 1;
-}
\ No newline at end of file
+}
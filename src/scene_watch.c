@@ -0,0 +1,228 @@
+#include "scene_watch.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+// Quiet time after the last event before a batch is reported
+#define WATCH_SETTLE_SECONDS 0.2
+
+#define WATCH_POLL_SECONDS 0.5
+
+// A missing file stamps as all zero
+static FileStamp fileStamp(const char* path)
+{
+    FileStamp stamp = {0, 0, 0};
+
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info)) {return stamp;}
+
+    // FILETIME counts 100 ns ticks
+    long long ticks = (long long)info.ftLastWriteTime.dwHighDateTime << 32 | info.ftLastWriteTime.dwLowDateTime;
+    stamp.seconds = ticks / 10000000;
+    stamp.nanoseconds = ticks % 10000000 * 100;
+    stamp.size = (long long)info.nFileSizeHigh << 32 | info.nFileSizeLow;
+#else
+    struct stat info;
+    if (stat(path, &info) != 0) {return stamp;}
+
+    stamp.seconds = (long long)info.st_mtime;
+#ifdef __APPLE__
+    stamp.nanoseconds = (long long)info.st_mtimespec.tv_nsec;
+#else
+    stamp.nanoseconds = (long long)info.st_mtim.tv_nsec;
+#endif
+    stamp.size = (long long)info.st_size;
+#endif
+
+    return stamp;
+}
+
+static int sameStamp(const FileStamp* a, const FileStamp* b)
+{
+    return a->seconds == b->seconds && a->nanoseconds == b->nanoseconds && a->size == b->size;
+}
+
+static const char* baseName(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+#ifdef _WIN32
+    const char* backslash = strrchr(path, '\\');
+    if (backslash && (!slash || backslash > slash)) {slash = backslash;}
+#endif
+    return slash ? slash + 1 : path;
+}
+
+#ifdef __linux__
+static int initNotify(SceneWatch* watch)
+{
+    watch->notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->notifyFd < 0) {return 0;}
+
+    watch->notifyWatches = malloc(sizeof(int) * (watch->count ? watch->count : 1));
+    if (!watch->notifyWatches) {return 0;}
+
+    for (int i = 0; i < watch->count; i++)
+    {
+        const char* name = baseName(watch->paths[i]);
+        char directory[1024];
+        size_t length = (size_t)(name - watch->paths[i]);
+
+        if (length == 0) {strcpy(directory, ".");}
+        else
+        {
+            if (length >= sizeof(directory)) {return 0;}
+            memcpy(directory, watch->paths[i], length);
+            directory[length] = '\0';
+        }
+
+        // Same directory twice hands back the same descriptor
+        watch->notifyWatches[i] = inotify_add_watch(watch->notifyFd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (watch->notifyWatches[i] < 0) {return 0;}
+    }
+
+    return 1;
+}
+
+static void readNotify(SceneWatch* watch)
+{
+    // Aligned for struct inotify_event
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;)
+    {
+        ssize_t length = read(watch->notifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {break;}
+
+        for (char* p = buffer; p < buffer + length;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0) {continue;}
+
+            for (int i = 0; i < watch->count; i++)
+            {
+                if (watch->notifyWatches[i] == event->wd && strcmp(baseName(watch->paths[i]), event->name) == 0)
+                {
+                    watch->changed[i] = 1;
+                    watch->pending = 1;
+                    watch->lastEvent = getTimeSeconds();
+                }
+            }
+        }
+    }
+}
+#endif
+
+static void pollStamps(SceneWatch* watch, double now)
+{
+    if (now - watch->lastPoll < WATCH_POLL_SECONDS) {return;}
+    watch->lastPoll = now;
+
+    for (int i = 0; i < watch->count; i++)
+    {
+        FileStamp stamp = fileStamp(watch->paths[i]);
+        if (sameStamp(&stamp, &watch->stamps[i])) {continue;}
+
+        watch->stamps[i] = stamp;
+        watch->changed[i] = 1;
+        watch->pending = 1;
+        watch->lastEvent = now;
+    }
+}
+
+int initSceneWatch(SceneWatch* watch, WatchMode mode, const char* const* paths, int count)
+{
+    memset(watch, 0, sizeof(SceneWatch));
+    watch->mode = mode;
+    watch->notifyFd = -1;
+
+    size_t slots = count > 0 ? (size_t)count : 1;
+    watch->paths = calloc(slots, sizeof(char*));
+    watch->changed = calloc(slots, sizeof(int));
+    watch->stamps = calloc(slots, sizeof(FileStamp));
+    if (!watch->paths || !watch->changed || !watch->stamps)
+    {
+        freeSceneWatch(watch);
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        watch->paths[i] = strdup(paths[i]);
+        if (!watch->paths[i])
+        {
+            freeSceneWatch(watch);
+            return 0;
+        }
+        watch->count++;
+        watch->stamps[i] = fileStamp(paths[i]);
+    }
+
+#ifdef __linux__
+    if (mode == WATCH_NOTIFY && !initNotify(watch))
+    {
+        fprintf(stderr, "inotify unavailable, polling %d watched file(s)\n", watch->count);
+        if (watch->notifyFd >= 0) {close(watch->notifyFd);}
+        free(watch->notifyWatches);
+        watch->notifyWatches = NULL;
+        watch->notifyFd = -1;
+    }
+#endif
+
+    watch->lastPoll = getTimeSeconds();
+    return 1;
+}
+
+int pollSceneWatch(SceneWatch* watch)
+{
+    if (watch->reported)
+    {
+        memset(watch->changed, 0, sizeof(int) * watch->count);
+        watch->reported = 0;
+    }
+
+    double now = getTimeSeconds();
+
+#ifdef __linux__
+    if (watch->notifyFd >= 0) {readNotify(watch);}
+    else {pollStamps(watch, now);}
+#else
+    pollStamps(watch, now);
+#endif
+
+    if (!watch->pending || now - watch->lastEvent < WATCH_SETTLE_SECONDS) {return 0;}
+
+    watch->pending = 0;
+    watch->reported = 1;
+    return 1;
+}
+
+void freeSceneWatch(SceneWatch* watch)
+{
+#ifdef __linux__
+    if (watch->notifyFd >= 0) {close(watch->notifyFd);}
+#endif
+
+    for (int i = 0; watch->paths && i < watch->count; i++) {free(watch->paths[i]);}
+    free(watch->paths);
+    free(watch->changed);
+    free(watch->stamps);
+    free(watch->notifyWatches);
+
+    memset(watch, 0, sizeof(SceneWatch));
+    watch->notifyFd = -1;
+}
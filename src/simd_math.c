@@ -0,0 +1,265 @@
+#include "simd_math.h"
+
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+Affine3x4 affineFromMat4(const Mat4* m)
+{
+    Affine3x4 a;
+
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 4; c++) {a.m[r][c] = m->m[r][c];}
+    }
+
+    return a;
+}
+
+Affine3x4 affineMultiply(const Affine3x4* a, const Affine3x4* b)
+{
+    Affine3x4 result;
+
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            result.m[r][c] = a->m[r][0] * b->m[0][c] + a->m[r][1] * b->m[1][c] + a->m[r][2] * b->m[2][c];
+        }
+        result.m[r][3] += a->m[r][3];
+    }
+
+    return result;
+}
+
+// Cofactors of the 3x3 part, the adjugate is their transpose
+static float cofactors(const Affine3x4* m, float cof[3][3])
+{
+    for (int r = 0; r < 3; r++)
+    {
+        int r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+        for (int c = 0; c < 3; c++)
+        {
+            int c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+            cof[r][c] = m->m[r1][c1] * m->m[r2][c2] - m->m[r1][c2] * m->m[r2][c1];
+        }
+    }
+
+    return m->m[0][0] * cof[0][0] + m->m[0][1] * cof[0][1] + m->m[0][2] * cof[0][2];
+}
+
+int affineInverse(const Affine3x4* m, Affine3x4* inverse)
+{
+    float cof[3][3];
+    float det = cofactors(m, cof);
+    if (det == 0.0f || !isfinite(det)) {return 0;}
+
+    float invDet = 1.0f / det;
+    Affine3x4 result;
+
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++) {result.m[r][c] = cof[c][r] * invDet;}
+    }
+
+    // x = A^-1 (y - t)
+    for (int r = 0; r < 3; r++)
+    {
+        result.m[r][3] = -(result.m[r][0] * m->m[0][3] + result.m[r][1] * m->m[1][3] + result.m[r][2] * m->m[2][3]);
+    }
+
+    *inverse = result;
+    return 1;
+}
+
+int affineNormalMatrix(const Affine3x4* m, Affine3x4* normal)
+{
+    float cof[3][3];
+    float det = cofactors(m, cof);
+    if (det == 0.0f || !isfinite(det)) {return 0;}
+
+    // (A^-1)^T is the cofactor matrix over the determinant
+    float invDet = 1.0f / det;
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++) {normal->m[r][c] = cof[r][c] * invDet;}
+        normal->m[r][3] = 0.0f;
+    }
+
+    return 1;
+}
+
+// Same picks as minps and maxps, NaN and equal inputs give the second
+static inline float minFloat(float a, float b) {return a < b ? a : b;}
+static inline float maxFloat(float a, float b) {return a > b ? a : b;}
+
+// Sums run ((m0 x + m1 y) + m2 z) + m3 like matrixMultiplyVec4, so every
+// version here matches it and each other to the bit
+static void transformScalar(const Affine3x4* m, const float* in, float* out, size_t count, int translate, float* minBounds, float* maxBounds)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const float p[3] = {in[4 * i], in[4 * i + 1], in[4 * i + 2]};
+        float* q = &out[4 * i];
+
+        for (int r = 0; r < 3; r++)
+        {
+            q[r] = m->m[r][0] * p[0] + m->m[r][1] * p[1] + m->m[r][2] * p[2];
+            if (translate) {q[r] += m->m[r][3];}
+        }
+        q[3] = 0.0f;
+
+        for (int a = 0; minBounds && a < 3; a++)
+        {
+            minBounds[a] = minFloat(minBounds[a], q[a]);
+            maxBounds[a] = maxFloat(maxBounds[a], q[a]);
+        }
+    }
+}
+
+#ifdef __SSE2__
+// Four elements per step, transposed to x, y, z registers and back
+static size_t transformSSE(const Affine3x4* m, const float* in, float* out, size_t count, int translate, float* minBounds, float* maxBounds)
+{
+    __m128 row[3][4];
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 4; c++) {row[r][c] = _mm_set1_ps(m->m[r][c]);}
+    }
+
+    __m128 lo[3], hi[3];
+    for (int a = 0; a < 3; a++)
+    {
+        lo[a] = _mm_set1_ps(minBounds ? minBounds[a] : INFINITY);
+        hi[a] = _mm_set1_ps(maxBounds ? maxBounds[a] : -INFINITY);
+    }
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&in[4 * i]);
+        __m128 y = _mm_loadu_ps(&in[4 * i + 4]);
+        __m128 z = _mm_loadu_ps(&in[4 * i + 8]);
+        __m128 w = _mm_loadu_ps(&in[4 * i + 12]);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        __m128 p[4];
+        for (int r = 0; r < 3; r++)
+        {
+            p[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(row[r][0], x), _mm_mul_ps(row[r][1], y)), _mm_mul_ps(row[r][2], z));
+            if (translate) {p[r] = _mm_add_ps(p[r], row[r][3]);}
+            lo[r] = _mm_min_ps(lo[r], p[r]);
+            hi[r] = _mm_max_ps(hi[r], p[r]);
+        }
+        p[3] = _mm_setzero_ps();
+
+        _MM_TRANSPOSE4_PS(p[0], p[1], p[2], p[3]);
+        _mm_storeu_ps(&out[4 * i], p[0]);
+        _mm_storeu_ps(&out[4 * i + 4], p[1]);
+        _mm_storeu_ps(&out[4 * i + 8], p[2]);
+        _mm_storeu_ps(&out[4 * i + 12], p[3]);
+    }
+
+    for (int a = 0; minBounds && a < 3; a++)
+    {
+        float lanes[4];
+        _mm_storeu_ps(lanes, lo[a]);
+        minBounds[a] = minFloat(minFloat(lanes[0], lanes[1]), minFloat(lanes[2], lanes[3]));
+        _mm_storeu_ps(lanes, hi[a]);
+        maxBounds[a] = maxFloat(maxFloat(lanes[0], lanes[1]), maxFloat(lanes[2], lanes[3]));
+    }
+
+    return i;
+}
+#endif
+
+void transformPoints(const Affine3x4* m, const float* in, float* out, size_t count, float* minBounds, float* maxBounds)
+{
+    size_t done = 0;
+#ifdef __SSE2__
+    done = transformSSE(m, in, out, count, 1, minBounds, maxBounds);
+#endif
+    transformScalar(m, in + 4 * done, out + 4 * done, count - done, 1, minBounds, maxBounds);
+}
+
+void transformPointsScalar(const Affine3x4* m, const float* in, float* out, size_t count, float* minBounds, float* maxBounds)
+{
+    transformScalar(m, in, out, count, 1, minBounds, maxBounds);
+}
+
+void transformVectors(const Affine3x4* m, const float* in, float* out, size_t count)
+{
+    size_t done = 0;
+#ifdef __SSE2__
+    done = transformSSE(m, in, out, count, 0, NULL, NULL);
+#endif
+    transformScalar(m, in + 4 * done, out + 4 * done, count - done, 0, NULL, NULL);
+}
+
+void transformVectorsScalar(const Affine3x4* m, const float* in, float* out, size_t count)
+{
+    transformScalar(m, in, out, count, 0, NULL, NULL);
+}
+
+void transformBoxesScalar(const Affine3x4* m, const AABB* in, AABB* out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        AABB box = in[i];
+
+        for (int r = 0; r < 3; r++)
+        {
+            float lo[3], hi[3];
+            for (int c = 0; c < 3; c++)
+            {
+                float a = m->m[r][c] * box.min[c];
+                float b = m->m[r][c] * box.max[c];
+                lo[c] = minFloat(a, b);
+                hi[c] = maxFloat(a, b);
+            }
+
+            out[i].min[r] = lo[0] + lo[1] + lo[2] + m->m[r][3];
+            out[i].max[r] = hi[0] + hi[1] + hi[2] + m->m[r][3];
+        }
+    }
+}
+
+void transformBoxes(const Affine3x4* m, const AABB* in, AABB* out, size_t count)
+{
+#ifdef __SSE2__
+    // Matrix columns, one box per step with x, y, z in the lanes
+    __m128 column[4];
+    for (int c = 0; c < 4; c++) {column[c] = _mm_set_ps(0.0f, m->m[2][c], m->m[1][c], m->m[0][c]);}
+
+    for (size_t i = 0; i < count; i++)
+    {
+        __m128 a = _mm_mul_ps(column[0], _mm_set1_ps(in[i].min[0]));
+        __m128 b = _mm_mul_ps(column[0], _mm_set1_ps(in[i].max[0]));
+        __m128 lo = _mm_min_ps(a, b);
+        __m128 hi = _mm_max_ps(a, b);
+
+        for (int c = 1; c < 3; c++)
+        {
+            a = _mm_mul_ps(column[c], _mm_set1_ps(in[i].min[c]));
+            b = _mm_mul_ps(column[c], _mm_set1_ps(in[i].max[c]));
+            lo = _mm_add_ps(lo, _mm_min_ps(a, b));
+            hi = _mm_add_ps(hi, _mm_max_ps(a, b));
+        }
+        lo = _mm_add_ps(lo, column[3]);
+        hi = _mm_add_ps(hi, column[3]);
+
+        float lanes[8];
+        _mm_storeu_ps(lanes, lo);
+        _mm_storeu_ps(lanes + 4, hi);
+        for (int a = 0; a < 3; a++)
+        {
+            out[i].min[a] = lanes[a];
+            out[i].max[a] = lanes[4 + a];
+        }
+    }
+#else
+    transformBoxesScalar(m, in, out, count);
+#endif
+}
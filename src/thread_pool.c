@@ -0,0 +1,435 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#define MAX_WORKERS 256
+#define MAX_NODES 64
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef HANDLE PoolThread;
+typedef CRITICAL_SECTION PoolMutex;
+typedef CONDITION_VARIABLE PoolCond;
+
+#define mutexInit(m) InitializeCriticalSection(m)
+#define mutexDestroy(m) DeleteCriticalSection(m)
+#define mutexLock(m) EnterCriticalSection(m)
+#define mutexUnlock(m) LeaveCriticalSection(m)
+#define condInit(c) InitializeConditionVariable(c)
+#define condDestroy(c) ((void)(c))
+#define condWait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define condBroadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+typedef pthread_t PoolThread;
+typedef pthread_mutex_t PoolMutex;
+typedef pthread_cond_t PoolCond;
+
+#define mutexInit(m) pthread_mutex_init(m, NULL)
+#define mutexDestroy(m) pthread_mutex_destroy(m)
+#define mutexLock(m) pthread_mutex_lock(m)
+#define mutexUnlock(m) pthread_mutex_unlock(m)
+#define condInit(c) pthread_cond_init(c, NULL)
+#define condDestroy(c) pthread_cond_destroy(c)
+#define condWait(c, m) pthread_cond_wait(c, m)
+#define condBroadcast(c) pthread_cond_broadcast(c)
+#endif
+
+typedef struct
+{
+    ParallelTask task;
+    void* context;
+    size_t count;
+    size_t grain;
+    atomic_size_t next;
+    atomic_int pending;
+} PoolJob;
+
+typedef struct
+{
+    int running;
+    int size;
+    int nodeCount;
+
+    PoolThread threads[MAX_WORKERS];
+    int workerCpu[MAX_WORKERS];
+
+    PoolMutex mutex;
+    PoolCond wake;
+    PoolCond done;
+    PoolMutex submitMutex;
+
+    unsigned long generation;
+    int stop;
+    PoolJob job;
+} ThreadPool;
+
+static ThreadPool g_pool;
+
+// Worker index while inside a task, nested parallelFor runs inline
+static _Thread_local int t_workerIndex = -1;
+
+typedef struct
+{
+    int cpus[MAX_WORKERS];
+    int cpuCount;
+} NodeCpus;
+
+#ifdef _WIN32
+static int discoverTopology(NodeCpus* nodes)
+{
+    ULONG highestNode = 0;
+    if (!GetNumaHighestNodeNumber(&highestNode)) {highestNode = 0;}
+
+    int nodeCount = 0;
+    for (ULONG n = 0; n <= highestNode && nodeCount < MAX_NODES; n++)
+    {
+        ULONGLONG mask = 0;
+        if (!GetNumaNodeProcessorMask((UCHAR)n, &mask) || mask == 0) {continue;}
+
+        NodeCpus* node = &nodes[nodeCount++];
+        node->cpuCount = 0;
+
+        for (int cpu = 0; cpu < 64 && node->cpuCount < MAX_WORKERS; cpu++)
+        {
+            if (mask & (1ULL << cpu)) {node->cpus[node->cpuCount++] = cpu;}
+        }
+    }
+
+    if (nodeCount == 0)
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+
+        nodes[0].cpuCount = 0;
+        for (DWORD cpu = 0; cpu < info.dwNumberOfProcessors && cpu < MAX_WORKERS; cpu++)
+        {
+            nodes[0].cpus[nodes[0].cpuCount++] = (int)cpu;
+        }
+        nodeCount = 1;
+    }
+
+    return nodeCount;
+}
+
+static void pinThread(PoolThread thread, int cpu)
+{
+    if (cpu >= 0 && cpu < 64) {SetThreadAffinityMask(thread, (DWORD_PTR)1 << cpu);}
+}
+#else
+// Parses sysfs cpulist ranges like "0-7,16-23"
+static void parseCpuList(const char* list, NodeCpus* node, const cpu_set_t* allowed)
+{
+    const char* p = list;
+
+    while (*p)
+    {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p) {break;}
+
+        long last = first;
+        p = end;
+
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+
+        for (long cpu = first; cpu <= last && node->cpuCount < MAX_WORKERS; cpu++)
+        {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, allowed)) {node->cpus[node->cpuCount++] = (int)cpu;}
+        }
+
+        if (*p == ',') {p++;}
+        else if (*p != '\0') {break;}
+    }
+}
+
+static int discoverTopology(NodeCpus* nodes)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long cpu = 0; cpu < online && cpu < CPU_SETSIZE; cpu++) {CPU_SET(cpu, &allowed);}
+    }
+
+    int nodeCount = 0;
+    for (int n = 0; n < MAX_NODES; n++)
+    {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+
+        FILE* file = fopen(path, "r");
+        if (!file) {continue;}
+
+        char list[1024] = {0};
+        if (fgets(list, sizeof(list), file))
+        {
+            NodeCpus* node = &nodes[nodeCount];
+            node->cpuCount = 0;
+            parseCpuList(list, node, &allowed);
+
+            if (node->cpuCount > 0) {nodeCount++;}
+        }
+        fclose(file);
+    }
+
+    // No sysfs NUMA info, one node with every allowed CPU
+    if (nodeCount == 0)
+    {
+        nodes[0].cpuCount = 0;
+        for (int cpu = 0; cpu < CPU_SETSIZE && nodes[0].cpuCount < MAX_WORKERS; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed)) {nodes[0].cpus[nodes[0].cpuCount++] = cpu;}
+        }
+        if (nodes[0].cpuCount == 0) {nodes[0].cpus[nodes[0].cpuCount++] = 0;}
+        nodeCount = 1;
+    }
+
+    return nodeCount;
+}
+
+static void pinThread(PoolThread thread, int cpu)
+{
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {return;}
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+#endif
+
+static void runJob(PoolJob* job, int worker, int workerCount)
+{
+    if (job->grain == 0)
+    {
+        size_t begin = job->count * worker / workerCount;
+        size_t end = job->count * (worker + 1) / workerCount;
+
+        if (begin < end) {job->task(job->context, begin, end, worker);}
+        return;
+    }
+
+    for (;;)
+    {
+        size_t begin = atomic_fetch_add(&job->next, job->grain);
+        if (begin >= job->count) {break;}
+
+        size_t end = begin + job->grain;
+        if (end > job->count) {end = job->count;}
+
+        job->task(job->context, begin, end, worker);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI workerMain(LPVOID param)
+#else
+static void* workerMain(void* param)
+#endif
+{
+    int worker = (int)(size_t)param;
+    unsigned long seen = 0;
+
+    t_workerIndex = worker;
+
+    for (;;)
+    {
+        mutexLock(&g_pool.mutex);
+        while (!g_pool.stop && g_pool.generation == seen) {condWait(&g_pool.wake, &g_pool.mutex);}
+        seen = g_pool.generation;
+        int stop = g_pool.stop;
+        mutexUnlock(&g_pool.mutex);
+
+        if (stop) {break;}
+
+        runJob(&g_pool.job, worker, g_pool.size);
+
+        if (atomic_fetch_sub(&g_pool.job.pending, 1) == 1)
+        {
+            mutexLock(&g_pool.mutex);
+            condBroadcast(&g_pool.done);
+            mutexUnlock(&g_pool.mutex);
+        }
+    }
+
+    return 0;
+}
+
+// Joins the first started workers and destroys the sync objects, shared by
+// shutdown and a failed init so neither leaks them
+static void stopWorkers(int started)
+{
+    mutexLock(&g_pool.mutex);
+    g_pool.stop = 1;
+    condBroadcast(&g_pool.wake);
+    mutexUnlock(&g_pool.mutex);
+
+    for (int w = 0; w < started; w++)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(g_pool.threads[w], INFINITE);
+        CloseHandle(g_pool.threads[w]);
+#else
+        pthread_join(g_pool.threads[w], NULL);
+#endif
+    }
+
+    mutexDestroy(&g_pool.mutex);
+    mutexDestroy(&g_pool.submitMutex);
+    condDestroy(&g_pool.wake);
+    condDestroy(&g_pool.done);
+
+    g_pool.running = 0;
+}
+
+int threadPoolInit(const ThreadPoolConfig* config)
+{
+    if (g_pool.running) {return 1;}
+
+    static NodeCpus nodes[MAX_NODES];
+    int nodeCount = discoverTopology(nodes);
+
+    // CPU order for worker placement
+    int order[MAX_WORKERS];
+    int orderCount = 0;
+
+    if (config->pinning == PIN_SCATTER)
+    {
+        for (int i = 0; orderCount < MAX_WORKERS; i++)
+        {
+            int added = 0;
+            for (int n = 0; n < nodeCount && orderCount < MAX_WORKERS; n++)
+            {
+                if (i < nodes[n].cpuCount) {order[orderCount++] = nodes[n].cpus[i]; added = 1;}
+            }
+            if (!added) {break;}
+        }
+    }
+    else
+    {
+        for (int n = 0; n < nodeCount; n++)
+        {
+            for (int i = 0; i < nodes[n].cpuCount && orderCount < MAX_WORKERS; i++) {order[orderCount++] = nodes[n].cpus[i];}
+        }
+    }
+
+    int size = config->threadCount > 0 ? config->threadCount : orderCount;
+    if (size > MAX_WORKERS) {size = MAX_WORKERS;}
+    if (size < 1) {size = 1;}
+
+    memset(&g_pool, 0, sizeof(g_pool));
+    g_pool.size = size;
+    g_pool.nodeCount = nodeCount;
+
+    mutexInit(&g_pool.mutex);
+    mutexInit(&g_pool.submitMutex);
+    condInit(&g_pool.wake);
+    condInit(&g_pool.done);
+
+    for (int w = 0; w < size; w++)
+    {
+        g_pool.workerCpu[w] = (config->pinning == PIN_NONE) ? -1 : order[w % orderCount];
+
+#ifdef _WIN32
+        g_pool.threads[w] = CreateThread(NULL, 0, workerMain, (LPVOID)(size_t)w, 0, NULL);
+        int failed = g_pool.threads[w] == NULL;
+#else
+        int failed = pthread_create(&g_pool.threads[w], NULL, workerMain, (void*)(size_t)w) != 0;
+#endif
+        if (failed)
+        {
+            fprintf(stderr, "Failed to start worker thread %d\n", w);
+            stopWorkers(w);
+            return 0;
+        }
+
+        pinThread(g_pool.threads[w], g_pool.workerCpu[w]);
+    }
+
+    g_pool.running = 1;
+
+    const char* policyNames[] = {"none", "compact", "scatter"};
+    printf("Thread pool: %d workers, %d NUMA node(s), pinning %s\n", size, nodeCount, policyNames[config->pinning]);
+
+    return 1;
+}
+
+void threadPoolShutdown(void)
+{
+    if (!g_pool.running) {return;}
+    stopWorkers(g_pool.size);
+}
+
+int threadPoolSize(void)
+{
+    return g_pool.running ? g_pool.size : 1;
+}
+
+int threadPoolNodeCount(void)
+{
+    return g_pool.running ? g_pool.nodeCount : 1;
+}
+
+void parallelFor(size_t count, size_t grain, ParallelTask task, void* context)
+{
+    if (count == 0) {return;}
+
+    // No pool, single worker or already on a worker: run inline
+    if (!g_pool.running || g_pool.size == 1 || t_workerIndex >= 0)
+    {
+        task(context, 0, count, t_workerIndex >= 0 ? t_workerIndex : 0);
+        return;
+    }
+
+    // Jobs from different caller threads run one after another
+    mutexLock(&g_pool.submitMutex);
+
+    mutexLock(&g_pool.mutex);
+    g_pool.job.task = task;
+    g_pool.job.context = context;
+    g_pool.job.count = count;
+    g_pool.job.grain = grain;
+    atomic_store(&g_pool.job.next, 0);
+    atomic_store(&g_pool.job.pending, g_pool.size);
+    g_pool.generation++;
+    condBroadcast(&g_pool.wake);
+
+    while (atomic_load(&g_pool.job.pending) > 0) {condWait(&g_pool.done, &g_pool.mutex);}
+    mutexUnlock(&g_pool.mutex);
+
+    mutexUnlock(&g_pool.submitMutex);
+}
+
+static void touchPages(void* context, size_t begin, size_t end, int worker)
+{
+    memset((char*)context + begin, 0, end - begin);
+}
+
+void* allocFirstTouch(size_t bytes)
+{
+    void* memory = malloc(bytes);
+    if (!memory) {return NULL;}
+
+    // Same static split as parallelFor with grain 0
+    parallelFor(bytes, 0, touchPages, memory);
+
+    return memory;
+}
@@ -0,0 +1,231 @@
+#include "triangle.h"
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+typedef struct 
+{
+    const MeshData* mesh;
+    void* output;
+} TriangleBuildJob;
+
+static void precomputeTriangleRange(void* context, size_t begin, size_t end, int worker)
+{
+    const MeshData* mesh = ((TriangleBuildJob*)context)->mesh;
+    PrecomputedTriangle* triangles = ((TriangleBuildJob*)context)->output;
+
+    for (size_t t = begin; t < end; t++)
+    {
+        const GPUPackedVertex* v0 = &mesh->vertices[mesh->indices[t * 3 + 0]];
+        const GPUPackedVertex* v1 = &mesh->vertices[mesh->indices[t * 3 + 1]];
+        const GPUPackedVertex* v2 = &mesh->vertices[mesh->indices[t * 3 + 2]];
+
+        PrecomputedTriangle* tri = &triangles[t];
+
+        tri->v0[0] = v0->x; tri->v0[1] = v0->y; tri->v0[2] = v0->z;
+        tri->v1[0] = v1->x; tri->v1[1] = v1->y; tri->v1[2] = v1->z;
+        tri->v2[0] = v2->x; tri->v2[1] = v2->y; tri->v2[2] = v2->z;
+        tri->pad0 = tri->pad1 = tri->pad2 = 1.0f;
+    }
+}
+
+PrecomputedTriangle* buildPrecomputedTriangles(const MeshData* mesh)
+{
+    PrecomputedTriangle* triangles = allocFirstTouch(sizeof(PrecomputedTriangle) * mesh->triangleCount);
+    if (!triangles)
+    {
+        fprintf(stderr, "Memory allocation for precomputed triangles failed\n");
+        return NULL;
+    }
+
+    TriangleBuildJob job = {mesh, triangles};
+    parallelFor(mesh->triangleCount, 0, precomputeTriangleRange, &job);
+
+    return triangles;
+}
+
+static int16_t packSnorm16(float v)
+{
+    if (v > 1.0f) {v = 1.0f;}
+    if (v < -1.0f) {v = -1.0f;}
+
+    return (int16_t)roundf(v * 32767.0f);
+}
+
+// Matches unpackSnorm2x16 + octahedral unfold in raytrace.comp
+uint32_t packOctNormal(const float* n)
+{
+    float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    // Degenerate triangle, decodes to +z
+    if (l1 == 0.0f) {return 0u;}
+
+    float x = n[0] / l1;
+    float y = n[1] / l1;
+
+    // Fold lower hemisphere over the diagonals
+    if (n[2] < 0.0f)
+    {
+        float foldX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldX;
+        y = foldY;
+    }
+
+    return (uint32_t)(uint16_t)packSnorm16(x) | ((uint32_t)(uint16_t)packSnorm16(y) << 16);
+}
+
+static void triangleNormalRange(void* context, size_t begin, size_t end, int worker)
+{
+    const MeshData* mesh = ((TriangleBuildJob*)context)->mesh;
+    uint32_t* normals = ((TriangleBuildJob*)context)->output;
+
+    for (size_t t = begin; t < end; t++)
+    {
+        const GPUPackedVertex* v0 = &mesh->vertices[mesh->indices[t * 3 + 0]];
+        const GPUPackedVertex* v1 = &mesh->vertices[mesh->indices[t * 3 + 1]];
+        const GPUPackedVertex* v2 = &mesh->vertices[mesh->indices[t * 3 + 2]];
+
+        float edge1[3] = {v1->x - v0->x, v1->y - v0->y, v1->z - v0->z};
+        float edge2[3] = {v2->x - v0->x, v2->y - v0->y, v2->z - v0->z};
+
+        float n[3] = 
+        {
+            edge1[1] * edge2[2] - edge1[2] * edge2[1],
+            edge1[2] * edge2[0] - edge1[0] * edge2[2],
+            edge1[0] * edge2[1] - edge1[1] * edge2[0]
+        };
+
+        normals[t] = packOctNormal(n);
+    }
+}
+
+uint32_t* buildTriangleNormals(const MeshData* mesh)
+{
+    uint32_t* normals = allocFirstTouch(sizeof(uint32_t) * mesh->triangleCount);
+    if (!normals)
+    {
+        fprintf(stderr, "Memory allocation for triangle normals failed\n");
+        return NULL;
+    }
+
+    TriangleBuildJob job = {mesh, normals};
+    parallelFor(mesh->triangleCount, 0, triangleNormalRange, &job);
+
+    return normals;
+}
+
+void setupWatertightRay(const float* rd, WatertightRay* ray)
+{
+    float ax = fabsf(rd[0]);
+    float ay = fabsf(rd[1]);
+    float az = fabsf(rd[2]);
+
+    // Dominant axis becomes z
+    int kz = (ax > ay) ? ((ax > az) ? 0 : 2) : ((ay > az) ? 1 : 2);
+    int kx = (kz + 1) % 3;
+    int ky = (kx + 1) % 3;
+
+    // Keep winding when the ray points down the dominant axis
+    if (rd[kz] < 0.0f)
+    {
+        int temp = kx;
+        kx = ky;
+        ky = temp;
+    }
+
+    ray->kx = kx;
+    ray->ky = ky;
+    ray->kz = kz;
+
+    ray->sx = rd[kx] / rd[kz];
+    ray->sy = rd[ky] / rd[kz];
+    ray->sz = 1.0f / rd[kz];
+}
+
+float hitTriangleIndexed(const MeshData* mesh, uint32_t triIdx, const float* ro, const float* rd)
+{
+    const GPUPackedVertex* p0 = &mesh->vertices[mesh->indices[3 * triIdx + 0]];
+    const GPUPackedVertex* p1 = &mesh->vertices[mesh->indices[3 * triIdx + 1]];
+    const GPUPackedVertex* p2 = &mesh->vertices[mesh->indices[3 * triIdx + 2]];
+
+    float edge1[3] = {p1->x - p0->x, p1->y - p0->y, p1->z - p0->z};
+    float edge2[3] = {p2->x - p0->x, p2->y - p0->y, p2->z - p0->z};
+
+    float h[3] = 
+    {
+        rd[1] * edge2[2] - rd[2] * edge2[1],
+        rd[2] * edge2[0] - rd[0] * edge2[2],
+        rd[0] * edge2[1] - rd[1] * edge2[0]
+    };
+    float a = edge1[0] * h[0] + edge1[1] * h[1] + edge1[2] * h[2];
+
+    // Check parallel
+    if (fabsf(a) < 0.00001f) {return -1.0f;}
+
+    float f = 1.0f / a;
+    float s[3] = {ro[0] - p0->x, ro[1] - p0->y, ro[2] - p0->z};
+    float u = f * (s[0] * h[0] + s[1] * h[1] + s[2] * h[2]);
+
+    if (u < 0.0f || u > 1.0f) {return -1.0f;}
+
+    float q[3] = 
+    {
+        s[1] * edge1[2] - s[2] * edge1[1],
+        s[2] * edge1[0] - s[0] * edge1[2],
+        s[0] * edge1[1] - s[1] * edge1[0]
+    };
+    float v = f * (rd[0] * q[0] + rd[1] * q[1] + rd[2] * q[2]);
+
+    if (v < 0.0f || u + v > 1.0f) {return -1.0f;}
+
+    float t = f * (edge2[0] * q[0] + edge2[1] * q[1] + edge2[2] * q[2]);
+
+    return (t > 0.001f) ? t : -1.0f;
+}
+
+float hitTriangleWatertight(const PrecomputedTriangle* tri, const float* ro, const WatertightRay* ray, float* bary)
+{
+    int kx = ray->kx;
+    int ky = ray->ky;
+    int kz = ray->kz;
+
+    // Vertices relative to ray origin
+    float a[3] = {tri->v0[0] - ro[0], tri->v0[1] - ro[1], tri->v0[2] - ro[2]};
+    float b[3] = {tri->v1[0] - ro[0], tri->v1[1] - ro[1], tri->v1[2] - ro[2]};
+    float c[3] = {tri->v2[0] - ro[0], tri->v2[1] - ro[1], tri->v2[2] - ro[2]};
+
+    // Shear into ray space
+    float ax = a[kx] - ray->sx * a[kz];
+    float ay = a[ky] - ray->sy * a[kz];
+    float bx = b[kx] - ray->sx * b[kz];
+    float by = b[ky] - ray->sy * b[kz];
+    float cx = c[kx] - ray->sx * c[kz];
+    float cy = c[ky] - ray->sy * c[kz];
+
+    // Scaled barycentrics, edges count as inside for both neighbours
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) {return -1.0f;}
+
+    float det = u + v + w;
+    if (det == 0.0f) {return -1.0f;}
+
+    float az = ray->sz * a[kz];
+    float bz = ray->sz * b[kz];
+    float cz = ray->sz * c[kz];
+
+    float invDet = 1.0f / det;
+    float t = (u * az + v * bz + w * cz) * invDet;
+
+    if (bary)
+    {
+        bary[0] = v * invDet;
+        bary[1] = w * invDet;
+    }
+
+    return (t > 0.001f) ? t : -1.0f;
+}
@@ -0,0 +1,161 @@
+#include "vertex_quant.h"
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+typedef struct
+{
+    const MeshData* mesh;
+    const QuantizationFrame* frame;
+    QuantizedVertex* output;
+} QuantizeJob;
+
+void initQuantizationFrame(QuantizationFrame* frame, const float* minBounds, const float* maxBounds)
+{
+    float worstStep = 0.0f;
+
+    for (int a = 0; a < 3; a++)
+    {
+        frame->origin[a] = minBounds[a];
+        frame->step[a] = (maxBounds[a] - minBounds[a]) / (float)QUANT_MAX;
+        if (frame->step[a] > worstStep) {worstStep = frame->step[a];}
+    }
+
+    // Rounding error only, the measured error in quantizeMesh is authoritative
+    frame->maxError = worstStep * 0.5f;
+}
+
+static uint32_t quantizeAxis(const QuantizationFrame* frame, const float* p, int a)
+{
+    if (frame->step[a] <= 0.0f) {return 0u;}
+
+    float q = roundf((p[a] - frame->origin[a]) / frame->step[a]);
+    if (q < 0.0f) {q = 0.0f;}
+    if (q > (float)QUANT_MAX) {q = (float)QUANT_MAX;}
+
+    return (uint32_t)q;
+}
+
+QuantizedVertex quantizeVertex(const QuantizationFrame* frame, const float* p)
+{
+    uint32_t x = quantizeAxis(frame, p, 0);
+    uint32_t y = quantizeAxis(frame, p, 1);
+    uint32_t z = quantizeAxis(frame, p, 2);
+
+    QuantizedVertex q;
+    q.lo = x | (y << 21);
+    q.hi = (y >> 11) | (z << 10);
+
+    return q;
+}
+
+// Same arithmetic as fetchVertex in raytrace.comp
+void dequantizeVertex(const QuantizationFrame* frame, QuantizedVertex q, float* p)
+{
+    uint32_t x = q.lo & QUANT_MAX;
+    uint32_t y = (q.lo >> 21) | ((q.hi & 0x3FFu) << 11);
+    uint32_t z = (q.hi >> 10) & QUANT_MAX;
+
+    p[0] = frame->origin[0] + (float)x * frame->step[0];
+    p[1] = frame->origin[1] + (float)y * frame->step[1];
+    p[2] = frame->origin[2] + (float)z * frame->step[2];
+}
+
+static void quantizeRange(void* context, size_t begin, size_t end, int worker)
+{
+    QuantizeJob* job = context;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        const GPUPackedVertex* v = &job->mesh->vertices[i];
+        float p[3] = {v->x, v->y, v->z};
+        job->output[i] = quantizeVertex(job->frame, p);
+    }
+}
+
+static float shortestEdge(const MeshData* mesh)
+{
+    float shortest = INFINITY;
+
+    for (uint32_t t = 0; t < mesh->triangleCount; t++)
+    {
+        for (int e = 0; e < 3; e++)
+        {
+            const GPUPackedVertex* a = &mesh->vertices[mesh->indices[t * 3 + e]];
+            const GPUPackedVertex* b = &mesh->vertices[mesh->indices[t * 3 + (e + 1) % 3]];
+
+            float dx = a->x - b->x;
+            float dy = a->y - b->y;
+            float dz = a->z - b->z;
+            float length = sqrtf(dx * dx + dy * dy + dz * dz);
+
+            // Degenerate edges stay degenerate, they do not constrain anything
+            if (length > 0.0f && length < shortest) {shortest = length;}
+        }
+    }
+
+    return shortest;
+}
+
+QuantizedVertex* quantizeMesh(const MeshData* mesh, QuantizationFrame* frame)
+{
+    if (mesh->vertexCount == 0) {return NULL;}
+
+    float minBounds[3] = {INFINITY, INFINITY, INFINITY};
+    float maxBounds[3] = {-INFINITY, -INFINITY, -INFINITY};
+
+    for (uint32_t i = 0; i < mesh->vertexCount; i++)
+    {
+        const float p[3] = {mesh->vertices[i].x, mesh->vertices[i].y, mesh->vertices[i].z};
+        for (int a = 0; a < 3; a++)
+        {
+            if (p[a] < minBounds[a]) {minBounds[a] = p[a];}
+            if (p[a] > maxBounds[a]) {maxBounds[a] = p[a];}
+        }
+    }
+
+    initQuantizationFrame(frame, minBounds, maxBounds);
+
+    QuantizedVertex* quantized = allocFirstTouch(sizeof(QuantizedVertex) * mesh->vertexCount);
+    if (!quantized)
+    {
+        fprintf(stderr, "Memory allocation for quantized vertices failed\n");
+        return NULL;
+    }
+
+    QuantizeJob job = {mesh, frame, quantized};
+    parallelFor(mesh->vertexCount, 0, quantizeRange, &job);
+
+    // Measure instead of trusting step / 2, float decode adds its own rounding
+    float maxError = 0.0f;
+    for (uint32_t i = 0; i < mesh->vertexCount; i++)
+    {
+        const float p[3] = {mesh->vertices[i].x, mesh->vertices[i].y, mesh->vertices[i].z};
+        float decoded[3];
+        dequantizeVertex(frame, quantized[i], decoded);
+
+        for (int a = 0; a < 3; a++)
+        {
+            float error = fabsf(decoded[a] - p[a]);
+            if (error > maxError) {maxError = error;}
+        }
+    }
+    frame->maxError = maxError;
+
+    float edge = shortestEdge(mesh);
+    if (maxError > edge * QUANT_MAX_EDGE_ERROR)
+    {
+        printf("Vertex quantization skipped: error %g exceeds %g (shortest edge %g), keeping float vertices\n",
+            maxError, edge * QUANT_MAX_EDGE_ERROR, edge);
+        free(quantized);
+        return NULL;
+    }
+
+    printf("Quantized %u vertices to %d bits: max error %g, %.1f -> %.1f MB\n", mesh->vertexCount, QUANT_BITS, maxError,
+        sizeof(GPUPackedVertex) * (double)mesh->vertexCount / (1024.0 * 1024.0),
+        sizeof(QuantizedVertex) * (double)mesh->vertexCount / (1024.0 * 1024.0));
+
+    return quantized;
+}
@@ -0,0 +1,232 @@
+// Copyright (c) 2026 Henri Paasonen - GPLv2
+// See LICENSE for details
+
+// Incoherent single ray throughput of the binary BVH against the BVH8 kernel,
+// plus the binary BVH over quantized vertices when the mesh allows it.
+// Usage: glt-bench-bvh8 [model.obj | scenes/x.scene ...]
+// Defaults to bunny.obj, cessna.obj and city.scene
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "obj_loader.h"
+#include "scene_loader.h"
+#include "bvh.h"
+#include "bvh8.h"
+#include "cpu_trace.h"
+#include "triangle.h"
+#include "vertex_quant.h"
+#include "thread_pool.h"
+#include "config.h"
+#include "timer.h"
+
+#define RAY_COUNT 1000000
+#define RAY_GRAIN 1024
+
+typedef struct 
+{
+    float ro[3];
+    float rd[3];
+} BenchRay;
+
+typedef struct 
+{
+    const BVH8* wide;
+    const BenchRay* rays;
+    RayHit* hits;
+} TraceJob;
+
+static uint32_t g_rngState = 12345u;
+
+static float randomFloat(void)
+{
+    g_rngState = g_rngState * 747796405u + 2891336453u;
+    uint32_t word = ((g_rngState >> ((g_rngState >> 28u) + 4u)) ^ g_rngState) * 277803737u;
+    return (float)(((word >> 22u) ^ word) * 2.3283064365386963e-10);
+}
+
+// Origins inside the scene bounds, uniform directions
+static void generateRays(const BVHNode* root, BenchRay* rays, int rayCount)
+{
+    for (int i = 0; i < rayCount; i++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            rays[i].ro[a] = root->aabbMin[a] + randomFloat() * (root->aabbMax[a] - root->aabbMin[a]);
+        }
+
+        float theta = randomFloat() * 6.2831853f;
+        float z = randomFloat() * 2.0f - 1.0f;
+        float r = sqrtf(1.0f - z * z);
+
+        rays[i].rd[0] = r * cosf(theta);
+        rays[i].rd[1] = r * sinf(theta);
+        rays[i].rd[2] = z;
+    }
+}
+
+static void resetHits(RayHit* hits, int rayCount)
+{
+    for (int i = 0; i < rayCount; i++)
+    {
+        hits[i].t = 1e30f;
+        hits[i].triIndex = NO_HIT;
+    }
+}
+
+static void traceRange(void* context, size_t begin, size_t end, int worker)
+{
+    TraceJob* job = context;
+
+    for (size_t i = begin; i < end; i++) {traceBVH8(job->wide, job->rays[i].ro, job->rays[i].rd, &job->hits[i]);}
+}
+
+static int loadBenchMesh(const char* path, MeshData* mesh)
+{
+    size_t length = strlen(path);
+
+    if (length > 6 && strcmp(path + length - 6, ".scene") == 0)
+    {
+        SceneDescription scene;
+        if (!loadScene(path, &scene)) {return 0;}
+
+        int built = buildSceneMesh(&scene, mesh);
+        freeScene(&scene);
+
+        return built && mesh->triangleCount > 0;
+    }
+
+    memset(mesh, 0, sizeof(MeshData));
+    return loadObj(path, mesh);
+}
+
+static void benchmark(const char* path)
+{
+    MeshData mesh;
+    if (!loadBenchMesh(path, &mesh))
+    {
+        fprintf(stderr, "Skipping %s\n", path);
+        return;
+    }
+
+    BVH bvh;
+    buildBVH(&bvh, &mesh);
+
+    PrecomputedTriangle* triangles = bvh.nodes ? buildPrecomputedTriangles(&mesh) : NULL;
+
+    BVH8 wide;
+    if (!triangles || !buildBVH8(&wide, &bvh, triangles))
+    {
+        free(triangles);
+        free(bvh.nodes);
+        freeMeshData(&mesh);
+        return;
+    }
+
+    BenchRay* rays = allocFirstTouch(sizeof(BenchRay) * RAY_COUNT);
+    RayHit* hitsBinary = allocFirstTouch(sizeof(RayHit) * RAY_COUNT);
+    RayHit* hitsWide = allocFirstTouch(sizeof(RayHit) * RAY_COUNT);
+    if (!rays || !hitsBinary || !hitsWide)
+    {
+        fprintf(stderr, "Out of memory for %d rays\n", RAY_COUNT);
+        free(rays);
+        free(hitsBinary);
+        free(hitsWide);
+        freeBVH8(&wide);
+        free(triangles);
+        free(bvh.nodes);
+        freeMeshData(&mesh);
+        return;
+    }
+
+    generateRays(&bvh.nodes[0], rays, RAY_COUNT);
+
+    // Binary BVH, scalar reference
+    resetHits(hitsBinary, RAY_COUNT);
+    double start = getTimeSeconds();
+    for (int i = 0; i < RAY_COUNT; i++) {traceBVH(&bvh, triangles, rays[i].ro, rays[i].rd, &hitsBinary[i]);}
+    double binaryTime = getTimeSeconds() - start;
+
+    // BVH8, one thread
+    resetHits(hitsWide, RAY_COUNT);
+    start = getTimeSeconds();
+    for (int i = 0; i < RAY_COUNT; i++) {traceBVH8(&wide, rays[i].ro, rays[i].rd, &hitsWide[i]);}
+    double wideTime = getTimeSeconds() - start;
+
+    // BVH8 on the pool
+    TraceJob job = {&wide, rays, hitsWide};
+    resetHits(hitsWide, RAY_COUNT);
+    start = getTimeSeconds();
+    parallelFor(RAY_COUNT, RAY_GRAIN, traceRange, &job);
+    double poolTime = getTimeSeconds() - start;
+
+    // Binary BVH decoding quantized vertices, compared against the float reference
+    QuantizationFrame frame;
+    QuantizedVertex* quantized = quantizeMesh(&mesh, &frame);
+    double quantizedTime = 0.0;
+    int quantizedMismatches = 0;
+    if (quantized)
+    {
+        padBVHBounds(&bvh, frame.maxError);
+
+        RayHit hit;
+        start = getTimeSeconds();
+        for (int i = 0; i < RAY_COUNT; i++)
+        {
+            hit.t = 1e30f;
+            hit.triIndex = NO_HIT;
+            traceBVHQuantized(&bvh, quantized, mesh.indices, &frame, rays[i].ro, rays[i].rd, &hit);
+            if (fabsf(hitsBinary[i].t - hit.t) > 1e-3f * hitsBinary[i].t) {quantizedMismatches++;}
+        }
+        quantizedTime = getTimeSeconds() - start;
+    }
+
+    int hits = 0;
+    int mismatches = 0;
+    for (int i = 0; i < RAY_COUNT; i++)
+    {
+        if (hitsBinary[i].triIndex != NO_HIT) {hits++;}
+        if (fabsf(hitsBinary[i].t - hitsWide[i].t) > 1e-3f * hitsBinary[i].t) {mismatches++;}
+    }
+
+    printf("\n%s: %u triangles, %d rays, %.1f%% hit\n", path, mesh.triangleCount, RAY_COUNT, 100.0 * hits / RAY_COUNT);
+    printf("BVH2 scalar:      %8.2f Mrays/s\n", RAY_COUNT / binaryTime * 1e-6);
+    printf("BVH8 1 thread:    %8.2f Mrays/s\n", RAY_COUNT / wideTime * 1e-6);
+    printf("BVH8 %2d threads:  %8.2f Mrays/s\n", threadPoolSize(), RAY_COUNT / poolTime * 1e-6);
+    if (mismatches > 0) {printf("Mismatching hits: %d\n", mismatches);}
+    if (quantized)
+    {
+        printf("BVH2 quantized:   %8.2f Mrays/s\n", RAY_COUNT / quantizedTime * 1e-6);
+        if (quantizedMismatches > 0) {printf("Quantized mismatching hits: %d\n", quantizedMismatches);}
+    }
+
+    free(rays);
+    free(hitsBinary);
+    free(hitsWide);
+    free(quantized);
+    freeBVH8(&wide);
+    free(triangles);
+    free(bvh.nodes);
+    freeMeshData(&mesh);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* defaults[] = {"models/bunny.obj", "models/cessna.obj", "scenes/city.scene"};
+
+    threadPoolInit(&getConfig()->threads);
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++) {benchmark(argv[i]);}
+    }
+    else
+    {
+        for (int i = 0; i < 3; i++) {benchmark(defaults[i]);}
+    }
+
+    threadPoolShutdown();
+    return 0;
+}
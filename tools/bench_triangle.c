@@ -0,0 +1,157 @@
+// Copyright (c) 2026 Henri Paasonen - GPLv2
+// See LICENSE for details
+
+// Intersection throughput of the indexed Moller-Trumbore routine against
+// the watertight test over precomputed leaf ordered triangles.
+// Usage: glt-bench-tri [model.obj] [rays]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "obj_loader.h"
+#include "bvh.h"
+#include "triangle.h"
+#include "timer.h"
+
+// Triangles tested per ray, roughly a few BVH leaves
+#define TESTS_PER_RAY 32
+
+typedef struct 
+{
+    float ro[3];
+    float rd[3];
+    uint32_t firstTri;
+} BenchRay;
+
+static uint32_t g_rngState = 12345u;
+
+static float randomFloat(void)
+{
+    g_rngState = g_rngState * 747796405u + 2891336453u;
+    uint32_t word = ((g_rngState >> ((g_rngState >> 28u) + 4u)) ^ g_rngState) * 277803737u;
+    return (float)(((word >> 22u) ^ word) * 2.3283064365386963e-10);
+}
+
+// Rays from the bounds towards a random point on a random triangle
+static void generateRays(const MeshData* mesh, BenchRay* rays, int rayCount)
+{
+    float center[3];
+    float radius = 0.0f;
+
+    for (int a = 0; a < 3; a++)
+    {
+        center[a] = 0.5f * (mesh->minBounds[a] + mesh->maxBounds[a]);
+        float extent = mesh->maxBounds[a] - mesh->minBounds[a];
+        radius += extent * extent;
+    }
+    radius = sqrtf(radius);
+
+    for (int i = 0; i < rayCount; i++)
+    {
+        uint32_t tri = (uint32_t)(randomFloat() * mesh->triangleCount) % mesh->triangleCount;
+
+        float u = randomFloat();
+        float v = randomFloat();
+        if (u + v > 1.0f) {u = 1.0f - u; v = 1.0f - v;}
+
+        const GPUPackedVertex* p0 = &mesh->vertices[mesh->indices[tri * 3 + 0]];
+        const GPUPackedVertex* p1 = &mesh->vertices[mesh->indices[tri * 3 + 1]];
+        const GPUPackedVertex* p2 = &mesh->vertices[mesh->indices[tri * 3 + 2]];
+
+        float target[3] = 
+        {
+            p0->x + u * (p1->x - p0->x) + v * (p2->x - p0->x),
+            p0->y + u * (p1->y - p0->y) + v * (p2->y - p0->y),
+            p0->z + u * (p1->z - p0->z) + v * (p2->z - p0->z)
+        };
+
+        float theta = randomFloat() * 6.2831853f;
+        float z = randomFloat() * 2.0f - 1.0f;
+        float r = sqrtf(1.0f - z * z);
+
+        rays[i].ro[0] = center[0] + radius * r * cosf(theta);
+        rays[i].ro[1] = center[1] + radius * r * sinf(theta);
+        rays[i].ro[2] = center[2] + radius * z;
+
+        float len = 0.0f;
+        for (int a = 0; a < 3; a++)
+        {
+            rays[i].rd[a] = target[a] - rays[i].ro[a];
+            len += rays[i].rd[a] * rays[i].rd[a];
+        }
+        len = sqrtf(len);
+        for (int a = 0; a < 3; a++) {rays[i].rd[a] /= len;}
+
+        // Test a window of neighbouring leaf triangles around the target
+        rays[i].firstTri = (tri >= TESTS_PER_RAY / 2) ? tri - TESTS_PER_RAY / 2 : 0;
+        if (rays[i].firstTri + TESTS_PER_RAY > mesh->triangleCount)
+        {
+            rays[i].firstTri = mesh->triangleCount > TESTS_PER_RAY ? mesh->triangleCount - TESTS_PER_RAY : 0;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : "models/bunny.obj";
+    int rayCount = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    MeshData mesh = {0};
+    if (!loadObj(path, &mesh)) {return 1;}
+    if (mesh.triangleCount < TESTS_PER_RAY)
+    {
+        fprintf(stderr, "Mesh too small for benchmark: %u triangles\n", mesh.triangleCount);
+        return 1;
+    }
+
+    BVH bvh;
+    buildBVH(&bvh, &mesh);
+    if (!bvh.nodes) {return 1;}
+
+    PrecomputedTriangle* triangles = buildPrecomputedTriangles(&mesh);
+    BenchRay* rays = malloc(sizeof(BenchRay) * rayCount);
+    if (!triangles || !rays) {return 1;}
+
+    generateRays(&mesh, rays, rayCount);
+
+    uint64_t tests = (uint64_t)rayCount * TESTS_PER_RAY;
+
+    // Indexed Moller-Trumbore
+    int hitsIndexed = 0;
+    double start = getTimeSeconds();
+    for (int i = 0; i < rayCount; i++)
+    {
+        for (uint32_t t = rays[i].firstTri; t < rays[i].firstTri + TESTS_PER_RAY; t++)
+        {
+            if (hitTriangleIndexed(&mesh, t, rays[i].ro, rays[i].rd) > 0.0f) {hitsIndexed++;}
+        }
+    }
+    double indexedTime = getTimeSeconds() - start;
+
+    // Watertight, per ray setup included in the timing
+    int hitsWatertight = 0;
+    start = getTimeSeconds();
+    for (int i = 0; i < rayCount; i++)
+    {
+        WatertightRay ray;
+        setupWatertightRay(rays[i].rd, &ray);
+
+        for (uint32_t t = rays[i].firstTri; t < rays[i].firstTri + TESTS_PER_RAY; t++)
+        {
+            if (hitTriangleWatertight(&triangles[t], rays[i].ro, &ray, NULL) > 0.0f) {hitsWatertight++;}
+        }
+    }
+    double watertightTime = getTimeSeconds() - start;
+
+    printf("\n%s: %u triangles, %d rays x %d tests\n", path, mesh.triangleCount, rayCount, TESTS_PER_RAY);
+    printf("Moller-Trumbore:  %8.2f M isect/s  (%d hits)\n", tests / indexedTime * 1e-6, hitsIndexed);
+    printf("Watertight:       %8.2f M isect/s  (%d hits)\n", tests / watertightTime * 1e-6, hitsWatertight);
+
+    free(rays);
+    free(triangles);
+    free(bvh.nodes);
+    freeMeshData(&mesh);
+
+    return 0;
+}
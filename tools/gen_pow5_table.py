@@ -0,0 +1,35 @@
+# Copyright (c) 2026 Henri Paasonen - GPLv2
+# See LICENSE for details
+
+# Prints the 128 bit truncated powers of five used by parseFloat in
+# src/parse_util.c. Covers every decimal exponent that can round to a
+# finite nonzero float, 5^-65 .. 5^38.
+
+SMALLEST_POWER = -65
+LARGEST_POWER = 38
+
+def power_of_five(q):
+    if q >= 0:
+        value = 5 ** q
+        while value < (1 << 127):
+            value *= 2
+        while value >= (1 << 128):
+            value //= 2
+        return value
+
+    divisor = 5 ** -q
+    z = divisor.bit_length()
+    bits = z + 127 if q >= -27 else 2 * z + 2 * 64
+    value = (1 << bits) // divisor + 1
+    while value >= (1 << 128):
+        value //= 2
+    return value
+
+print("static const uint64_t g_powersOfFive[][2] =")
+print("{")
+for q in range(SMALLEST_POWER, LARGEST_POWER + 1):
+    value = power_of_five(q)
+    hi = value >> 64
+    lo = value & ((1 << 64) - 1)
+    print("    {0x%016xull, 0x%016xull}, // 5^%d" % (hi, lo, q))
+print("};")
@@ -0,0 +1,305 @@
+// Copyright (c) 2026 Henri Paasonen - GPLv2
+// See LICENSE for details
+
+// Loads a scene the way the renderer does, without GL, and reports what it
+// costs: wall time and peak RSS after every stage, triangles per source,
+// instance expansion, BVH quality and the bytes of every SSBO setupSceneData
+// would upload. --json prints the same as one JSON object on stdout, the
+// loaders' progress lines then go to stderr.
+// Usage: glt-inspect <scene> [--json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define fileno _fileno
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+#include "scene_loader.h"
+#include "bvh.h"
+#include "triangle.h"
+#include "vertex_quant.h"
+#include "thread_pool.h"
+#include "config.h"
+#include "timer.h"
+
+#define MAX_STAGES 8
+
+typedef struct
+{
+    const char* name;
+    double seconds;
+    double peakMB;      // Process peak after the stage, not the stage's own share
+} Stage;
+
+typedef struct
+{
+    int binding;
+    const char* name;
+    size_t bytes;
+} BufferSize;
+
+static double getPeakMB(void)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {return 0.0;}
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {return 0.0;}
+    return usage.ru_maxrss / 1024.0;    // KB on Linux
+#endif
+}
+
+static Stage g_stages[MAX_STAGES];
+static int g_stageCount = 0;
+static double g_stageStart;
+
+static void beginStage(void)
+{
+    g_stageStart = getTimeSeconds();
+}
+
+static void endStage(const char* name)
+{
+    if (g_stageCount == MAX_STAGES) {return;}
+
+    Stage* stage = &g_stages[g_stageCount++];
+    stage->name = name;
+    stage->seconds = getTimeSeconds() - g_stageStart;
+    stage->peakMB = getPeakMB();
+}
+
+static void printJsonString(const char* s)
+{
+    putchar('"');
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\') {printf("\\%c", *s);}
+        else if ((unsigned char)*s < 0x20) {printf("\\u%04x", (unsigned char)*s);}
+        else {putchar(*s);}
+    }
+    putchar('"');
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <scene> [--json]\n", argv[0]);
+        return 1;
+    }
+
+    const char* scenePath = argv[1];
+    int json = argc > 2 && strcmp(argv[2], "--json") == 0;
+
+    // Core progress output would break the JSON, it goes to stderr meanwhile
+    int savedStdout = -1;
+    if (json)
+    {
+        fflush(stdout);
+        savedStdout = dup(fileno(stdout));
+        dup2(fileno(stderr), fileno(stdout));
+    }
+
+    threadPoolInit(&getConfig()->threads);
+
+    SceneDescription scene;
+    beginStage();
+    int loaded = loadScene(scenePath, &scene);
+    endStage("load scene");
+
+    if (!loaded)
+    {
+        fprintf(stderr, "Failed to load scene %s\n", scenePath);
+        threadPoolShutdown();
+        return 1;
+    }
+
+    beginStage();
+    MeshData sceneMesh;
+    int built = buildSceneMesh(&scene, &sceneMesh);
+    endStage("build scene mesh");
+
+    BVH bvh = {0};
+    beginStage();
+    if (built && sceneMesh.triangleCount > 0)
+    {
+        buildBVH(&bvh, &sceneMesh);
+        built = bvh.nodes != NULL;
+    }
+    endStage("build BVH");
+
+    if (!built)
+    {
+        fprintf(stderr, "Failed to build the scene mesh of %s\n", scenePath);
+        freeMeshData(&sceneMesh);
+        freeScene(&scene);
+        threadPoolShutdown();
+        return 1;
+    }
+
+    // Same buffers as setupSceneData and uploadSpheres, built to be measured
+    beginStage();
+    QuantizedVertex* quantized = NULL;
+    QuantizationFrame frame;
+#if QUANTIZED_VERTICES
+    if (sceneMesh.triangleCount > 0) {quantized = quantizeMesh(&sceneMesh, &frame);}
+#endif
+    (void)frame;
+
+    PrecomputedTriangle* triangles = NULL;
+#if WATERTIGHT_TRIANGLES
+    if (!quantized && sceneMesh.triangleCount > 0) {triangles = buildPrecomputedTriangles(&sceneMesh);}
+#endif
+
+    uint32_t* triangleNormals = sceneMesh.triangleCount > 0 ? buildTriangleNormals(&sceneMesh) : NULL;
+
+    BVH sphereBvh = {0};
+    AABB* sphereBounds = scene.sphereCount > 0 ? malloc(sizeof(AABB) * scene.sphereCount) : NULL;
+    uint32_t* sphereOrder = scene.sphereCount > 0 ? malloc(sizeof(uint32_t) * scene.sphereCount) : NULL;
+    if (sphereBounds && sphereOrder)
+    {
+        for (int i = 0; i < scene.sphereCount; i++)
+        {
+            const Sphere* s = &scene.spheres[i];
+            float center[3] = {s->px, s->py, s->pz};
+            for (int a = 0; a < 3; a++)
+            {
+                sphereBounds[i].min[a] = center[a] - s->radius;
+                sphereBounds[i].max[a] = center[a] + s->radius;
+            }
+        }
+        buildBoxBVH(&sphereBvh, sphereBounds, (uint32_t)scene.sphereCount, SPHERE_LEAF_SIZE, sphereOrder);
+    }
+    endStage("prepare buffers");
+
+    // Placeholders hold one element where the renderer would upload nothing
+    BufferSize buffers[] =
+    {
+        {0, "spheres", sizeof(Sphere) * (sphereBvh.nodes ? (size_t)scene.sphereCount : 1)},
+        {1, "materials", sizeof(Material) * (size_t)scene.materialCount},
+        {2, quantized ? "vertices (quantized)" : "vertices", (quantized ? sizeof(QuantizedVertex) : sizeof(GPUPackedVertex)) * sceneMesh.vertexCount},
+        {3, "indices", sizeof(uint32_t) * (size_t)sceneMesh.indexCount},
+        {4, "bvh nodes", sizeof(BVHNode) * bvh.nodeCount},
+        {5, "triangle materials", sizeof(uint32_t) * (size_t)sceneMesh.triangleCount},
+        {6, "precomputed triangles", sizeof(PrecomputedTriangle) * (triangles ? (size_t)sceneMesh.triangleCount : 1)},
+        {7, "triangle normals", sizeof(uint32_t) * (size_t)sceneMesh.triangleCount},
+        {8, "sphere bvh nodes", sizeof(BVHNode) * (sphereBvh.nodes ? sphereBvh.nodeCount : 1)}
+    };
+    int bufferCount = (int)(sizeof(buffers) / sizeof(buffers[0]));
+
+    size_t totalBytes = 0;
+    for (int i = 0; i < bufferCount; i++) {totalBytes += buffers[i].bytes;}
+
+    BVHStats stats = {0, 0, 0};
+    if (bvh.nodeCount > 0) {getStatsRecursive(&bvh, 0, 1, &stats);}
+    float trisPerLeaf = stats.leafCount > 0 ? (float)stats.totalTrisInLeaves / stats.leafCount : 0.0f;
+    float sahCost = bvh.nodeCount > 0 ? computeBVHCost(&bvh) : 0.0f;
+
+    // Expansion against every source an instance draws from, LOD levels included
+    int* instanceCounts = calloc(scene.numberOfSources + 1, sizeof(int));
+    uint64_t usedSourceTriangles = 0;
+    for (int i = 0; instanceCounts && i < scene.numberOfInstances; i++)
+    {
+        int source = scene.meshInstances[i].meshSourceIndex;
+        if (source < 0 || source >= scene.numberOfSources) {continue;}
+
+        if (instanceCounts[source]++ == 0) {usedSourceTriangles += scene.meshSources[source].triangleCount;}
+    }
+    double expansion = usedSourceTriangles > 0 ? (double)sceneMesh.triangleCount / (double)usedSourceTriangles : 0.0;
+
+    if (json)
+    {
+        fflush(stdout);
+        dup2(savedStdout, fileno(stdout));
+
+        printf("{\n  \"scene\": ");
+        printJsonString(scenePath);
+        printf(",\n  \"stages\": [\n");
+        for (int i = 0; i < g_stageCount; i++)
+        {
+            printf("    {\"name\": \"%s\", \"seconds\": %.6f, \"peak_rss_mb\": %.2f}%s\n", g_stages[i].name,
+                g_stages[i].seconds, g_stages[i].peakMB, i + 1 < g_stageCount ? "," : "");
+        }
+        printf("  ],\n  \"sources\": [\n");
+        for (int i = 0; i < scene.numberOfSources; i++)
+        {
+            printf("    {\"path\": ");
+            printJsonString(scene.sourcePaths[i]);
+            printf(", \"triangles\": %u, \"vertices\": %u, \"instances\": %d}%s\n", scene.meshSources[i].triangleCount,
+                scene.meshSources[i].vertexCount, instanceCounts ? instanceCounts[i] : 0, i + 1 < scene.numberOfSources ? "," : "");
+        }
+        printf("  ],\n");
+        printf("  \"instances\": %d,\n  \"materials\": %d,\n  \"spheres\": %d,\n", scene.numberOfInstances, scene.materialCount, scene.sphereCount);
+        printf("  \"world_triangles\": %u,\n  \"world_vertices\": %u,\n  \"instance_expansion\": %.4f,\n",
+            sceneMesh.triangleCount, sceneMesh.vertexCount, expansion);
+        printf("  \"bvh\": {\"nodes\": %u, \"leaves\": %d, \"max_depth\": %d, \"triangles_per_leaf\": %.3f, \"sah_cost\": %.3f},\n",
+            bvh.nodeCount, stats.leafCount, stats.maxDepth, trisPerLeaf, sahCost);
+        printf("  \"buffers\": [\n");
+        for (int i = 0; i < bufferCount; i++)
+        {
+            printf("    {\"binding\": %d, \"name\": \"%s\", \"bytes\": %zu}%s\n", buffers[i].binding, buffers[i].name,
+                buffers[i].bytes, i + 1 < bufferCount ? "," : "");
+        }
+        printf("  ],\n  \"buffer_bytes\": %zu\n}\n", totalBytes);
+    }
+    else
+    {
+        printf("\nScene %s\n\n", scenePath);
+        printf("%-20s %10s %12s\n", "Stage", "Time", "Peak RSS");
+        for (int i = 0; i < g_stageCount; i++)
+        {
+            printf("%-20s %8.3f s %9.1f MB\n", g_stages[i].name, g_stages[i].seconds, g_stages[i].peakMB);
+        }
+
+        printf("\nSources (%d)\n", scene.numberOfSources);
+        for (int i = 0; i < scene.numberOfSources; i++)
+        {
+            printf("  %-40s %10u tris %10u verts %6d instances\n", scene.sourcePaths[i], scene.meshSources[i].triangleCount,
+                scene.meshSources[i].vertexCount, instanceCounts ? instanceCounts[i] : 0);
+        }
+
+        printf("\nInstances:          %d (%d materials, %d spheres)\n", scene.numberOfInstances, scene.materialCount, scene.sphereCount);
+        printf("World triangles:    %u (%u vertices)\n", sceneMesh.triangleCount, sceneMesh.vertexCount);
+        printf("Instance expansion: %.2fx\n", expansion);
+
+        printf("\nBVH nodes:          %u\n", bvh.nodeCount);
+        printf("Leaves:             %d\n", stats.leafCount);
+        printf("Max depth:          %d\n", stats.maxDepth);
+        printf("Tris per leaf:      %.2f\n", trisPerLeaf);
+        printf("SAH cost:           %.2f\n", sahCost);
+
+        printf("\nGPU buffers\n");
+        for (int i = 0; i < bufferCount; i++)
+        {
+            printf("  %d %-24s %12.2f KB\n", buffers[i].binding, buffers[i].name, buffers[i].bytes / 1024.0);
+        }
+        printf("  %-26s %12.2f KB\n", "total", totalBytes / 1024.0);
+    }
+
+    free(instanceCounts);
+    free(sphereBounds);
+    free(sphereOrder);
+    free(sphereBvh.nodes);
+    free(triangleNormals);
+    free(triangles);
+    free(quantized);
+    free(bvh.nodes);
+    freeMeshData(&sceneMesh);
+    freeScene(&scene);
+    threadPoolShutdown();
+
+    return 0;
+}
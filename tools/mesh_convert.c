@@ -0,0 +1,41 @@
+// Copyright (c) 2026 Henri Paasonen - GPLv2
+// See LICENSE for details
+
+// Converts an OBJ into the binary .gltm format that loadObj maps directly.
+// Usage: glt-mesh-convert <model.obj> <model.gltm> [weld tolerance]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "obj_loader.h"
+#include "mesh_file.h"
+#include "mesh_weld.h"
+#include "thread_pool.h"
+#include "config.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <model.obj> <model.gltm> [weld tolerance]\n", argv[0]);
+        return 1;
+    }
+
+    threadPoolInit(&getConfig()->threads);
+
+    MeshData mesh;
+    memset(&mesh, 0, sizeof(MeshData));
+
+    int converted = loadObj(argv[1], &mesh);
+
+    if (converted && argc > 3) {converted = weldMesh(&mesh, (float)atof(argv[3]));}
+    if (converted) {converted = writeMeshFile(argv[2], &mesh);}
+
+    if (converted) {printf("Wrote %s\n", argv[2]);}
+
+    freeMeshData(&mesh);
+    threadPoolShutdown();
+
+    return converted ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+// Copyright (c) 2026 Henri Paasonen - GPLv2
+// See LICENSE for details
+
+// Converts an OBJ of any size into a .gltm with a prebuilt BVH while keeping
+// the heap under the given limit. Spill files go next to the output.
+// Usage: glt-mesh-ingest <model.obj> <model.gltm> [memory limit MB]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mesh_ingest.h"
+
+#define DEFAULT_MEMORY_LIMIT_MB 2048
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <model.obj> <model.gltm> [memory limit MB]\n", argv[0]);
+        return 1;
+    }
+
+    long limitMB = argc > 3 ? atol(argv[3]) : DEFAULT_MEMORY_LIMIT_MB;
+    if (limitMB <= 0)
+    {
+        fprintf(stderr, "Memory limit must be a positive number of MB\n");
+        return 1;
+    }
+
+    if (!ingestObj(argv[1], argv[2], (size_t)limitMB << 20)) {return 1;}
+
+    printf("Wrote %s\n", argv[2]);
+    return 0;
+}
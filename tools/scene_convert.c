@@ -0,0 +1,87 @@
+// Copyright (c) 2026 Henri Paasonen - GPLv2
+// See LICENSE for details
+
+// Converts a text .scene into the binary .glts container that loadScene maps.
+// --embed also stores every source mesh with its BVH, the scene then loads
+// without touching the model files.
+// Usage: glt-scene-convert <in.scene> <out.glts> [--embed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scene_loader.h"
+#include "scene_file.h"
+#include "bvh.h"
+#include "thread_pool.h"
+#include "config.h"
+
+// Loads what is not embedded yet and builds the trees ingested meshes already carry
+static int loadForEmbedding(SceneDescription* scene, BVH* trees)
+{
+    for (int i = 0; i < scene->numberOfSources; i++)
+    {
+        MeshData* mesh = &scene->meshSources[i];
+
+        if (!mesh->mapping && !loadObj(scene->sourcePaths[i], mesh))
+        {
+            fprintf(stderr, "Failed to load mesh: %s\n", scene->sourcePaths[i]);
+            return 0;
+        }
+
+        if (mesh->bvhNodes || mesh->triangleCount == 0) {continue;}
+
+        buildBVH(&trees[i], mesh);
+        if (!trees[i].nodes) {return 0;}
+        mesh->bvhNodes = trees[i].nodes;
+        mesh->bvhNodeCount = trees[i].nodeCount;
+    }
+
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <in.scene> <out.glts> [--embed]\n", argv[0]);
+        return 1;
+    }
+
+    int embed = argc > 3 && strcmp(argv[3], "--embed") == 0;
+
+    threadPoolInit(&getConfig()->threads);
+
+    SceneDescription scene;
+    if (!readScene(argv[1], &scene))
+    {
+        threadPoolShutdown();
+        return 1;
+    }
+
+    BVH* trees = calloc(scene.numberOfSources ? scene.numberOfSources : 1, sizeof(BVH));
+    int converted = trees != NULL;
+
+    if (converted && embed) {converted = loadForEmbedding(&scene, trees);}
+    if (converted) {converted = writeSceneFile(argv[2], &scene, embed);}
+
+    if (converted)
+    {
+        printf("Wrote %s: %d materials, %d sources%s, %d instances, %d spheres\n", argv[2], scene.materialCount,
+            scene.numberOfSources, embed ? " embedded" : "", scene.numberOfInstances, scene.sphereCount);
+    }
+
+    // Trees built here belong to this tool, mapped meshes would not free them
+    for (int i = 0; trees && i < scene.numberOfSources; i++)
+    {
+        if (!trees[i].nodes) {continue;}
+        if (scene.meshSources[i].bvhNodes == trees[i].nodes) {scene.meshSources[i].bvhNodes = NULL;}
+        free(trees[i].nodes);
+    }
+
+    free(trees);
+    freeScene(&scene);
+    threadPoolShutdown();
+
+    return converted ? 0 : 1;
+}
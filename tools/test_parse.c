@@ -0,0 +1,161 @@
+// Copyright (c) 2026 Henri Paasonen - GPLv2
+// See LICENSE for details
+
+// Round trip check of parseFloat against strtof in the "C" locale. Every
+// positive finite float (or every stride-th one) is printed shortest round
+// trip (%.9g), in short scientific (%.6e) and as the midpoint to the next
+// float (%.40e), the ties and near ties Eisel-Lemire has to get right. Both
+// parsers must give the same bits and parseFloat must consume the whole
+// string. A fixed list of edge cases runs first. Exits 1 on any mismatch.
+// Usage: glt-test-parse [stride]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+#include "parse_util.h"
+#include "thread_pool.h"
+#include "config.h"
+#include "timer.h"
+
+// Floats per parallelFor task, the first mismatches of each worker are kept
+#define CHECK_GRAIN 65536
+#define MAX_REPORTS 8
+
+// 0x7F800000 is infinity, everything below it is finite
+#define FINITE_FLOATS 0x7F800000u
+
+typedef struct
+{
+    uint32_t stride;
+    uint64_t* checked;      // Per worker
+    uint64_t* mismatches;
+    char (*reports)[MAX_REPORTS][96];
+} CheckJob;
+
+static const char* g_edgeCases[] =
+{
+    "0", "-0", "+0", "0.0", ".5", "5.", "-.5e1", "1e0", "1E+2", "1e-2",
+    "3.4028235e38", "3.4028236e38", "3.40282357e38", "3.4028237e38", "1e39", "-1e39",
+    "1.17549435e-38", "1.1754942e-38", "1.401298464e-45", "7.006492e-46", "7.006493e-46", "1e-46", "-1e-50",
+    "16777216", "16777217", "16777218", "16777219", "33554433",
+    "0.1", "0.2", "0.3", "1.00000006", "1.00000018", "0.000000059604644775390625",
+    "123456789012345678901234567890", "0.000000000000000000000000000000000000000123456789",
+    "1.000000059604644775390625000000000000000000000000000001", "1.000000059604644775390624999999999999999999999999999999",
+    "00000000000000000000000000012.5", "1e100000000", "1e-100000000", "2.5e-45"
+};
+
+static int checkString(const char* text, char* report, size_t reportSize)
+{
+    size_t length = strlen(text);
+    float expected = strtof(text, NULL);
+    float parsed = 0.0f;
+    const char* end = parseFloat(text, text + length, &parsed);
+
+    uint32_t expectedBits, parsedBits;
+    memcpy(&expectedBits, &expected, sizeof(float));
+    memcpy(&parsedBits, &parsed, sizeof(float));
+
+    if (expectedBits == parsedBits && end == text + length) {return 1;}
+
+    if (report) {snprintf(report, reportSize, "%s: strtof %08x, parseFloat %08x, %d of %d chars", text, expectedBits, parsedBits, (int)(end - text), (int)length);}
+    return 0;
+}
+
+static void checkRange(void* context, size_t begin, size_t end, int worker)
+{
+    CheckJob* job = context;
+    char text[96];
+
+    for (size_t i = begin; i < end; i++)
+    {
+        uint32_t bits = (uint32_t)(i * job->stride);
+        float value, next;
+        memcpy(&value, &bits, sizeof(float));
+        uint32_t nextBits = bits + 1;
+        memcpy(&next, &nextBits, sizeof(float));
+
+        // The midpoint of two floats is exact in double
+        const char* formats[3] = {"%.9g", "%.6e", "%.40e"};
+        double values[3] = {value, value, ((double)value + (double)next) * 0.5};
+
+        // Past the largest float the midpoint is infinity, which strtof reads and parseFloat does not
+        int formatCount = nextBits < FINITE_FLOATS ? 3 : 2;
+
+        for (int f = 0; f < formatCount; f++)
+        {
+            snprintf(text, sizeof(text), formats[f], values[f]);
+            job->checked[worker]++;
+
+            uint64_t failed = job->mismatches[worker];
+            char* report = failed < MAX_REPORTS ? job->reports[worker][failed] : NULL;
+            if (!checkString(text, report, sizeof(job->reports[worker][0]))) {job->mismatches[worker]++;}
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t stride = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 1;
+    if (stride == 0)
+    {
+        fprintf(stderr, "Usage: %s [stride]\n", argv[0]);
+        return 1;
+    }
+
+    setlocale(LC_ALL, "C");
+    threadPoolInit(&getConfig()->threads);
+
+    int failures = 0;
+    int edgeCount = (int)(sizeof(g_edgeCases) / sizeof(g_edgeCases[0]));
+    for (int i = 0; i < edgeCount; i++)
+    {
+        char report[256];
+        if (!checkString(g_edgeCases[i], report, sizeof(report)))
+        {
+            printf("Mismatch %s\n", report);
+            failures++;
+        }
+    }
+    printf("Edge cases: %d of %d match\n", edgeCount - failures, edgeCount);
+
+    int workers = threadPoolSize();
+    CheckJob job = {stride, calloc(workers, sizeof(uint64_t)), calloc(workers, sizeof(uint64_t)), calloc(workers, sizeof(*job.reports))};
+    if (!job.checked || !job.mismatches || !job.reports)
+    {
+        fprintf(stderr, "Out of memory\n");
+        free(job.checked);
+        free(job.mismatches);
+        free(job.reports);
+        threadPoolShutdown();
+        return 1;
+    }
+
+    // Every multiple of stride below infinity
+    size_t count = (FINITE_FLOATS - 1) / stride + 1;
+
+    double start = getTimeSeconds();
+    parallelFor(count, CHECK_GRAIN, checkRange, &job);
+    double seconds = getTimeSeconds() - start;
+
+    uint64_t checked = 0;
+    uint64_t mismatches = 0;
+    for (int w = 0; w < workers; w++)
+    {
+        checked += job.checked[w];
+        mismatches += job.mismatches[w];
+
+        for (uint64_t r = 0; r < job.mismatches[w] && r < MAX_REPORTS; r++) {printf("Mismatch %s\n", job.reports[w][r]);}
+    }
+
+    printf("Floats: %llu strings checked (stride %u) in %.1f s, %llu mismatches\n", (unsigned long long)checked,
+        stride, seconds, (unsigned long long)mismatches);
+
+    free(job.checked);
+    free(job.mismatches);
+    free(job.reports);
+    threadPoolShutdown();
+
+    return failures > 0 || mismatches > 0;
+}
@@ -0,0 +1,323 @@
+// Copyright (c) 2026 Henri Paasonen - GPLv2
+// See LICENSE for details
+
+// Checks the SIMD affine routines against their scalar versions on random
+// transforms and inputs. transformPoints, transformVectors and
+// transformBoxes must give the same bits as the scalar ones, counts cover
+// every tail length and in place calls. Boxes must also hold every
+// transformed corner and interior point. affineInverse is compared against
+// a double precision inverse and must refuse singular matrices without
+// touching its output. Exits 1 on any mismatch.
+// Usage: glt-test-simd [cases] [seed]
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "simd_math.h"
+#include "matrix.h"
+
+// Longest batch, covers every tail of the vector width a few times over
+#define MAX_BATCH 67
+#define MAX_REPORTS 8
+
+typedef struct
+{
+    const char* name;
+    unsigned long long checked;
+    unsigned long long mismatches;
+} CheckCount;
+
+static uint32_t g_rngState = 12345u;
+
+static float randomFloat(void)
+{
+    g_rngState = g_rngState * 747796405u + 2891336453u;
+    uint32_t word = ((g_rngState >> ((g_rngState >> 28u) + 4u)) ^ g_rngState) * 277803737u;
+    return (float)(((word >> 22u) ^ word) * 2.3283064365386963e-10);
+}
+
+static float randomRange(float low, float high)
+{
+    return low + randomFloat() * (high - low);
+}
+
+// Half are scene style translate, scale and rotate, half any well conditioned 3x4
+static Affine3x4 randomAffine(void)
+{
+    if (randomFloat() < 0.5f)
+    {
+        Vec4 position = {randomRange(-1000.0f, 1000.0f), randomRange(-1000.0f, 1000.0f), randomRange(-1000.0f, 1000.0f), 1.0f};
+        Vec4 scale = {randomRange(0.05f, 20.0f), randomRange(0.05f, 20.0f), randomRange(0.05f, 20.0f), 1.0f};
+        Vec4 rotation = {randomRange(-6.3f, 6.3f), randomRange(-6.3f, 6.3f), randomRange(-6.3f, 6.3f), 1.0f};
+        Mat4 m = transformMatrix(position, scale, rotation);
+        return affineFromMat4(&m);
+    }
+
+    Affine3x4 m;
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 4; c++) {m.m[r][c] = randomRange(-4.0f, 4.0f);}
+        m.m[r][r] += randomFloat() < 0.5f ? -6.0f : 6.0f;
+    }
+    return m;
+}
+
+// Mostly mesh scale values, some large and tiny ones for rounding at the ends
+static float randomValue(void)
+{
+    float pick = randomFloat();
+    if (pick < 0.8f) {return randomRange(-100.0f, 100.0f);}
+    if (pick < 0.9f) {return randomRange(-1e6f, 1e6f);}
+    return randomRange(-1e-3f, 1e-3f);
+}
+
+static void report(CheckCount* check, const char* what, size_t count)
+{
+    if (check->mismatches < MAX_REPORTS) {printf("Mismatch %s: %s, count %zu\n", check->name, what, count);}
+    check->mismatches++;
+}
+
+static void checkPoints(CheckCount* check, const Affine3x4* m, const float* in, size_t count, int inPlace)
+{
+    float simd[4 * MAX_BATCH], scalar[4 * MAX_BATCH];
+    float simdMin[3] = {INFINITY, INFINITY, INFINITY}, simdMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+    float scalarMin[3] = {INFINITY, INFINITY, INFINITY}, scalarMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+
+    memcpy(simd, in, sizeof(float) * 4 * count);
+    transformPoints(m, inPlace ? simd : in, simd, count, simdMin, simdMax);
+    transformPointsScalar(m, in, scalar, count, scalarMin, scalarMax);
+
+    check->checked++;
+    if (memcmp(simd, scalar, sizeof(float) * 4 * count) != 0) {report(check, "points differ", count);}
+    else if (memcmp(simdMin, scalarMin, sizeof(simdMin)) != 0 || memcmp(simdMax, scalarMax, sizeof(simdMax)) != 0)
+    {
+        report(check, "bounds differ", count);
+    }
+}
+
+static void checkVectors(CheckCount* check, const Affine3x4* m, const float* in, size_t count, int inPlace)
+{
+    float simd[4 * MAX_BATCH], scalar[4 * MAX_BATCH];
+
+    memcpy(simd, in, sizeof(float) * 4 * count);
+    transformVectors(m, inPlace ? simd : in, simd, count);
+    transformVectorsScalar(m, in, scalar, count);
+
+    check->checked++;
+    if (memcmp(simd, scalar, sizeof(float) * 4 * count) != 0) {report(check, "vectors differ", count);}
+}
+
+static void checkBoxes(CheckCount* check, CheckCount* contain, const Affine3x4* m, size_t count)
+{
+    AABB in[MAX_BATCH], simd[MAX_BATCH], scalar[MAX_BATCH];
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            float x = randomValue();
+            float y = randomFloat() < 0.1f ? x : randomValue();
+            in[i].min[a] = fminf(x, y);
+            in[i].max[a] = fmaxf(x, y);
+        }
+    }
+
+    transformBoxes(m, in, simd, count);
+    transformBoxesScalar(m, in, scalar, count);
+
+    check->checked++;
+    if (memcmp(simd, scalar, sizeof(AABB) * count) != 0) {report(check, "boxes differ", count);}
+
+    // Corners and random interior points through transformPoints
+    for (size_t i = 0; i < count; i++)
+    {
+        float points[4 * 12];
+        for (int k = 0; k < 12; k++)
+        {
+            for (int a = 0; a < 3; a++)
+            {
+                float low = in[i].min[a], high = in[i].max[a];
+                if (k < 8) {points[4 * k + a] = (k >> a) & 1 ? high : low;}
+                else {points[4 * k + a] = fminf(low + randomFloat() * (high - low), high);}
+            }
+            points[4 * k + 3] = 0.0f;
+        }
+        transformPoints(m, points, points, 12, NULL, NULL);
+
+        contain->checked++;
+        for (int k = 0; k < 12; k++)
+        {
+            int inside = 1;
+            for (int a = 0; a < 3; a++) {inside = inside && points[4 * k + a] >= simd[i].min[a] && points[4 * k + a] <= simd[i].max[a];}
+            if (!inside)
+            {
+                report(contain, "transformed point outside its box", count);
+                break;
+            }
+        }
+    }
+}
+
+// Gauss-Jordan with partial pivoting on the 3x3 part
+static int inverseDouble(const Affine3x4* m, double inverse[3][4])
+{
+    double a[3][6];
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            a[r][c] = m->m[r][c];
+            a[r][c + 3] = r == c ? 1.0 : 0.0;
+        }
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+        int pivot = c;
+        for (int r = c + 1; r < 3; r++) {if (fabs(a[r][c]) > fabs(a[pivot][c])) {pivot = r;}}
+        if (a[pivot][c] == 0.0) {return 0;}
+
+        for (int k = 0; k < 6; k++)
+        {
+            double swap = a[c][k];
+            a[c][k] = a[pivot][k];
+            a[pivot][k] = swap;
+        }
+
+        double scale = 1.0 / a[c][c];
+        for (int k = 0; k < 6; k++) {a[c][k] *= scale;}
+
+        for (int r = 0; r < 3; r++)
+        {
+            if (r == c) {continue;}
+            double factor = a[r][c];
+            for (int k = 0; k < 6; k++) {a[r][k] -= factor * a[c][k];}
+        }
+    }
+
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++) {inverse[r][c] = a[r][c + 3];}
+        inverse[r][3] = -(inverse[r][0] * m->m[0][3] + inverse[r][1] * m->m[1][3] + inverse[r][2] * m->m[2][3]);
+    }
+    return 1;
+}
+
+static double rowNorm(const double m[3][4], int columns)
+{
+    double norm = 0.0;
+    for (int r = 0; r < 3; r++)
+    {
+        double sum = 0.0;
+        for (int c = 0; c < columns; c++) {sum += fabs(m[r][c]);}
+        norm = fmax(norm, sum);
+    }
+    return norm;
+}
+
+static void checkInverse(CheckCount* check, const Affine3x4* m)
+{
+    Affine3x4 inverse;
+    double reference[3][4];
+    check->checked++;
+
+    if (!inverseDouble(m, reference))
+    {
+        report(check, "reference singular", 1);
+        return;
+    }
+    if (!affineInverse(m, &inverse))
+    {
+        report(check, "refused an invertible matrix", 1);
+        return;
+    }
+
+    // Float error grows with the condition number, translation with its magnitude
+    double source[3][4];
+    for (int r = 0; r < 3; r++) {for (int c = 0; c < 4; c++) {source[r][c] = m->m[r][c];}}
+    double condition = rowNorm(source, 3) * rowNorm(reference, 3);
+    double tolerance = 64.0 * FLT_EPSILON * condition;
+
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            double scale = c < 3 ? rowNorm(reference, 3) : rowNorm(reference, 3) * rowNorm(source, 4);
+            if (fabs(inverse.m[r][c] - reference[r][c]) > tolerance * scale)
+            {
+                report(check, "element off from the double inverse", 1);
+                return;
+            }
+        }
+    }
+}
+
+static void checkSingular(CheckCount* check)
+{
+    // Third row a blend of the first two, and an all zero matrix
+    Affine3x4 singular[2];
+    memset(singular, 0, sizeof(singular));
+    float u = randomRange(-2.0f, 2.0f);
+    for (int c = 0; c < 4; c++)
+    {
+        singular[0].m[0][c] = (float)(c + 1);
+        singular[0].m[1][c] = (float)(2 * c - 3);
+        singular[0].m[2][c] = singular[0].m[0][c] * u + singular[0].m[1][c] * 2.0f;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        Affine3x4 output, untouched;
+        memset(&output, 0x5A, sizeof(output));
+        untouched = output;
+
+        // Rounding may leave the blend just invertible, only a refusal is checked
+        int inverted = affineInverse(&singular[i], &output);
+        check->checked++;
+        if (!inverted && memcmp(&output, &untouched, sizeof(output)) != 0) {report(check, "output written for a singular matrix", 1);}
+        if (i == 1 && inverted) {report(check, "zero matrix inverted", 1);}
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    long cases = argc > 1 ? strtol(argv[1], NULL, 10) : 20000;
+    if (argc > 2) {g_rngState = (uint32_t)strtoul(argv[2], NULL, 10);}
+    if (cases <= 0)
+    {
+        fprintf(stderr, "Usage: %s [cases] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    CheckCount checks[] = {{"transformPoints", 0, 0}, {"transformVectors", 0, 0}, {"transformBoxes", 0, 0},
+        {"box containment", 0, 0}, {"affineInverse", 0, 0}, {"singular", 0, 0}};
+    const int checkCount = (int)(sizeof(checks) / sizeof(checks[0]));
+
+    float input[4 * MAX_BATCH];
+    for (long i = 0; i < cases; i++)
+    {
+        Affine3x4 m = randomAffine();
+        size_t count = (size_t)(i % (MAX_BATCH + 1));
+
+        // The unused fourth float gets values too, it must not leak into the results
+        for (size_t k = 0; k < 4 * count; k++) {input[k] = randomValue();}
+
+        checkPoints(&checks[0], &m, input, count, (int)(i & 1));
+        checkVectors(&checks[1], &m, input, count, (int)(i & 1));
+        checkBoxes(&checks[2], &checks[3], &m, count);
+        checkInverse(&checks[4], &m);
+        if (i % 64 == 0) {checkSingular(&checks[5]);}
+    }
+
+    unsigned long long mismatches = 0;
+    for (int c = 0; c < checkCount; c++)
+    {
+        printf("%-18s %llu checked, %llu mismatches\n", checks[c].name, checks[c].checked, checks[c].mismatches);
+        mismatches += checks[c].mismatches;
+    }
+
+    return mismatches > 0;
+}